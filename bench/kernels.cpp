@@ -0,0 +1,272 @@
+// In this file: microbenchmarks of the hot kernels.
+//
+// Each kernel runs on synthetic spectra of the real shape. Calls are batched,
+// the batch grown until it lasts long enough to time, which also warms up.
+// The batches then give the median, least and mean time per call, their
+// spread, and the cost per element in nanoseconds and in cycles of the
+// timestamp counter, which ticks at the nominal clock rate.
+//
+// Arguments are options 'key=value': micro.reps - batches, 30 by default,
+// micro.batch_ms - least duration of a batch, 5 by default,
+// micro.filter - only kernels whose name contains it.
+
+
+#include "dat.h"
+#include "dim.h"
+#include "io.h"
+#include "model.h"
+#include "opt.h"
+#include "pre.h"
+#include "score.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+constexpr auto N{ dat::Spectrum::_num_points };
+
+
+// Keep the compiler from optimising away what computed 'v'.
+template< typename T >
+void keep( const T & v )
+{
+    __asm__ __volatile__( "" : : "g"( & v ) : "memory" );
+}
+
+
+std::uint64_t ticks()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+struct Kernel
+{
+    std::string _name;
+    // Per call.
+    size_t _elements;
+    std::function< void () > _f;
+};
+
+
+struct Batch
+{
+    double _ns;
+    double _ticks;
+};
+
+
+Batch time( const Kernel & k, size_t calls )
+{
+    const auto start{ Clock::now() };
+    const auto start_ticks{ ticks() };
+    for( size_t i {}; i < calls; ++i )
+    {
+        k._f();
+    }
+    const auto end_ticks{ ticks() };
+    return { std::chrono::duration< double, std::nano >{ Clock::now() - start }.count()
+           , static_cast< double >( end_ticks - start_ticks ) };
+}
+
+
+void measure( const Kernel & k, std::ostream & out )
+{
+    const auto reps{ std::max( opt::get( "micro.reps", 30u ), 1u ) };
+    const auto batch_ns{ opt::get( "micro.batch_ms", 5. ) * 1e6 };
+
+    size_t calls{ 1 };
+    while( time( k, calls )._ns < batch_ns && calls < ( size_t{ 1 } << 30 ) )
+    {
+        calls *= 2;
+    }
+
+    std::vector< double > ns;
+    std::vector< double > cycles;
+    for( unsigned r {}; r < reps; ++r )
+    {
+        const auto b{ time( k, calls ) };
+        ns.push_back( b._ns / calls );
+        cycles.push_back( b._ticks / calls );
+    }
+    std::sort( ns.begin(), ns.end() );
+    std::sort( cycles.begin(), cycles.end() );
+
+    const auto mean{ std::accumulate( ns.cbegin(), ns.cend(), 0. ) / ns.size() };
+    double variance {};
+    for( const auto t : ns )
+    {
+        variance += ( t - mean ) * ( t - mean ) / ns.size();
+    }
+    const auto median{ ns[ ns.size() / 2 ] };
+    const auto median_cycles{ cycles[ cycles.size() / 2 ] };
+
+    out << std::left << std::setw( 26 ) << k._name << std::right << std::fixed << std::setprecision( 1 )
+        << std::setw( 10 ) << k._elements
+        << std::setw( 14 ) << median << std::setw( 14 ) << ns.front() << std::setw( 14 ) << mean
+        << std::setw( 9 ) << 100 * std::sqrt( variance ) / mean
+        << std::setprecision( 3 ) << std::setw( 12 ) << median / k._elements;
+    if( median_cycles > 0 )
+    {
+        out << std::setw( 12 ) << median_cycles / k._elements;
+    }
+    else
+    {
+        out << std::setw( 12 ) << "-";
+    }
+    out << std::endl;
+}
+
+
+// Smooth background, a few emission peaks and noise, as measured.
+dat::Spectrum synthetic( std::mt19937 & g, unsigned label )
+{
+    std::normal_distribution< double > noise{ 0, 2 };
+    dat::Spectrum s;
+    for( unsigned i {}; i < N; ++i )
+    {
+        s._y[ i ] = 100 + 20 * std::sin( i * 1e-3 ) + noise( g );
+    }
+    for( unsigned p {}; p < 8; ++p )
+    {
+        const auto at{ ( 977 * ( label + 1 ) * ( p + 1 ) ) % N };
+        for( unsigned i{ at > 20 ? at - 20 : 0 }; i < std::min( at + 20, N ); ++i )
+        {
+            s._y[ i ] += 500 * std::exp( - ( double( i ) - at ) * ( double( i ) - at ) / 32 );
+        }
+    }
+    return s;
+}
+
+
+int main( int argc, char ** argv )
+{
+    for( int i{ 1 }; i < argc; ++i )
+    {
+        opt::set( argv[ i ] );
+    }
+    const auto filter{ opt::get< std::string >( "micro.filter", "" ) };
+
+    std::mt19937 g{ 7 };
+    constexpr unsigned LABELS{ 4 };
+    constexpr unsigned PER_LABEL{ 16 };
+    dat::Dataset d;
+    for( unsigned l {}; l < LABELS; ++l )
+    {
+        const auto num{ d.second.encode( "/label" + std::to_string( l ) ) };
+        for( unsigned i {}; i < PER_LABEL; ++i )
+        {
+            d.first[ num ].push_back( synthetic( g, l ) );
+        }
+    }
+    const auto pristine{ synthetic( g, 1 ) };
+
+    // One spectrum as exported by the spectrometer, in lines and in a file.
+    std::vector< std::string > lines;
+    const auto csv{ fs::temp_directory_path() / "rocks_bench.csv" };
+    {
+        std::ofstream f{ csv };
+        f << "wavelength,intensity\r\n";
+        char line[ 64 ];
+        for( unsigned i {}; i < N; ++i )
+        {
+            std::snprintf( line, sizeof( line ), "%.8f,%.4f\r", dat::Spectrum::_x[ i ], pristine._y[ i ] );
+            lines.push_back( line );
+            f << line << '\n';
+        }
+    }
+
+    const pre::Log log{ d };
+    const pre::Norm norm{ d };
+    const dim::Simple simple{ d };
+    auto scratch{ pristine };
+
+    std::vector< label::Num > truth( 10000 );
+    std::vector< label::Num > predicted( truth.size() );
+    std::uniform_int_distribution< label::Num > labels{ 0, LABELS - 1 };
+    for( size_t i {}; i < truth.size(); ++i )
+    {
+        truth[ i ] = labels( g );
+        predicted[ i ] = labels( g );
+    }
+
+    std::vector< Kernel > kernels{
+        { "io::parse", N, [ & ]
+            {
+                double sum {};
+                for( const auto & l : lines )
+                {
+                    sum += io::parse( l );
+                }
+                keep( sum );
+            } }
+      , { "io::read_csv", N, [ & ] { keep( io::read_csv( csv ) ); } }
+        // The baseline of the in-place kernels below, which start from a copy.
+      , { "copy", N, [ & ] { scratch = pristine; keep( scratch ); } }
+      , { "pre::Log", N, [ & ] { scratch = pristine; log( scratch ); keep( scratch ); } }
+      , { "pre::Norm", N, [ & ] { scratch = pristine; norm( scratch ); keep( scratch ); } }
+      , { "dim::Simple", N, [ & ] { keep( simple( pristine ) ); } }
+      , { "score::Counts::add", truth.size(), [ & ]
+            {
+                score::Counts c{ LABELS };
+                for( size_t i {}; i < truth.size(); ++i )
+                {
+                    c.add( truth[ i ], predicted[ i ] );
+                }
+                keep( c );
+            } }
+    };
+
+#ifdef CMAKE_USE_DLIB
+    const auto cor{ model::create( "cor", d ) };
+    const auto svm{ model::create( "svm", d ) };
+    score::Counts counts{ 32 };
+    for( size_t i {}; i < truth.size(); ++i )
+    {
+        counts.add( truth[ i ] * 8 + predicted[ i ], predicted[ i ] * 8 + truth[ i ] );
+    }
+    kernels.push_back( { "dat::to_dlib_sample", N, [ & ] { keep( dat::to_dlib_sample( pristine ) ); } } );
+    // Mostly 'compute_correlation_row', against every training spectrum.
+    kernels.push_back( { "cor predict", dat::count( d ) * N, [ & ] { keep( cor->predict( pristine ) ); } } );
+    kernels.push_back( { "svm predict", N, [ & ] { keep( svm->predict( pristine ) ); } } );
+    kernels.push_back( { "score::calc_confusion", counts.size() * counts.size()
+                       , [ & ] { keep( score::calc_confusion( counts ) ); } } );
+#endif  // CMAKE_USE_DLIB
+
+    std::cout << std::left << std::setw( 26 ) << "kernel" << std::right << std::setw( 10 ) << "elements"
+              << std::setw( 14 ) << "median_ns" << std::setw( 14 ) << "min_ns" << std::setw( 14 ) << "mean_ns"
+              << std::setw( 9 ) << "sd_%" << std::setw( 12 ) << "ns/elem" << std::setw( 12 ) << "cycles/elem"
+              << std::endl;
+    for( const auto & k : kernels )
+    {
+        if( k._name.find( filter ) != std::string::npos )
+        {
+            measure( k, std::cout );
+        }
+    }
+
+    fs::remove( csv );
+    return 0;
+}
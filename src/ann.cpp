@@ -0,0 +1,534 @@
+#include "ann.h"
+
+#include "except.h"
+#include "task.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <queue>
+#include <random>
+#include <string>
+
+
+namespace ann
+{
+
+
+constexpr char MAGIC[]{ "rocks-hnsw" };
+constexpr std::uint32_t VERSION{ 1 };
+constexpr unsigned MAX_LEVEL{ 16 };
+
+
+// Eight independent sums, so that the compiler can keep them in one vector register.
+float dot( const float * a, const float * b, unsigned n )
+{
+    float sums[ 8 ] {};
+    unsigned i {};
+    for( ; i + 8 <= n; i += 8 )
+    {
+        for( unsigned j {}; j < 8; ++j )
+        {
+            sums[ j ] += a[ i + j ] * b[ i + j ];
+        }
+    }
+    float ret {};
+    for( ; i < n; ++i )
+    {
+        ret += a[ i ] * b[ i ];
+    }
+    for( const auto s : sums )
+    {
+        ret += s;
+    }
+    return ret;
+}
+
+
+// Exponentially decaying probability of a node reaching each next layer.
+std::vector< std::uint8_t > draw_levels( size_t n, unsigned m )
+{
+    std::default_random_engine engine;
+    engine.seed( 0 );
+    std::uniform_real_distribution distribution( 0., 1. );
+    const auto ml{ 1 / std::log( std::max( m, 2u ) ) };
+
+    std::vector< std::uint8_t > ret( n );
+    for( auto & l : ret )
+    {
+        const auto level{ -std::log( 1 - distribution( engine ) ) * ml };
+        l = static_cast< std::uint8_t >( std::min( level, 1. * MAX_LEVEL ) );
+    }
+    return ret;
+}
+
+
+Hnsw::Hnsw( unsigned dim, std::vector< float > && rows, const Params & p )
+    : _dim{ dim }
+    , _params{ p }
+    , _rows{ std::move( rows ) }
+    , _levels{ draw_levels( _rows.size() / dim, p.m ) }
+    , _links0( _levels.size() * ( capacity( 0 ) + 1 ) )
+    , _upper( _levels.size() )
+{
+    assert( _rows.size() % dim == 0 );
+    const auto n{ size() };
+    if( ! n )
+    {
+        return;
+    }
+
+    for( Id i {}; i < n; ++i )
+    {
+        _upper[ i ].resize( _levels[ i ] * ( capacity( 1 ) + 1 ) );
+    }
+
+    _locks = std::make_unique< std::mutex[] >( n );
+    _entry_lock = std::make_unique< std::mutex >();
+    _entry = 0;
+    _max_level = _levels[ 0 ];
+
+    task::parallel_for( n - 1
+                      , [ this ] ( size_t i ) { insert( static_cast< Id >( i + 1 ) ); }
+                      , p.threads ? p.threads : task::concurrency() );
+
+    _locks.reset();
+    _entry_lock.reset();
+}
+
+
+template< typename T >
+void write( std::ostream & s, const T * data, size_t count )
+{
+    s.write( reinterpret_cast< const char * >( data )
+           , static_cast< std::streamsize >( count * sizeof( T ) ) );
+}
+
+
+template< typename T >
+void read( std::istream & s, T * data, size_t count )
+{
+    s.read( reinterpret_cast< char * >( data )
+          , static_cast< std::streamsize >( count * sizeof( T ) ) );
+    if( ! s )
+    {
+        throw Exception{ "Truncated HNSW index." };
+    }
+}
+
+
+Hnsw::Hnsw( std::istream & s )
+{
+    char magic[ sizeof( MAGIC ) ] {};
+    read( s, magic, sizeof( magic ) );
+    std::uint32_t header[ 7 ] {};
+    read( s, header, 7 );
+    if( std::memcmp( magic, MAGIC, sizeof( MAGIC ) ) || header[ 0 ] != VERSION )
+    {
+        throw Exception{ "Not a HNSW index or an unsupported version of one." };
+    }
+
+    _dim = header[ 1 ];
+    _params.m = header[ 2 ];
+    _params.ef_construction = header[ 3 ];
+    _params.ef_search = header[ 4 ];
+    _entry = header[ 5 ];
+    _max_level = header[ 6 ];
+    std::uint64_t n {};
+    read( s, & n, 1 );
+
+    // Sizes are checked against what is left of the stream before allocating.
+    const auto corrupt = [] { return Exception{ "Corrupt HNSW index." }; };
+    if( ! _dim || _dim > ( 1u << 20 ) || ! _params.m || _params.m > 1024 || _max_level > MAX_LEVEL
+     || n > std::numeric_limits< Id >::max() || ( n && _entry >= n ) )
+    {
+        throw corrupt();
+    }
+    const auto here{ s.tellg() };
+    if( here != std::istream::pos_type( -1 ) )
+    {
+        s.seekg( 0, std::ios::end );
+        const auto left{ static_cast< std::uint64_t >( s.tellg() - here ) };
+        s.seekg( here );
+        const std::uint64_t per_node{ 1 + ( capacity( 0 ) + 1 ) * sizeof( Id ) + _dim * sizeof( float ) };
+        if( n > left / per_node )
+        {
+            throw corrupt();
+        }
+    }
+
+    _levels.resize( n );
+    read( s, _levels.data(), n );
+    _links0.resize( n * ( capacity( 0 ) + 1 ) );
+    read( s, _links0.data(), _links0.size() );
+    _upper.resize( n );
+    for( Id i {}; i < n; ++i )
+    {
+        if( _levels[ i ] > _max_level )
+        {
+            throw corrupt();
+        }
+        _upper[ i ].resize( _levels[ i ] * ( capacity( 1 ) + 1 ) );
+        read( s, _upper[ i ].data(), _upper[ i ].size() );
+    }
+    _rows.resize( n * _dim );
+    read( s, _rows.data(), _rows.size() );
+
+    // Searching follows links unchecked: each must be to a node on its layer.
+    if( n && _levels[ _entry ] != _max_level )
+    {
+        throw corrupt();
+    }
+    for( Id i {}; i < n; ++i )
+    {
+        for( unsigned layer {}; layer <= _levels[ i ]; ++layer )
+        {
+            const auto l{ links( i, layer ) };
+            if( l[ 0 ] > capacity( layer ) )
+            {
+                throw corrupt();
+            }
+            for( auto to{ l + 1 }; to != l + 1 + l[ 0 ]; ++to )
+            {
+                if( * to >= n || _levels[ * to ] < layer )
+                {
+                    throw corrupt();
+                }
+            }
+        }
+    }
+}
+
+
+void Hnsw::save( std::ostream & s ) const
+{
+    write( s, MAGIC, sizeof( MAGIC ) );
+    const std::uint32_t header[ 7 ]{ VERSION
+                                   , _dim
+                                   , _params.m
+                                   , _params.ef_construction
+                                   , _params.ef_search
+                                   , _entry
+                                   , _max_level };
+    write( s, header, 7 );
+
+    const std::uint64_t n{ size() };
+    write( s, & n, 1 );
+    write( s, _levels.data(), _levels.size() );
+    write( s, _links0.data(), _links0.size() );
+    for( const auto & u : _upper )
+    {
+        write( s, u.data(), u.size() );
+    }
+    write( s, _rows.data(), _rows.size() );
+
+    if( ! s )
+    {
+        throw Exception{ "Failed writing HNSW index." };
+    }
+}
+
+
+std::vector< std::pair< Id, float > > Hnsw::search( const float * query
+                                                  , unsigned k ) const
+{
+    if( ! size() || ! k )
+    {
+        return {};
+    }
+
+    // Greedy descent down to the bottom layer.
+    auto entry{ _entry };
+    auto best{ similarity( query, entry ) };
+    for( auto layer{ _max_level }; layer > 0; --layer )
+    {
+        for( bool changed{ true }; changed; )
+        {
+            changed = false;
+            const auto l{ links( entry, layer ) };
+            for( auto n{ l + 1 }; n != l + 1 + l[ 0 ]; ++n )
+            {
+                const auto s{ similarity( query, * n ) };
+                if( s > best )
+                {
+                    best = s;
+                    entry = * n;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    const auto found{ search_layer( query
+                                  , entry
+                                  , std::max( _params.ef_search, k )
+                                  , 0
+                                  , false ) };
+
+    std::vector< std::pair< Id, float > > ret;
+    for( size_t i {}; i < found.size() && i < k; ++i )
+    {
+        ret.emplace_back( found[ i ].second, found[ i ].first );
+    }
+    return ret;
+}
+
+
+void Hnsw::set_ef( unsigned ef_search )
+{
+    _params.ef_search = ef_search;
+}
+
+
+size_t Hnsw::size() const
+{
+    return _levels.size();
+}
+
+
+unsigned Hnsw::dim() const
+{
+    return _dim;
+}
+
+
+float Hnsw::similarity( const float * v, Id i ) const
+{
+    return dot( v, & _rows[ size_t{ i } * _dim ], _dim );
+}
+
+
+const Id * Hnsw::links( Id i, unsigned layer ) const
+{
+    if( layer == 0 )
+    {
+        return & _links0[ size_t{ i } * ( capacity( 0 ) + 1 ) ];
+    }
+    return & _upper[ i ][ ( layer - 1 ) * ( capacity( 1 ) + 1 ) ];
+}
+
+
+Id * Hnsw::links( Id i, unsigned layer )
+{
+    return const_cast< Id * >( std::as_const( * this ).links( i, layer ) );
+}
+
+
+unsigned Hnsw::capacity( unsigned layer ) const
+{
+    return layer ? _params.m : 2 * _params.m;
+}
+
+
+// Returns at most 'ef' candidates, most similar first.
+std::vector< Hnsw::Candidate > Hnsw::search_layer( const float * query
+                                                 , Id entry
+                                                 , unsigned ef
+                                                 , unsigned layer
+                                                 , bool locking ) const
+{
+    // Generation-stamped visited marks, reused by every search on this thread.
+    thread_local std::vector< std::uint32_t > visited;
+    thread_local std::uint32_t generation {};
+    if( visited.size() < size() )
+    {
+        visited.assign( size(), 0 );
+        generation = 0;
+    }
+    if( ++generation == 0 )
+    {
+        std::fill( visited.begin(), visited.end(), 0 );
+        generation = 1;
+    }
+
+    std::priority_queue< Candidate > candidates;
+    std::priority_queue< Candidate
+                       , std::vector< Candidate >
+                       , std::greater< Candidate > > results;
+
+    const Candidate first{ similarity( query, entry ), entry };
+    candidates.push( first );
+    results.push( first );
+    visited[ entry ] = generation;
+
+    std::vector< Id > neighbours;
+    while( ! candidates.empty() )
+    {
+        const auto c{ candidates.top() };
+        if( c.first < results.top().first && results.size() >= ef )
+        {
+            break;
+        }
+        candidates.pop();
+
+        {
+            std::unique_lock< std::mutex > lock;
+            if( locking )
+            {
+                lock = std::unique_lock{ _locks[ c.second ] };
+            }
+            const auto l{ links( c.second, layer ) };
+            neighbours.assign( l + 1, l + 1 + l[ 0 ] );
+        }
+
+        for( const auto n : neighbours )
+        {
+            if( visited[ n ] == generation )
+            {
+                continue;
+            }
+            visited[ n ] = generation;
+
+            const auto s{ similarity( query, n ) };
+            if( results.size() < ef || s > results.top().first )
+            {
+                candidates.emplace( s, n );
+                results.emplace( s, n );
+                if( results.size() > ef )
+                {
+                    results.pop();
+                }
+            }
+        }
+    }
+
+    std::vector< Candidate > ret( results.size() );
+    for( auto r{ ret.rbegin() }; r != ret.rend(); ++r )
+    {
+        * r = results.top();
+        results.pop();
+    }
+    return ret;
+}
+
+
+// The neighbour selection heuristic: skip a candidate that is closer
+// to an already selected neighbour than to the base point.
+// Keeps the graph navigable across clusters.
+std::vector< Id > Hnsw::select( const std::vector< Candidate > & sorted
+                              , unsigned max ) const
+{
+    std::vector< Id > ret;
+    for( const auto & c : sorted )
+    {
+        if( ret.size() >= max )
+        {
+            break;
+        }
+
+        const auto row{ & _rows[ size_t{ c.second } * _dim ] };
+        const auto dominated = std::any_of( ret.cbegin(), ret.cend(), [ & ] ( Id r )
+            { return similarity( row, r ) > c.first; } );
+        if( ! dominated )
+        {
+            ret.push_back( c.second );
+        }
+    }
+    return ret;
+}
+
+
+void Hnsw::connect( Id from, Id to, unsigned layer )
+{
+    std::lock_guard lock{ _locks[ from ] };
+    const auto l{ links( from, layer ) };
+    const auto cap{ capacity( layer ) };
+    if( l[ 0 ] < cap )
+    {
+        l[ 1 + l[ 0 ] ] = to;
+        ++l[ 0 ];
+        return;
+    }
+
+    // Full, re-select among the old neighbours and the new one.
+    const auto row{ & _rows[ size_t{ from } * _dim ] };
+    std::vector< Candidate > all{ { similarity( row, to ), to } };
+    for( auto n{ l + 1 }; n != l + 1 + l[ 0 ]; ++n )
+    {
+        all.emplace_back( similarity( row, * n ), * n );
+    }
+    std::sort( all.begin(), all.end(), std::greater< Candidate >() );
+
+    const auto kept{ select( all, cap ) };
+    l[ 0 ] = static_cast< Id >( kept.size() );
+    std::copy( kept.cbegin(), kept.cend(), l + 1 );
+}
+
+
+void Hnsw::insert( Id q )
+{
+    const auto query{ & _rows[ size_t{ q } * _dim ] };
+    const unsigned level{ _levels[ q ] };
+
+    // A node topping the hierarchy holds the lock until it becomes the entry.
+    std::unique_lock global{ * _entry_lock };
+    auto entry{ _entry };
+    const auto max_level{ _max_level };
+    if( level <= max_level )
+    {
+        global.unlock();
+    }
+
+    auto best{ similarity( query, entry ) };
+    for( auto layer{ max_level }; layer > level; --layer )
+    {
+        for( bool changed{ true }; changed; )
+        {
+            changed = false;
+            std::vector< Id > neighbours;
+            {
+                std::lock_guard lock{ _locks[ entry ] };
+                const auto l{ links( entry, layer ) };
+                neighbours.assign( l + 1, l + 1 + l[ 0 ] );
+            }
+            for( const auto n : neighbours )
+            {
+                const auto s{ similarity( query, n ) };
+                if( s > best )
+                {
+                    best = s;
+                    entry = n;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for( auto layer{ static_cast< int >( std::min( level, max_level ) ) }; layer >= 0; --layer )
+    {
+        const auto l{ static_cast< unsigned >( layer ) };
+        auto found{ search_layer( query, entry, _params.ef_construction, l, true ) };
+        std::erase_if( found, [ q ] ( const Candidate & c ) { return c.second == q; } );
+        if( found.empty() )
+        {
+            continue;
+        }
+
+        const auto chosen{ select( found, _params.m ) };
+        {
+            std::lock_guard lock{ _locks[ q ] };
+            const auto own{ links( q, l ) };
+            own[ 0 ] = static_cast< Id >( chosen.size() );
+            std::copy( chosen.cbegin(), chosen.cend(), own + 1 );
+        }
+        for( const auto c : chosen )
+        {
+            connect( c, q, l );
+        }
+        entry = found.front().second;
+    }
+
+    if( global.owns_lock() )
+    {
+        _entry = q;
+        _max_level = level;
+    }
+}
+
+
+}  // namespace ann
@@ -0,0 +1,97 @@
+#ifndef ANN_H_
+#define ANN_H_
+
+
+// In this file: approximate nearest neighbour search.
+//
+// A Hierarchical Navigable Small World graph, after
+// Malkov & Yashunin, "Efficient and robust approximate nearest neighbor
+// search using HNSW graphs", 2016.
+// Rows are expected to be of unit length, similarity is the inner product,
+// i.e. the cosine similarity of the original vectors.
+
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+namespace ann
+{
+
+
+using Id = std::uint32_t;
+
+
+struct Params
+{
+    // Links per node on the upper layers; twice as many on the bottom one.
+    unsigned m{ 16 };
+    // Width of the search while inserting; higher builds a better graph slower.
+    unsigned ef_construction{ 200 };
+    // Width of the search while querying; the recall vs latency knob.
+    unsigned ef_search{ 64 };
+    // Threads for the construction; 0 means the whole thread budget.
+    unsigned threads{ 0 };
+};
+
+
+struct Hnsw
+{
+    // 'rows' holds 'dim' consecutive floats per point, Id is the row index.
+    Hnsw( unsigned dim, std::vector< float > && rows, const Params & );
+
+    // Restore a graph written by 'save()'.
+    explicit Hnsw( std::istream & );
+    void save( std::ostream & ) const;
+
+    // Up to 'k' most similar rows, most similar first.
+    std::vector< std::pair< Id, float > > search( const float * query
+                                                , unsigned k ) const;
+
+    void set_ef( unsigned ef_search );
+    size_t size() const;
+    unsigned dim() const;
+
+private:
+    using Candidate = std::pair< float, Id >;
+
+    float similarity( const float *, Id ) const;
+    const Id * links( Id, unsigned layer ) const;
+    Id * links( Id, unsigned layer );
+    unsigned capacity( unsigned layer ) const;
+
+    std::vector< Candidate > search_layer( const float * query
+                                         , Id entry
+                                         , unsigned ef
+                                         , unsigned layer
+                                         , bool locking ) const;
+    std::vector< Id > select( const std::vector< Candidate > & sorted
+                            , unsigned max ) const;
+    void connect( Id from, Id to, unsigned layer );
+    void insert( Id );
+
+    unsigned _dim;
+    Params _params;
+    std::vector< float > _rows;
+    std::vector< std::uint8_t > _levels;
+    // Bottom layer: per node, a count followed by '2 * m' slots.
+    std::vector< Id > _links0;
+    // Upper layers: per node, 'level' blocks of a count and 'm' slots.
+    std::vector< std::vector< Id > > _upper;
+    Id _entry{};
+    unsigned _max_level{};
+
+    // Only exist while building.
+    std::unique_ptr< std::mutex[] > _locks;
+    std::unique_ptr< std::mutex > _entry_lock;
+};
+
+
+}  // namespace ann
+
+
+#endif  // defined(ANN_H_)
@@ -0,0 +1,206 @@
+#include "art.h"
+
+#include "except.h"
+#include "model.h"
+#include "opt.h"
+#include "pre.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+
+
+namespace art
+{
+
+
+constexpr char MAGIC[]{ "rocks-artifact" };
+
+
+void Writer::put( const std::string & s )
+{
+    put( std::uint64_t{ s.size() } );
+    _bytes.insert( _bytes.end(), s.cbegin(), s.cend() );
+}
+
+
+Reader::Reader( const char * begin, const char * end )
+    : _p{ begin }
+    , _end{ end }
+{
+}
+
+
+std::string Reader::get_string()
+{
+    const auto size{ get< std::uint64_t >() };
+    const auto p{ take( size ) };
+    return { p, p + size };
+}
+
+
+const char * Reader::take( size_t bytes )
+{
+    if( static_cast< size_t >( _end - _p ) < bytes )
+    {
+        throw Exception{ "Artifact is truncated or corrupt." };
+    }
+    const auto ret{ _p };
+    _p += bytes;
+    return ret;
+}
+
+
+Mapped::Mapped( const std::filesystem::path & p )
+    : _data{ MAP_FAILED }
+    , _size{}
+{
+    const auto fd{ ::open( p.c_str(), O_RDONLY ) };
+    if( fd < 0 )
+    {
+        throw Exception{ "Cannot open '" + p.string() + "'." };
+    }
+
+    struct stat st {};
+    if( ::fstat( fd, & st ) == 0 && st.st_size > 0 )
+    {
+        _size = static_cast< size_t >( st.st_size );
+        _data = ::mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+    ::close( fd );
+
+    if( _data == MAP_FAILED )
+    {
+        throw Exception{ "Cannot map '" + p.string() + "'." };
+    }
+}
+
+
+Mapped::~Mapped()
+{
+    ::munmap( _data, _size );
+}
+
+
+const char * Mapped::begin() const
+{
+    return static_cast< const char * >( _data );
+}
+
+
+const char * Mapped::end() const
+{
+    return begin() + _size;
+}
+
+
+Pipeline::Pipeline() = default;
+Pipeline::Pipeline( Pipeline && ) = default;
+Pipeline::~Pipeline() = default;
+
+
+void Pipeline::save( const std::filesystem::path & p ) const
+{
+    Writer w;
+    w.put( std::string{ MAGIC } );
+    w.put( VERSION );
+
+    const auto labels{ _codec.labels() };
+    w.put( std::uint64_t{ labels.size() } );
+    for( const auto & l : labels )
+    {
+        w.put( l );
+    }
+
+    w.put( std::uint64_t{ _preprocessing.size() } );
+    for( const auto & step : _preprocessing )
+    {
+        w.put( step.first );
+        step.second->save( w );
+    }
+
+    w.put( _model_name );
+    _model->save( w );
+
+    std::ofstream f{ p, std::ios::binary };
+    f.write( w._bytes.data(), static_cast< std::streamsize >( w._bytes.size() ) );
+    if( ! f )
+    {
+        throw Exception{ "Failed writing artifact '" + p.string() + "'." };
+    }
+}
+
+
+Pipeline Pipeline::load( const std::filesystem::path & p )
+{
+    const Mapped m{ p };
+    Reader r{ m.begin(), m.end() };
+
+    if( r.get_string() != MAGIC )
+    {
+        throw Exception{ "'" + p.string() + "' is not an artifact." };
+    }
+    const auto version{ r.get< std::uint32_t >() };
+    if( version != VERSION )
+    {
+        throw Exception{ "Artifact '" + p.string() + "' has version "
+                       + std::to_string( version ) + ", expected "
+                       + std::to_string( VERSION ) + '.' };
+    }
+
+    Pipeline ret;
+    const auto num_labels{ r.get< std::uint64_t >() };
+    for( std::uint64_t i {}; i < num_labels; ++i )
+    {
+        ret._codec.encode( r.get_string() );
+    }
+
+    const auto num_steps{ r.get< std::uint64_t >() };
+    for( std::uint64_t i {}; i < num_steps; ++i )
+    {
+        auto name{ r.get_string() };
+        auto step{ pre::load( name, r ) };
+        ret._preprocessing.emplace_back( std::move( name ), std::move( step ) );
+    }
+
+    ret._model_name = r.get_string();
+    ret._model = model::load( ret._model_name, r );
+    if( opt::get< std::string >( "quant", "" ) == "int8" )
+    {
+        ret._model = std::make_unique< model::Int8 >( std::move( ret._model ) );
+    }
+
+    return ret;
+}
+
+
+void Pipeline::preprocess( dat::Spectrum & s ) const
+{
+    for( const auto & step : _preprocessing )
+    {
+        ( * step.second )( s );
+    }
+}
+
+
+label::Num Pipeline::predict( dat::Spectrum s ) const
+{
+    preprocess( s );
+    return _model->predict( s );
+}
+
+
+std::vector< model::Scored > Pipeline::score( std::vector< dat::Spectrum > spectra ) const
+{
+    for( auto & s : spectra )
+    {
+        preprocess( s );
+    }
+    return _model->score_batch( spectra );
+}
+
+
+}  // namespace art
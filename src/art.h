@@ -0,0 +1,149 @@
+#ifndef ART_H_
+#define ART_H_
+
+
+// In this file: trained pipeline artifacts.
+//
+// An artifact file holds, in order:
+//     1. a magic string and the format version,
+//     2. the label codec,
+//     3. the fitted preprocessing steps, by name and parameters,
+//     4. the model, by name and parameters.
+// Dimensionality reductions are not part of it, as models train on whole spectra.
+// Numbers are stored in native byte order; loading maps the file read-only.
+// Saving a loaded artifact reproduces it byte for byte.
+
+
+#include "dat.h"
+#include "label.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace model { struct Base; struct Scored; }
+namespace pre { struct Base; }
+
+
+namespace art
+{
+
+
+constexpr std::uint32_t VERSION{ 2 };
+
+
+// Append plain values, arrays and strings to a byte buffer.
+struct Writer
+{
+    template< typename T >
+    void put( const T & v )
+    {
+        static_assert( std::is_trivially_copyable_v< T > );
+        const auto p{ reinterpret_cast< const char * >( & v ) };
+        _bytes.insert( _bytes.end(), p, p + sizeof( T ) );
+    }
+
+    template< typename T >
+    void put( const std::vector< T > & v )
+    {
+        static_assert( std::is_trivially_copyable_v< T > );
+        put( std::uint64_t{ v.size() } );
+        const auto p{ reinterpret_cast< const char * >( v.data() ) };
+        _bytes.insert( _bytes.end(), p, p + v.size() * sizeof( T ) );
+    }
+
+    void put( const std::string & );
+
+    std::vector< char > _bytes;
+};
+
+
+// Consume what a 'Writer' produced, in the same order.
+// Throws on reading past the end.
+struct Reader
+{
+    Reader( const char * begin, const char * end );
+
+    template< typename T >
+    T get()
+    {
+        static_assert( std::is_trivially_copyable_v< T > );
+        T ret;
+        std::memcpy( & ret, take( sizeof( T ) ), sizeof( T ) );
+        return ret;
+    }
+
+    template< typename T >
+    std::vector< T > get_vector()
+    {
+        static_assert( std::is_trivially_copyable_v< T > );
+        // Taken before allocating, a corrupt size cannot ask for more than is left.
+        const auto size{ get< std::uint64_t >() };
+        const auto bytes{ take( size <= SIZE_MAX / sizeof( T ) ? size * sizeof( T ) : SIZE_MAX ) };
+        std::vector< T > ret( size );
+        std::memcpy( ret.data(), bytes, size * sizeof( T ) );
+        return ret;
+    }
+
+    std::string get_string();
+
+private:
+    const char * take( size_t bytes );
+
+    const char * _p;
+    const char * const _end;
+};
+
+
+// A whole file, mapped read-only into memory.
+struct Mapped
+{
+    Mapped( const std::filesystem::path & );
+    ~Mapped();
+    Mapped( const Mapped & ) = delete;
+    Mapped & operator=( const Mapped & ) = delete;
+
+    const char * begin() const;
+    const char * end() const;
+
+private:
+    void * _data;
+    size_t _size;
+};
+
+
+// Everything needed to classify a raw spectrum.
+struct Pipeline
+{
+    Pipeline();
+    Pipeline( Pipeline && );
+    ~Pipeline();
+
+    void save( const std::filesystem::path & ) const;
+    // Option quant=int8 runs linear models in int8, see model::Int8.
+    static Pipeline load( const std::filesystem::path & );
+
+    // Apply the fitted preprocessing steps in order.
+    void preprocess( dat::Spectrum & ) const;
+
+    // Preprocess and predict.
+    label::Num predict( dat::Spectrum ) const;
+    std::vector< model::Scored > score( std::vector< dat::Spectrum > ) const;
+
+    label::Codec _codec;
+    std::vector< std::pair< std::string, std::unique_ptr< pre::Base > > > _preprocessing;
+    std::string _model_name;
+    std::unique_ptr< model::Base > _model;
+};
+
+
+}  // namespace art
+
+
+#endif  // defined(ART_H_)
@@ -0,0 +1,407 @@
+#include "bench.h"
+
+#include "dat.h"
+#include "dim.h"
+#include "io.h"
+#include "model.h"
+#include "opt.h"
+#include "perf.h"
+#include "pre.h"
+#include "print.h"
+#include "task.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <optional>
+
+
+namespace bench
+{
+
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+
+// Times stages by name, in the order first timed, and counts them if given counters.
+struct Timer
+{
+    struct Mark
+    {
+        Clock::time_point _time;
+        perf::Counts _counts;
+    };
+
+
+    // Not 'counted' where reading the counters of every thread would cost more than the stage.
+    Mark mark( bool counted = true ) const
+    {
+        auto counts{ _counters && counted ? _counters->read() : perf::Counts{} };
+        return { Clock::now(), counts };
+    }
+
+
+    template< typename F >
+    void time( const std::string & name, size_t items, size_t bytes, F && f, bool counted = true )
+    {
+        const auto since{ mark( counted ) };
+        f();
+        add( name, items, bytes, since, counted );
+    }
+
+
+    void add( const std::string & name, size_t items, size_t bytes, const Mark & since, bool counted = true )
+    {
+        const auto seconds{ std::chrono::duration< double >{ Clock::now() - since._time }.count() };
+        if( ! _timing )
+        {
+            return;
+        }
+        auto & s{ stage( name, items, bytes ) };
+        s._seconds.push_back( seconds );
+        if( _counters && counted )
+        {
+            s._counts += _counters->read() - since._counts;
+        }
+    }
+
+
+    // What the stage 'name', timed apart and not counted, counted since 'since'.
+    void count( const std::string & name, const Mark & since )
+    {
+        if( _timing && _counters )
+        {
+            stage( name, 0, 0 )._counts += _counters->read() - since._counts;
+        }
+    }
+
+
+    Stage & stage( const std::string & name, size_t items, size_t bytes )
+    {
+        auto it{ std::find_if( _stages.begin(), _stages.end(), [ & ] ( const Stage & s ) { return s._name == name; } ) };
+        if( it == _stages.end() )
+        {
+            it = _stages.insert( it, { name, items, bytes, {}, {} } );
+        }
+        return * it;
+    }
+
+    // Off during warmup.
+    bool _timing {};
+    const perf::Counters * _counters {};
+    std::vector< Stage > _stages;
+};
+
+
+size_t bytes( const dat::Dataset & d )
+{
+    return dat::count( d ) * sizeof( dat::Spectrum::Axis );
+}
+
+
+void run_once( const fs::path & data_dir
+             , unsigned labels_depth
+             , const std::string & model_name
+             , const std::vector< std::string > & preprocessing
+             , const std::string & reduction
+             , Timer & t
+             )
+{
+    // A dataset cache or a shared one has no files to list and parse.
+    auto since{ t.mark() };
+    size_t file_bytes{ fs::is_regular_file( data_dir ) ? fs::file_size( data_dir ) : 0 };
+    if( fs::is_directory( data_dir ) )
+    {
+        const auto files{ io::recursively_list_csvs( data_dir ) };
+        t.add( "list", files.size(), 0, since );
+        for( const auto & f : files )
+        {
+            file_bytes += fs::file_size( f );
+        }
+
+        std::vector< dat::Spectrum > spectra( files.size() );
+        t.time( "parse", files.size(), file_bytes, [ & ]
+            {
+                task::parallel_for( files.size(), [ & ] ( size_t i ) { spectra[ i ] = io::read_csv( files[ i ] ); } );
+            } );
+    }
+
+    since = t.mark();
+    auto raw{ io::read( data_dir, labels_depth ) };
+    size_t read {};
+    for( const auto & kv : raw )
+    {
+        read += kv.second.size();
+    }
+    t.add( "read", read, file_bytes, since );
+
+    since = t.mark();
+    auto d{ dat::encode( std::move( raw ) ) };
+    t.add( "encode", dat::count( d ), bytes( d ), since );
+
+    for( const auto & op : preprocessing )
+    {
+        t.time( "pre:" + op, dat::count( d ), bytes( d ), [ & ]
+            {
+                const auto algo{ pre::create( op, d ) };
+                d = ( * algo )( d );
+            } );
+    }
+
+    // Timed for its own cost only; models train on full spectra, as in 'RunModel'.
+    if( ! reduction.empty() )
+    {
+        t.time( "reduce:" + reduction, dat::count( d ), bytes( d ), [ & ]
+            {
+                const auto r{ dim::create( reduction, d ) };
+                ( * r )( d );
+            } );
+    }
+
+    const auto [ train, test ]{ dat::split( d ) };
+    std::unique_ptr< model::Base > m;
+    t.time( "train", dat::count( train ), bytes( train ), [ & ] { m = model::create( model_name, train ); } );
+
+    since = t.mark();
+    dat::apply( [ & ] ( label::Num, const dat::Spectrum & s )
+        {
+            t.time( "predict", 1, sizeof( s._y ), [ & ] { m->predict( s ); }, false );
+        }
+              , test );
+    t.count( "predict", since );
+}
+
+
+Report run( const fs::path & data_dir
+          , unsigned labels_depth
+          , const std::string & model
+          , const std::vector< std::string > & preprocessing
+          , const std::string & reduction
+          )
+{
+    const auto runs{ opt::get( "bench.runs", 5u ) };
+    const auto warmup{ opt::get( "bench.warmup", 1u ) };
+
+    std::unique_ptr< const perf::Counters > counters;
+    if( opt::get( "bench.counters", true ) )
+    {
+        counters = std::make_unique< const perf::Counters >();
+    }
+
+    Timer t;
+    t._counters = counters && counters->any() ? counters.get() : nullptr;
+    for( unsigned r {}; r < warmup + runs; ++r )
+    {
+        t._timing = r >= warmup;
+        print::info( std::string{ t._timing ? "Timed" : "Warmup" } + " run " + std::to_string( r + 1 )
+                   + " of " + std::to_string( warmup + runs ) + '.' );
+        run_once( data_dir, labels_depth, model, preprocessing, reduction, t );
+    }
+
+    return { data_dir, labels_depth, model, preprocessing, reduction, runs, task::concurrency()
+           , t._counters ? t._counters->available() : perf::Available{}, t._stages };
+}
+
+
+// Nearest rank.
+double percentile( std::vector< double > sorted, double p )
+{
+    if( sorted.empty() )
+    {
+        return 0;
+    }
+    std::sort( sorted.begin(), sorted.end() );
+    const auto rank{ static_cast< size_t >( std::ceil( p * sorted.size() ) ) };
+    return sorted[ std::clamp< size_t >( rank, 1, sorted.size() ) - 1 ];
+}
+
+
+struct Summary
+{
+    double _total;
+    double _items_per_s;
+    double _mb_per_s;
+    double _min;
+    double _p50;
+    double _p90;
+    double _p99;
+    double _max;
+    // Unless not counted.
+    std::optional< double > _ipc;
+    std::optional< double > _llc_misses_per_spectrum;
+    std::optional< double > _branch_misses_per_spectrum;
+};
+
+
+Summary summarize( const Stage & s, const perf::Available & counted )
+{
+    const auto total{ std::accumulate( s._seconds.cbegin(), s._seconds.cend(), 0. ) };
+    const auto per_s = [ & ] ( size_t per_sample ) { return total > 0 ? per_sample * s._seconds.size() / total : 0; };
+    const auto spectra{ static_cast< double >( s._items * s._seconds.size() ) };
+    const auto per_spectrum = [ & ] ( perf::Event e ) -> std::optional< double >
+    {
+        if( ! counted[ e ] || ! spectra )
+        {
+            return {};
+        }
+        return s._counts[ e ] / spectra;
+    };
+    std::optional< double > ipc;
+    if( counted[ perf::CYCLES ] && counted[ perf::INSTRUCTIONS ] && s._counts[ perf::CYCLES ] )
+    {
+        ipc = static_cast< double >( s._counts[ perf::INSTRUCTIONS ] ) / s._counts[ perf::CYCLES ];
+    }
+    return { total
+           , per_s( s._items )
+           , per_s( s._bytes ) / 1e6
+           , percentile( s._seconds, 0 )
+           , percentile( s._seconds, 0.5 )
+           , percentile( s._seconds, 0.9 )
+           , percentile( s._seconds, 0.99 )
+           , percentile( s._seconds, 1 )
+           , ipc
+           , per_spectrum( perf::LLC_MISSES )
+           , per_spectrum( perf::BRANCH_MISSES )
+           };
+}
+
+
+bool any( const perf::Available & counted )
+{
+    return std::find( counted.cbegin(), counted.cend(), true ) != counted.cend();
+}
+
+
+void print( const Report & r, std::ostream & out )
+{
+    out << std::left << std::setw( 16 ) << "stage" << std::right
+        << std::setw( 8 ) << "samples" << std::setw( 12 ) << "spectra/s" << std::setw( 10 ) << "MB/s"
+        << std::setw( 12 ) << "p50_us" << std::setw( 12 ) << "p90_us" << std::setw( 12 ) << "p99_us"
+        << std::setw( 12 ) << "max_us";
+    if( any( r._counted ) )
+    {
+        out << std::setw( 8 ) << "IPC" << std::setw( 12 ) << "llc_miss/sp" << std::setw( 12 ) << "br_miss/sp";
+    }
+    out << '\n' << std::fixed;
+    const auto optional = [ & ] ( int width, const std::optional< double > & v )
+    {
+        if( v )
+        {
+            out << std::setw( width ) << * v;
+        }
+        else
+        {
+            out << std::setw( width ) << "-";
+        }
+    };
+    for( const auto & s : r._stages )
+    {
+        const auto m{ summarize( s, r._counted ) };
+        out << std::left << std::setw( 16 ) << s._name << std::right << std::setprecision( 1 )
+            << std::setw( 8 ) << s._seconds.size() << std::setw( 12 ) << m._items_per_s
+            << std::setw( 10 ) << m._mb_per_s
+            << std::setw( 12 ) << m._p50 * 1e6 << std::setw( 12 ) << m._p90 * 1e6
+            << std::setw( 12 ) << m._p99 * 1e6 << std::setw( 12 ) << m._max * 1e6;
+        if( any( r._counted ) )
+        {
+            out << std::setprecision( 2 );
+            optional( 8, m._ipc );
+            out << std::setprecision( 1 );
+            optional( 12, m._llc_misses_per_spectrum );
+            optional( 12, m._branch_misses_per_spectrum );
+        }
+        out << '\n';
+    }
+    out << std::defaultfloat << std::flush;
+}
+
+
+std::string quoted( const std::string & s )
+{
+    std::string ret{ '"' };
+    for( const auto c : s )
+    {
+        if( c == '"' || c == '\\' )
+        {
+            ret += '\\';
+        }
+        if( static_cast< unsigned char >( c ) < 0x20 )
+        {
+            continue;
+        }
+        ret += c;
+    }
+    return ret + '"';
+}
+
+
+void write_json( const Report & r, std::ostream & out )
+{
+    out << std::setprecision( 9 )
+        << "{\n  \"dataset\": " << quoted( r._data_dir.string() )
+        << ",\n  \"labels_depth\": " << r._labels_depth
+        << ",\n  \"model\": " << quoted( r._model )
+        << ",\n  \"preprocessing\": [";
+    for( size_t i {}; i < r._preprocessing.size(); ++i )
+    {
+        out << ( i ? ", " : "" ) << quoted( r._preprocessing[ i ] );
+    }
+    out << "],\n  \"reduction\": " << quoted( r._reduction )
+        << ",\n  \"runs\": " << r._runs
+        << ",\n  \"threads\": " << r._threads
+        << ",\n  \"stages\": [";
+    for( size_t i {}; i < r._stages.size(); ++i )
+    {
+        const auto & s{ r._stages[ i ] };
+        const auto m{ summarize( s, r._counted ) };
+        out << ( i ? "," : "" ) << "\n    { \"name\": " << quoted( s._name )
+            << ", \"samples\": " << s._seconds.size()
+            << ", \"items\": " << s._items
+            << ", \"bytes\": " << s._bytes
+            << ", \"seconds\": " << m._total
+            << ", \"spectra_per_s\": " << m._items_per_s
+            << ", \"mb_per_s\": " << m._mb_per_s
+            << ", \"min_s\": " << m._min
+            << ", \"p50_s\": " << m._p50
+            << ", \"p90_s\": " << m._p90
+            << ", \"p99_s\": " << m._p99
+            << ", \"max_s\": " << m._max;
+        for( unsigned e {}; e < perf::EVENTS; ++e )
+        {
+            out << ", \"" << perf::name( static_cast< perf::Event >( e ) ) << "\": ";
+            if( r._counted[ e ] )
+            {
+                out << s._counts[ e ];
+            }
+            else
+            {
+                out << "null";
+            }
+        }
+        const auto optional = [ & ] ( const std::optional< double > & v )
+        {
+            if( v )
+            {
+                out << * v;
+            }
+            else
+            {
+                out << "null";
+            }
+        };
+        out << ", \"ipc\": ";
+        optional( m._ipc );
+        out << ", \"llc_misses_per_spectrum\": ";
+        optional( m._llc_misses_per_spectrum );
+        out << ", \"branch_misses_per_spectrum\": ";
+        optional( m._branch_misses_per_spectrum );
+        out << " }";
+    }
+    out << "\n  ]\n}\n" << std::flush;
+}
+
+
+}  // namespace bench
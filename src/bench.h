@@ -0,0 +1,78 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+
+// In this file: the benchmark of every stage of the pipeline on a dataset.
+//
+// The yardstick for performance changes. Each run lists the dataset files,
+// parses them, reads the dataset whole, encodes it, fits and applies every
+// preprocessing step and the reduction, trains the model and predicts the
+// test spectra one by one. Runs after the warmup ones are timed, and reported
+// as throughput and latency percentiles, in a table or in JSON to compare runs,
+// with the instructions per cycle and cache and branch misses per spectrum of
+// the stages where the hardware counters are available, see 'perf.h'.
+
+
+#include "perf.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+namespace bench
+{
+
+
+struct Stage
+{
+    // E.g. "parse", "pre:log", "predict".
+    std::string _name;
+    // Spectra and bytes per sample.
+    size_t _items;
+    size_t _bytes;
+    // A sample per run, or per spectrum for "predict".
+    std::vector< double > _seconds;
+    // Over all samples.
+    perf::Counts _counts;
+};
+
+
+struct Report
+{
+    std::filesystem::path _data_dir;
+    unsigned _labels_depth;
+    std::string _model;
+    std::vector< std::string > _preprocessing;
+    std::string _reduction;
+    unsigned _runs;
+    unsigned _threads;
+    // None if counters were off or unavailable.
+    perf::Available _counted;
+    std::vector< Stage > _stages;
+};
+
+
+// Options: bench.runs - timed runs, 5 by default, bench.warmup - untimed runs before, 1 by default,
+//          bench.counters - false not to read the hardware counters.
+Report run( const std::filesystem::path & data_dir
+          , unsigned labels_depth
+          , const std::string & model
+          , const std::vector< std::string > & preprocessing
+          , const std::string & reduction
+          );
+
+
+// A stage per line: samples, spectra/s, MB/s, latency percentiles,
+// and IPC and misses per spectrum if counted.
+void print( const Report &, std::ostream & = std::cout );
+
+void write_json( const Report &, std::ostream & );
+
+
+}  // namespace bench
+
+
+#endif  // defined(BENCH_H_)
@@ -1,15 +1,21 @@
 #include "cli.h"
 #include "dim.h"
+#include "except.h"
 #include "print.h"
 
 #ifdef CMAKE_USE_DLIB
 
 #include "model.h"
+#include "opt.h"
+#include "task.h"
 
 #include <dlib/cmd_line_parser.h>
 
 #include <algorithm>
+#include <cassert>
+#include <charconv>
 #include <filesystem>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -35,6 +41,20 @@ std::filesystem::path find_dataset( const Parser & p )
 }
 
 
+// The argument of option 'name', a whole number of at least 1.
+unsigned positive( const Parser & p, const std::string & name )
+{
+    const auto arg{ p.option( name ).argument() };
+    unsigned long ret {};
+    const auto end{ std::from_chars( arg.data(), arg.data() + arg.size(), ret ) };
+    if( end.ec != std::errc{} || end.ptr != arg.data() + arg.size() || ! ret || ret > std::numeric_limits< unsigned >::max() )
+    {
+        throw Exception{ "Option -" + name + " needs a whole number of at least 1, not '" + arg + "'." };
+    }
+    return static_cast< unsigned >( ret );
+}
+
+
 unsigned find_labels_depth( const Parser & p )
 {
     if( p.option( "l" ) )
@@ -80,8 +100,7 @@ Cmd create_model( const Parser & p )
     assert( p.option( "m" ).count() );
     const auto model_name{ p.option( "m" ).argument() };
 
-    // Verify such a model exists by creating one with an empy training set.
-    model::create( model_name, {} );
+    model::check( model_name );
 
     return std::make_unique< cmd::RunModel >( find_dataset( p )
                                             , model_name
@@ -92,60 +111,151 @@ Cmd create_model( const Parser & p )
 }
 
 
-void show_models()
+Cmd create_benchmark( const Parser & p )
 {
-    std::string all{"Models: "};
-    for( const auto & m : model::ALL_MODELS )
+    if( ! p.option( "m" ) )
     {
-        all += m + ", ";
+        throw Exception{ "Benchmarking needs a model, see -m." };
     }
-
-    print::info( all );
+    const auto model_name{ p.option( "m" ).argument() };
+    model::check( model_name );
+
+    return std::make_unique< cmd::Benchmark >( find_dataset( p )
+                                             , model_name
+                                             , find_labels_depth( p )
+                                             , find_preprocessing( p )
+                                             , find_reduction( p )
+                                             , p.option( "b" ).argument()
+                                             );
 }
 
 
-void show_preprocessing()
+Cmd create_train( const Parser & p )
 {
+    if( ! p.option( "m" ) )
+    {
+        throw Exception{ "Training needs a model, see -m." };
+    }
 
-    std::string all{ "Data preprocessing algos: " };
-    for( const auto & p : pre::ALL_PRE )
+    // Fail before training rather than when saving.
+    const auto model_name{ p.option( "m" ).argument() };
+    model::check( model_name );
+    if( ! model::serializable( model_name ) )
     {
-        all += p + ", ";
+        throw Exception{ "Model '" + model_name + "', or one of its members, cannot be saved into an artifact." };
     }
-    print::info( all );
+    const auto preprocessing{ find_preprocessing( p ) };
+    for( const auto & op : preprocessing )
+    {
+        pre::check( op );
+        if( ! pre::Registry::get().at( op )._traits.serializable )
+        {
+            throw Exception{ "Preprocessing '" + op + "' cannot be saved into an artifact." };
+        }
+    }
+
+    return std::make_unique< cmd::Train >( find_dataset( p )
+                                         , model_name
+                                         , find_labels_depth( p )
+                                         , preprocessing
+                                         , p.option( "t" ).argument()
+                                         );
 }
 
 
-void show_reduction()
+// Names and traits of everything in a registry.
+template< typename Registry >
+void show( const std::string & title, const Registry & r )
 {
-
-    std::string all{ "Dimensionality reduction algos: " };
-    for( const auto & r : dim::ALL )
+    std::string all{ title + ": " };
+    for( const auto & name : r.names() )
     {
-        all += r + ", ";
+        const auto traits{ reg::describe( r.at( name )._traits ) };
+        all += name + ( traits.empty() ? "" : " (" + traits + ")" ) + ", ";
     }
     print::info( all );
 }
 
 
+void show_models()
+{
+    show( "Models", model::Registry::get() );
+}
+
+
+void show_preprocessing()
+{
+    show( "Data preprocessing algos", pre::Registry::get() );
+}
+
+
+void show_reduction()
+{
+    show( "Dimensionality reduction algos", dim::Registry::get() );
+}
+
+
+Cmd select( const Parser & p );
+
+
 Cmd parse( int argc, Argv argv )
 {
     Parser p;
     p.add_option( "h", "Print this." );
     p.add_option( "help", "Print this." );
 
-    p.add_option( "a", "Run all models. Obviously very slow." );
-    p.add_option( "d", "Path to dataset root dir.", 1 );
+    p.add_option( "a", "Run all models on all preprocessings at labels depths up to -l, "
+                       "sharing the dataset and running models concurrently." );
+    p.add_option( "b", "Benchmark every stage of -m with -p and -r on -d, writing JSON to <file>.", 1 );
+    p.add_option( "c", "Classify the spectra under -d, or requests to -S, "
+                       "with the pipeline trained into <file>.", 1 );
+    p.add_option( "d", "Path to dataset root dir, or to a dataset cache from -g.", 1 );
+    p.add_option( "e", "Record the results of -a into <store>, skipping cells recorded already.", 1 );
+    p.add_option( "E", "Print the results recorded into <store>, best first.", 1 );
+    p.add_option( "g", "Generate a synthetic dataset into <dir>, see the -x gen.* options.", 1 );
+    p.add_option( "j", "Run at most <threads> at once, all cores by default.", 1 );
     p.add_option( "l", "How many <levels> of subdirs to capture into hierarchic labels.", 1 );
     p.add_option( "m", "Execute <model>.", 1 );
     p.add_option( "o", "Produce a report on outliers." );
+    p.add_option( "P", "Publish -d at -l as the shared dataset <name>, e.g. '/rocks', "
+                       "for -d shm:<name>, until interrupted.", 1 );
     p.add_option( "p", "Use <algorithm> to preprocess the dataset.", 1 );
+    p.add_option( "q", "Classify the spectra under -d via the server on <socket>.", 1 );
+    p.add_option( "Q", "Benchmark the server on <socket> with the spectra under -d.", 1 );
     p.add_option( "r", "Use <algorithm> to reduce dimensions in the dataset"
                        ", currently hardcoded to 100 from 7810.", 1 );
     p.add_option( "s", "Show all available models and preprocessing algorithms." );
+    p.add_option( "S", "Serve -c on the Unix domain <socket>.", 1 );
+    p.add_option( "T", "Record a trace of the stages run into <json>, for chrome://tracing or Perfetto.", 1 );
+    p.add_option( "t", "Train -m on the whole of -d and save the pipeline to <file>.", 1 );
+    p.add_option( "w", "Run -a by <workers> processes rather than threads, recording into -e.", 1 );
+    p.add_option( "W", "Run the sweep jobs spooled in <dir>, started by -w.", 1 );
+    p.add_option( "u", "Update the pipeline trained into <file> with the spectra under -d.", 1 );
+    p.add_option( "x", "Tune an algorithm with <key=value>, e.g. 'ann.ef=128'. Repeatable.", 1 );
 
     p.parse( argc, const_cast< char** >( argv ) );
 
+    if( p.option( "j" ) )
+    {
+        task::set_concurrency( positive( p, "j" ) );
+    }
+    for( unsigned long i {}; i < p.option( "x" ).count(); ++i )
+    {
+        opt::set( p.option( "x" ).argument( 0, i ) );
+    }
+    print::set_level( print::level( opt::get< std::string >( "log.level", "info" ) ) );
+
+    if( p.option( "T" ) )
+    {
+        return std::make_unique< cmd::Trace >( select( p ), p.option( "T" ).argument() );
+    }
+    return select( p );
+}
+
+
+// The command the options ask for.
+Cmd select( const Parser & p )
+{
     if( p.option( "h" ) || p.option( "help" ) )
     {
         p.print_options();
@@ -157,6 +267,56 @@ Cmd parse( int argc, Argv argv )
         return std::make_unique< cmd::ReportOutliers >( find_dataset( p ) );
     }
 
+    if( p.option( "b" ) )
+    {
+        return create_benchmark( p );
+    }
+
+    if( p.option( "t" ) )
+    {
+        return create_train( p );
+    }
+
+    if( p.option( "u" ) )
+    {
+        return std::make_unique< cmd::Update >( p.option( "u" ).argument()
+                                              , find_dataset( p )
+                                              , find_labels_depth( p )
+                                              );
+    }
+
+    if( p.option( "S" ) )
+    {
+        if( ! p.option( "c" ) )
+        {
+            throw Exception{ "Serving needs a trained pipeline, see -c." };
+        }
+        return std::make_unique< cmd::Serve >( p.option( "c" ).argument()
+                                             , p.option( "S" ).argument()
+                                             );
+    }
+
+    if( p.option( "q" ) )
+    {
+        return std::make_unique< cmd::Query >( p.option( "q" ).argument()
+                                             , find_dataset( p )
+                                             );
+    }
+
+    if( p.option( "Q" ) )
+    {
+        return std::make_unique< cmd::Load >( p.option( "Q" ).argument()
+                                            , find_dataset( p )
+                                            );
+    }
+
+    if( p.option( "c" ) )
+    {
+        return std::make_unique< cmd::Classify >( p.option( "c" ).argument()
+                                                , find_dataset( p )
+                                                );
+    }
+
     if( p.option( "m" ) )
     {
         return create_model( p );
@@ -170,10 +330,35 @@ Cmd parse( int argc, Argv argv )
         return std::make_unique< cmd::NoOp >();
     }
 
+    if( p.option( "g" ) )
+    {
+        return std::make_unique< cmd::Generate >( p.option( "g" ).argument() );
+    }
+
+    if( p.option( "P" ) )
+    {
+        return std::make_unique< cmd::Publish >( find_dataset( p )
+                                               , find_labels_depth( p )
+                                               , p.option( "P" ).argument()
+                                               );
+    }
+
+    if( p.option( "W" ) )
+    {
+        return std::make_unique< cmd::Work >( p.option( "W" ).argument() );
+    }
+
+    if( p.option( "E" ) )
+    {
+        return std::make_unique< cmd::Report >( p.option( "E" ).argument() );
+    }
+
     if( p.option( "a" ) )
     {
         return std::make_unique< cmd::RunAllModels >( find_dataset( p )
                                                     , find_labels_depth( p )
+                                                    , p.option( "e" ) ? p.option( "e" ).argument() : ""
+                                                    , p.option( "w" ) ? positive( p, "w" ) : 0u
                                                     );
     }
 
@@ -185,6 +370,10 @@ Cmd parse( int argc, Argv argv )
 #else  // CMAKE_USE_DLIB
 
 
+namespace cli
+{
+
+
 std::unique_ptr<cmd::Base> parse( int, Argv )
 {
     print::info( "dlib is required for command line parsing. Exiting." );
@@ -1,17 +1,38 @@
 #include "cmd.h"
 
+#include "art.h"
+#include "bench.h"
 #include "dim.h"
+#include "except.h"
+#include "gen.h"
 #include "io.h"
 #include "label.h"
 #include "model.h"
+#include "opt.h"
+#include "perf.h"
 #include "pre.h"
 #include "print.h"
+#include "res.h"
 #include "score.h"
+#include "shm.h"
+#include "spool.h"
+#include "srv.h"
+#include "stage.h"
+#include "sweep.h"
 #include "task.h"
+#include "trace.h"
 
+#include <signal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <numeric>
+#include <sstream>
 #include <type_traits>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -39,8 +60,10 @@ dat::Dataset read_dataset( const std::filesystem::path & p, unsigned labels_dept
 {
     print::info( std::string( "Reading dataset '" ) + p.string()
                + "' at labels depth " + std::to_string( labels_depth ) );
+    perf::Scope stage{ "read" };
     auto raw{ io::read( p, labels_depth ) };
     const auto encoded{ dat::encode( std::move( raw ) ) };
+    stage.count( dat::count( encoded ) );
     return encoded;
 }
 
@@ -54,6 +77,7 @@ void preprocess_dataset( dat::Dataset & d
     for( const auto & op : operations )
     {
         print::info( "Preprocessing dataset via '" + op + "' algo." );
+        const perf::Scope stage{ "pre:", op, dat::count( d ) };
         const auto algo{ pre::create( op, d ) };
         d = ( *algo )( d );
     }
@@ -65,46 +89,12 @@ dat::DatasetCompressed reduce_dataset( const dat::Dataset & d
                                      )
 {
     print::info( "Performing dimensionality reduction via '" + algo + "' algo." );
+    const perf::Scope stage{ "reduce:", algo, dat::count( d ) };
     const auto r{ dim::create( algo, d ) };
     return ( * r )( d );
 }
 
 
-void evaluate( const dat::Dataset & test
-             , const model::Base & m
-             )
-{
-    print::info( "Evaluating the test set." );
-    std::vector< label::Num > ground_truth;
-    std::vector< label::Num > predicted;
-    for( const auto & kv : test.first )
-    {
-        for( const auto & s : kv.second )
-        {
-            ground_truth.push_back( kv.first );
-            predicted.push_back( m.predict( s ) );
-        }
-    }
-
-    // Reduce to head labels.
-    const auto headonly{ test.second.headonly() };
-    const auto gt{ label::headonly_recode( ground_truth, test.second, headonly) };
-    const auto pr{ label::headonly_recode( predicted, test.second, headonly) };
-
-#ifdef CMAKE_USE_DLIB
-    print::info( "Calculating confusion matrix." );
-    const auto conf = score::calc_confusion( gt, pr );
-
-    std::cout << "Confusion matrix, rows - ground truth, columns - prediction.\n"
-                 "Labels: " << test.second << '\n'
-              << conf
-              << "\naccuracy: " << score::accuracy( conf ) << '\n';
-#else
-    print::info( "Accuracy evaluadion disabled because dlib is not used." );
-#endif  // CMAKE_USE_DLIB
-}
-
-
 // Perform generic polymorphism on the return value
 // which a lambda cannot.
 auto split( auto && dataset, const std::string & reduction )
@@ -132,39 +122,376 @@ void RunModel::execute()
     const auto traintest{ split( std::move( dataset ) ) };
 
     print::info( "Training a " + _model_name + " model." );
-    const auto m{ model::create( _model_name, traintest.first ) };
+    auto m{ [ & ]
+        {
+            const perf::Scope stage{ "train:", _model_name, dat::count( traintest.first ) };
+            return model::create( _model_name, traintest.first );
+        }() };
+
+    const auto accuracy{ score::evaluate( traintest.second, * m, model::Registry::get().at( _model_name )._traits )._accuracy };
+
+    if( opt::get< std::string >( "quant", "" ) == "int8" )
+    {
+        const model::Int8 q{ std::move( m ) };
+        const auto q_accuracy{ score::evaluate( traintest.second, q, { .batch = true } )._accuracy };
+        std::cout << "int8 accuracy delta: " << q_accuracy - accuracy << '\n';
+    }
+}
+
+
+Benchmark::Benchmark( const std::string & data_dir
+                    , const std::string & model_name
+                    , unsigned labels_depth
+                    , const std::vector< std::string > & preprocessing
+                    , const std::string & reduction
+                    , const std::string & json
+                    )
+    : _data_dir{ data_dir }
+    , _model_name{ model_name }
+    , _labels_depth{ labels_depth }
+    , _preprocessing{ preprocessing }
+    , _reduction{ reduction }
+    , _json{ json }
+{
+}
+
+
+void Benchmark::execute()
+{
+    const auto r{ bench::run( _data_dir, _labels_depth, _model_name, _preprocessing, _reduction ) };
+    bench::print( r );
+
+    std::ofstream f{ _json };
+    bench::write_json( r, f );
+    if( ! f )
+    {
+        throw Exception{ "Failed writing benchmark '" + _json + "'." };
+    }
+}
+
+
+Train::Train( const std::string & data_dir
+            , const std::string & model_name
+            , unsigned labels_depth
+            , const std::vector< std::string > & preprocessing
+            , const std::string & artifact
+            )
+    : _data_dir{ data_dir }
+    , _model_name{ model_name }
+    , _labels_depth{ labels_depth }
+    , _preprocessing{ preprocessing }
+    , _artifact{ artifact }
+{
+}
+
+
+void Train::execute()
+{
+    auto dataset{ read_dataset( _data_dir, _labels_depth ) };
+
+    art::Pipeline p;
+    for( const auto & op : _preprocessing )
+    {
+        print::info( "Preprocessing dataset via '" + op + "' algo." );
+        auto algo{ pre::create( op, dataset ) };
+        dataset = ( * algo )( dataset );
+        p._preprocessing.emplace_back( op, std::move( algo ) );
+    }
+
+    print::info( "Training a " + _model_name + " model." );
+    p._codec = dataset.second;
+    p._model_name = _model_name;
+    p._model = model::create( _model_name, dataset );
+
+    print::info( "Saving the trained pipeline to '" + _artifact + "'." );
+    p.save( _artifact );
+}
+
+
+Update::Update( const std::string & artifact
+              , const std::string & data_dir
+              , unsigned labels_depth
+              )
+    : _artifact{ artifact }
+    , _data_dir{ data_dir }
+    , _labels_depth{ labels_depth }
+{
+}
+
+
+void Update::execute()
+{
+    print::info( "Loading the trained pipeline from '" + _artifact + "'." );
+    auto p{ art::Pipeline::load( _artifact ) };
+    if( ! model::Registry::get().at( p._model_name )._traits.online )
+    {
+        throw Exception{ "Model '" + p._model_name + "' cannot be updated, train it again instead." };
+    }
+
+    print::info( std::string( "Reading new spectra from '" ) + _data_dir
+               + "' at labels depth " + std::to_string( _labels_depth ) );
+    dat::Dataset d;
+    for( auto & kv : io::read( _data_dir, _labels_depth ) )
+    {
+        for( auto & s : kv.second )
+        {
+            p.preprocess( s );
+        }
+        d.first.emplace( p._codec.encode( kv.first ), std::move( kv.second ) );
+    }
+    d.second = p._codec;
+
+    print::info( "Updating the " + p._model_name + " model with "
+               + std::to_string( dat::count( d ) ) + " spectra." );
+    p._model->partial_fit( d );
+
+    print::info( "Saving the updated pipeline to '" + _artifact + "'." );
+    p.save( _artifact );
+}
+
+
+Classify::Classify( const std::string & artifact
+                  , const std::string & data_dir
+                  )
+    : _artifact{ artifact }
+    , _data_dir{ data_dir }
+{
+}
+
+
+void Classify::execute()
+{
+    print::info( "Loading the trained pipeline from '" + _artifact + "'." );
+    const auto p{ art::Pipeline::load( _artifact ) };
+
+    const auto files{ io::recursively_list_csvs( _data_dir ) };
+    const auto start{ std::chrono::steady_clock::now() };
+    const auto busy{ stage::classify( p
+                                    , files
+                                    , [ & ] ( size_t i, label::Num l )
+                                      {
+                                          std::cout << files[ i ].string() << ',' << p._codec.decode( l ) << '\n';
+                                      }
+                                    , opt::get( "classify.batch", 64u )
+                                    , opt::get( "classify.depth", 4u ) ) };
+    const std::chrono::duration< double > elapsed{ std::chrono::steady_clock::now() - start };
+
+    const auto ms = [] ( std::chrono::duration< double > d ) { return std::to_string( d.count() * 1e3 ); };
+    print::info( "Classified " + std::to_string( files.size() ) + " spectra in " + ms( elapsed )
+               + " ms; stages busy reading " + ms( busy._read ) + " ms, preprocessing "
+               + ms( busy._preprocess ) + " ms, predicting " + ms( busy._predict ) + " ms." );
+}
+
+
+Serve::Serve( const std::string & artifact
+            , const std::string & socket
+            )
+    : _artifact{ artifact }
+    , _socket{ socket }
+{
+}
+
+
+void Serve::execute()
+{
+    print::info( "Loading the trained pipeline from '" + _artifact + "'." );
+    const auto p{ art::Pipeline::load( _artifact ) };
+    srv::serve( _socket, p );
+}
+
+
+Query::Query( const std::string & socket
+            , const std::string & data_dir
+            )
+    : _socket{ socket }
+    , _data_dir{ data_dir }
+{
+}
+
+
+void Query::execute()
+{
+    const auto files{ io::recursively_list_csvs( _data_dir ) };
+    std::vector< dat::Spectrum > spectra;
+    for( const auto & f : files )
+    {
+        spectra.push_back( io::read_csv( f ) );
+    }
+
+    srv::Client client{ _socket };
+    std::unordered_map< label::Num, std::string > names;
+    std::istringstream labels{ client.request( 'L' ) };
+    for( std::string line; std::getline( labels, line ); )
+    {
+        const auto comma{ line.find( ',' ) };
+        names[ static_cast< label::Num >( std::stoul( line.substr( 0, comma ) ) ) ] = line.substr( comma + 1 );
+    }
+
+    const auto scored{ client.classify( spectra ) };
+    for( size_t i {}; i < files.size(); ++i )
+    {
+        std::cout << files[ i ].string() << ',' << names[ scored[ i ].first ]
+                  << ',' << scored[ i ].second << '\n';
+    }
+    std::cout << client.request( 'S' );
+}
 
-    evaluate( traintest.second, * m );
+
+Load::Load( const std::string & socket
+          , const std::string & data_dir
+          )
+    : _socket{ socket }
+    , _data_dir{ data_dir }
+{
+}
+
+
+void Load::execute()
+{
+    std::vector< dat::Spectrum > spectra;
+    for( const auto & f : io::recursively_list_csvs( _data_dir ) )
+    {
+        spectra.push_back( io::read_csv( f ) );
+    }
+
+    srv::load( _socket
+             , spectra
+             , opt::get( "srv.connections", 4u )
+             , opt::get( "srv.batch", 1u )
+             , opt::get( "srv.seconds", 10. )
+             );
 }
 
 
 RunAllModels::RunAllModels( const std::string & data_dir
                           , unsigned labels_depth_max
+                          , const std::string & store
+                          , unsigned workers
                           )
     : _data_dir{ data_dir }
     , _labels_depth_max{ labels_depth_max }
+    , _store{ store }
+    , _workers{ workers }
 {
 }
 
 
 void RunAllModels::execute()
 {
-    for( const auto & m : model::ALL_MODELS )
+    if( _workers )
+    {
+        const std::filesystem::path dir{ opt::get( "spool.dir"
+                                                 , ( std::filesystem::temp_directory_path() / "rocks-spool" ).string() ) };
+        const auto store{ _store.empty() ? dir / "results" : std::filesystem::path{ _store } };
+        std::filesystem::create_directories( dir );
+        print::info( "Recording the results into '" + store.string() + "'." );
+        spool::run( dir, _data_dir, sweep::plan( _labels_depth_max ), store, _workers );
+        return;
+    }
+
+    const auto store{ _store.empty() ? nullptr : res::open( _store ) };
+    sweep::run( _data_dir, sweep::plan( _labels_depth_max ), store.get() );
+}
+
+
+Trace::Trace( std::unique_ptr< Base > traced, const std::string & json )
+    : _traced{ std::move( traced ) }
+    , _json{ json }
+{
+}
+
+
+void Trace::execute()
+{
+    trace::start();
+    _traced->execute();
+
+    std::ofstream f{ _json };
+    trace::write_json( f );
+    if( ! f )
     {
-        for( const auto & p : pre::ALL_PRE )
+        throw Exception{ "Failed writing trace '" + _json + "'." };
+    }
+    print::info( "Wrote the trace to '" + _json + "'." );
+}
+
+
+Generate::Generate( const std::string & out )
+    : _out{ out }
+{
+}
+
+
+void Generate::execute()
+{
+    gen::generate( _out );
+}
+
+
+Publish::Publish( const std::string & data_dir
+                , unsigned labels_depth
+                , const std::string & name
+                )
+    : _data_dir{ data_dir }
+    , _labels_depth{ labels_depth }
+    , _name{ name }
+{
+}
+
+
+void Publish::execute()
+{
+    // Waited for rather than handled, so the segment is released on the way out.
+    sigset_t signals;
+    sigemptyset( & signals );
+    sigaddset( & signals, SIGINT );
+    sigaddset( & signals, SIGTERM );
+    pthread_sigmask( SIG_BLOCK, & signals, nullptr );
+
+    const auto segment{ shm::Segment::publish( _name, io::read( _data_dir, _labels_depth ), _labels_depth ) };
+    print::info( "Published '" + _data_dir + "' as shared dataset '" + _name + "' until interrupted." );
+    int signal {};
+    sigwait( & signals, & signal );
+    print::info( "Unpublishing '" + _name + "'." );
+}
+
+
+Work::Work( const std::string & dir )
+    : _dir{ dir }
+{
+}
+
+
+void Work::execute()
+{
+    spool::work( _dir );
+}
+
+
+Report::Report( const std::string & store )
+    : _store{ store }
+{
+}
+
+
+void Report::execute()
+{
+    auto records{ res::open( _store )->records() };
+    std::sort( records.begin(), records.end(), [] ( const res::Record & a, const res::Record & b )
         {
-            for( auto l{ _labels_depth_max }; l; --l )
-            {
-                const std::string reduction;
-                RunModel model( _data_dir
-                              , m
-                              , l
-                              , std::vector< std::string >{ p }
-                              , reduction
-                              );
-                model.execute();
-            }
-        }
+            return a._accuracy > b._accuracy;
+        } );
+    if( const auto top{ opt::get( "report.top", size_t{} ) }; top && top < records.size() )
+    {
+        records.resize( top );
+    }
+
+    std::cout << "accuracy\ttraining_s\tpredicting_s\tcell\tdataset\n";
+    for( const auto & r : records )
+    {
+        std::cout << std::fixed << std::setprecision( 4 ) << r._accuracy << '\t'
+                  << std::setprecision( 3 ) << r._training << '\t' << r._predicting << '\t'
+                  << sweep::describe( r._cell ) << '\t' << r._dataset << '\n';
     }
 }
 
@@ -30,6 +30,7 @@ struct NoOp : Base
 };
 
 
+// Option: perf.stages - log the hardware counters of every stage, see 'perf.h'.
 struct RunModel : Base
 {
     RunModel( const std::string & data_dir
@@ -48,15 +49,196 @@ struct RunModel : Base
 };
 
 
+// Time every stage of training and predicting with 'model_name' on 'data_dir',
+// print the stages and write them into 'json', see 'bench.h'.
+struct Benchmark : Base
+{
+    Benchmark( const std::string & data_dir
+             , const std::string & model_name
+             , unsigned labels_depth
+             , const std::vector< std::string > & preprocessing
+             , const std::string & reduction
+             , const std::string & json
+             );
+    void execute() override;
+
+    const std::string _data_dir;
+    const std::string _model_name;
+    const unsigned _labels_depth;
+    const std::vector< std::string > _preprocessing;
+    const std::string _reduction;
+    const std::string _json;
+};
+
+
+// Fit the preprocessing and the model on the whole dataset
+// and save them into an artifact, see 'art.h'.
+struct Train : Base
+{
+    Train( const std::string & data_dir
+         , const std::string & model_name
+         , unsigned labels_depth
+         , const std::vector< std::string > & preprocessing
+         , const std::string & artifact
+         );
+    void execute() override;
+
+    const std::string _data_dir;
+    const std::string _model_name;
+    const unsigned _labels_depth;
+    const std::vector< std::string > _preprocessing;
+    const std::string _artifact;
+};
+
+
+// Continue training a saved pipeline's model on the spectra under 'data_dir' only,
+// then save it back. Labels new to the pipeline are added to it.
+struct Update : Base
+{
+    Update( const std::string & artifact
+          , const std::string & data_dir
+          , unsigned labels_depth
+          );
+    void execute() override;
+
+    const std::string _artifact;
+    const std::string _data_dir;
+    const unsigned _labels_depth;
+};
+
+
+// Print the predicted label of every .csv file under 'data_dir'.
+// Reading, preprocessing and predicting run concurrently, see 'stage.h'.
+// Options: classify.batch - spectra per batch, classify.depth - batches queued between stages.
+struct Classify : Base
+{
+    Classify( const std::string & artifact
+            , const std::string & data_dir
+            );
+    void execute() override;
+
+    const std::string _artifact;
+    const std::string _data_dir;
+};
+
+
+// Answer prediction requests on a Unix socket, see 'srv.h'.
+struct Serve : Base
+{
+    Serve( const std::string & artifact
+         , const std::string & socket
+         );
+    void execute() override;
+
+    const std::string _artifact;
+    const std::string _socket;
+};
+
+
+// Classify the .csv files under 'data_dir' via a running 'Serve'.
+struct Query : Base
+{
+    Query( const std::string & socket
+         , const std::string & data_dir
+         );
+    void execute() override;
+
+    const std::string _socket;
+    const std::string _data_dir;
+};
+
+
+// Benchmark a running 'Serve' with the .csv files under 'data_dir'.
+// Options: srv.connections, srv.batch - spectra per request, srv.seconds.
+struct Load : Base
+{
+    Load( const std::string & socket
+        , const std::string & data_dir
+        );
+    void execute() override;
+
+    const std::string _socket;
+    const std::string _data_dir;
+};
+
+
+// Every model on every preprocessing at every labels depth up to the given one,
+// see 'sweep.h'. With a 'store', results are recorded into it and cells
+// recorded already are skipped, see 'res.h'. With 'workers', cells are run
+// by as many processes, see 'spool.h'; the store is then 'results' in the
+// spool directory unless given.
+// Option: spool.dir - the spool directory, 'rocks-spool' in the temp dir by default.
 struct RunAllModels : Base
 {
     RunAllModels( const std::string & data_dir
                 , unsigned labels_depth_max
+                , const std::string & store = ""
+                , unsigned workers = 0
                 );
     void execute() override;
 
     const std::string _data_dir;
     const unsigned _labels_depth_max;
+    const std::string _store;
+    const unsigned _workers;
+};
+
+
+// Execute 'traced', recording its stages into the Chrome trace 'json', see 'trace.h'.
+struct Trace : Base
+{
+    Trace( std::unique_ptr< Base > traced, const std::string & json );
+    void execute() override;
+
+    const std::unique_ptr< Base > _traced;
+    const std::string _json;
+};
+
+
+// Write a synthetic dataset into 'out', see 'gen.h'.
+struct Generate : Base
+{
+    Generate( const std::string & out );
+    void execute() override;
+
+    const std::string _out;
+};
+
+
+// Publish the dataset under 'data_dir' as the shared memory 'name', see 'shm.h',
+// until interrupted. Other commands read it given "shm:<name>" for a dataset dir.
+struct Publish : Base
+{
+    Publish( const std::string & data_dir
+           , unsigned labels_depth
+           , const std::string & name
+           );
+    void execute() override;
+
+    const std::string _data_dir;
+    const unsigned _labels_depth;
+    const std::string _name;
+};
+
+
+// Run the sweep jobs spooled in 'dir' by 'RunAllModels'.
+struct Work : Base
+{
+    Work( const std::string & dir );
+    void execute() override;
+
+    const std::string _dir;
+};
+
+
+// Print the results recorded into 'store', best accuracy first.
+// Option: report.top - most cells printed, 0 for all.
+struct Report : Base
+{
+    Report( const std::string & store );
+    void execute() override;
+
+    const std::string _store;
 };
 
 
@@ -1,6 +1,8 @@
 #include "dat.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <random>
 
 
@@ -16,6 +18,7 @@ void append( std::vector< Spectrum > & v1, const std::vector< Spectrum > & v2 )
 
 auto split_impl( auto & dataset
                , double traintest
+               , unsigned seed
                )
 {
     assert( traintest > 0 && traintest < 1 );
@@ -24,7 +27,7 @@ auto split_impl( auto & dataset
                  );
 
     std::default_random_engine engine;
-    engine.seed( 0 );
+    engine.seed( seed );
     std::uniform_real_distribution distribution( 0., 1. );
 
     using T = typename std::decay_t< decltype( dataset ) >;
@@ -53,17 +56,19 @@ auto split_impl( auto & dataset
 
 std::pair< Dataset, Dataset > split( const Dataset & d
                                    , double traintest
+                                   , unsigned seed
                                    )
 {
-    return split_impl( d, traintest );
+    return split_impl( d, traintest, seed );
 }
 
 
 std::pair< DatasetCompressed, DatasetCompressed > split( const DatasetCompressed & d
                                                        , double traintest
+                                                       , unsigned seed
                                                        )
 {
-    return split_impl( d, traintest );
+    return split_impl( d, traintest, seed );
 }
 
 
@@ -123,6 +128,24 @@ DataRaw decode( Dataset && d, const label::Codec & c )
 }
 
 
+DataRaw coarsen( const DataRaw & raw, unsigned depth )
+{
+    std::vector< const DataRaw::value_type * > sorted;
+    for( const auto & kv : raw )
+    {
+        sorted.push_back( & kv );
+    }
+    std::sort( sorted.begin(), sorted.end(), [] ( auto a, auto b ) { return a->first < b->first; } );
+
+    DataRaw ret;
+    for( const auto kv : sorted )
+    {
+        append( ret[ label::truncate( kv->first, depth ) ], kv->second );
+    }
+    return ret;
+}
+
+
 // The iteration order of unordered associative containers can only change
 // when rehashing as a result of a mutating operation
 // (as described in C++11 23.2.5/8).
@@ -173,6 +196,30 @@ size_t count( const Dataset & d )
 }
 
 
+std::uint64_t fingerprint( const Dataset & d )
+{
+    // FNV-1a, a word at a time.
+    std::uint64_t ret{ 14695981039346656037ull };
+    const auto add = [ & ] ( std::uint64_t word )
+    {
+        ret = ( ret ^ word ) * 1099511628211ull;
+    };
+    dat::apply( [ & ] ( label::Num l, const Spectrum & s )
+        {
+            add( l );
+            for( const auto y : s._y )
+            {
+                std::uint64_t word;
+                std::memcpy( & word, & y, sizeof( word ) );
+                add( word );
+            }
+        }
+              , d );
+    return ret;
+}
+
+
+#ifdef CMAKE_USE_SHARK
 shark::RealVector to_shark_vector( const Spectrum & s )
 {
     return { s._y.cbegin(), s._y.cend() };
@@ -224,6 +271,7 @@ Dataset from_shark_dataset( const shark::ClassificationDataset & d
     }
     return ret;
 }
+#endif  // CMAKE_USE_SHARK
 
 
 #ifdef CMAKE_USE_DLIB
@@ -240,7 +288,7 @@ DlibSample to_dlib_sample( const Spectrum & s )
         assert( abs( s._y[ i ] - sam( i ) ) < 1e-9 );
     }
 
-    return {};
+    return sam;
 }
 #endif  // CMAKE_USE_DLIB
 
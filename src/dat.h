@@ -20,6 +20,7 @@
 #endif
 
 #include <array>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <unordered_map>
@@ -94,10 +95,13 @@ using DatasetCompressed = std::pair< DataCompressed, label::Codec >;
 // Perform holdout split.
 // Sample points at random without regard to label. TODO: stratified sampler.
 // `traintest` ranges from 0 - only test to 1 - only train.
+// The same `seed` gives the same split.
 std::pair< Dataset, Dataset > split( const Dataset &
-                                   , double traintest=0.66 );
+                                   , double traintest=0.66
+                                   , unsigned seed=0 );
 std::pair< DatasetCompressed, DatasetCompressed > split( const DatasetCompressed &
-                                                       , double traintest=0.66 );
+                                                       , double traintest=0.66
+                                                       , unsigned seed=0 );
 
 
 Dataset encode( DataRaw && );
@@ -106,6 +110,12 @@ Dataset encode( const DataRaw & raw, const label::Codec & );
 
 DataRaw decode( Dataset &&, const label::Codec & );
 
+// Labels cut to their first 'depth' parts, as if read at that labels depth.
+// Spectra of labels sharing those parts are merged in the order of the labels.
+// Only those read are there: .csv files lying above the depth read are not,
+// see 'io::csvs_above()'.
+DataRaw coarsen( const DataRaw &, unsigned depth );
+
 // Invoke provided functor on every element in a dataset.
 // Walking order is consistent until the dataset is altered.
 void apply( std::function< void ( label::Num, const Spectrum & ) >
@@ -117,6 +127,10 @@ void mutate( std::function< void ( label::Num, Spectrum & ) >
 // Count total number of spectra.
 size_t count( const Dataset & );
 
+// Of the labels and spectra in walking order, to tell whether something
+// derived from a dataset, e.g. a saved index, still matches it.
+std::uint64_t fingerprint( const Dataset & );
+
 #ifdef CMAKE_USE_SHARK
 shark::RealVector to_shark_vector( const Spectrum & );
 shark::ClassificationDataset to_shark_dataset( const Dataset & );
@@ -158,7 +158,25 @@ dat::SpectrumCompressed Simple::operator()( const dat::Spectrum & s ) const
 }
 
 
-const std::vector< std::string > ALL{ "simple"
-                                    };
+void check( const std::string & name )
+{
+    if( ! Registry::get().contains( name ) )
+    {
+        throw Exception( name + ": no such reduction algo found. "
+                         "Use -s to see all available algos." );
+    }
+}
+
+
+std::unique_ptr< Base > create( const std::string & name
+                              , const dat::Dataset & d )
+{
+    check( name );
+    return Registry::get().at( name )._create( d );
+}
+
+
+const reg::Add< Base, Simple > add_simple{ "simple", {} };
+
 
 }  // namespace dim
@@ -7,12 +7,14 @@
 
 #include "dat.h"
 #include "except.h"
+#include "reg.h"
 
 #ifdef CMAKE_USE_OPENCV
 #include <opencv2/core.hpp>
 #endif
 
 #include <array>
+#include <memory>
 #include <vector>
 
 
@@ -69,25 +71,15 @@ struct Simple : Base
 
 
 
-inline std::unique_ptr< Base > create( const std::string & name
-                                     , const dat::Dataset & d )
-{
-    const auto is = [ & name ] ( const char * p )
-        { return ( name.compare( p ) == 0 ); };
-
-    if( is( "simple" ) )
-    {
-        return std::make_unique< Simple >( d );
-    }
-
-    throw Exception( name + ": no such reduction algo found. "
-                     "See 'dim.h' for a list of all algos." );
-}
+// Algorithms register themselves at the end of dim.cpp, see reg.h.
+using Registry = reg::Registry< Base, const dat::Dataset & >;
 
 
-extern const std::vector< std::string > ALL;
+// Throws unless 'name' is a registered algorithm, without constructing it.
+void check( const std::string & name );
 
 
+std::unique_ptr< Base > create( const std::string & name, const dat::Dataset & );
 
 
 }  // namespace dim
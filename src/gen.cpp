@@ -0,0 +1,269 @@
+#include "gen.h"
+
+#include "dat.h"
+#include "except.h"
+#include "io.h"
+#include "opt.h"
+#include "print.h"
+#include "task.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <numbers>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace gen
+{
+
+
+namespace fs = std::filesystem;
+constexpr auto N{ dat::Spectrum::_num_points };
+constexpr double STEP_NM{ 0.1 };
+
+
+struct Setup
+{
+    unsigned _classes;
+    unsigned _spots;
+    unsigned _shots;
+    unsigned _lines;
+    std::vector< double > _wavelengths;
+    std::string _profile;
+    double _width;
+    double _baseline;
+    double _drift;
+    double _noise;
+    unsigned _seed;
+};
+
+
+Setup setup()
+{
+    Setup ret{ opt::get( "gen.classes", 4u )
+             , opt::get( "gen.spots", 4u )
+             , opt::get( "gen.shots", 25u )
+             , opt::get( "gen.lines", 12u )
+             , opt::get_list< double >( "gen.wavelengths", {} )
+             , opt::get< std::string >( "gen.profile", "mixed" )
+             , opt::get( "gen.width", 0.2 )
+             , opt::get( "gen.baseline", 20. )
+             , opt::get( "gen.drift", 30. )
+             , opt::get( "gen.noise", 5. )
+             , opt::get( "gen.seed", 0u )
+             };
+    if( ! ret._classes || ! ret._spots || ! ret._shots )
+    {
+        throw Exception{ "Generating needs at least a class, a spot and a shot." };
+    }
+    if( ret._profile != "gauss" && ret._profile != "lorentz" && ret._profile != "mixed" )
+    {
+        throw Exception{ "Unknown line profile '" + ret._profile + "'." };
+    }
+    if( ret._width <= 0 )
+    {
+        throw Exception{ "Lines need a positive width." };
+    }
+    return ret;
+}
+
+
+struct Line
+{
+    // Index into the spectrum, fractional.
+    double _at;
+    double _height;
+    double _width;
+    bool _lorentz;
+};
+
+
+// Of class 'c', the same for all its spectra.
+std::vector< Line > lines( const Setup & s, unsigned c )
+{
+    std::seed_seq seed{ s._seed, c };
+    std::mt19937 g{ seed };
+    std::uniform_real_distribution< double > anywhere{ dat::Spectrum::_x.front(), dat::Spectrum::_x.back() };
+    std::uniform_real_distribution< double > log_height{ std::log( 50. ), std::log( 5000. ) };
+    std::uniform_real_distribution< double > width{ 0.5, 1.5 };
+    std::bernoulli_distribution lorentz{ s._profile == "lorentz" ? 1. : s._profile == "gauss" ? 0. : 0.5 };
+
+    std::vector< Line > ret;
+    for( unsigned i {}; i < s._lines; ++i )
+    {
+        const auto nm{ s._wavelengths.empty()
+                     ? anywhere( g )
+                     : s._wavelengths[ std::uniform_int_distribution< size_t >{ 0, s._wavelengths.size() - 1 }( g ) ] };
+        ret.push_back( { ( nm - dat::Spectrum::_x.front() ) / STEP_NM
+                       , std::exp( log_height( g ) )
+                       , s._width * width( g ) / STEP_NM
+                       , lorentz( g ) } );
+    }
+    return ret;
+}
+
+
+dat::Spectrum spectrum( const Setup & s, const std::vector< Line > & lines, unsigned c, unsigned spot, unsigned shot )
+{
+    // The spot scales all its shots alike.
+    std::seed_seq spot_seed{ s._seed, c, spot };
+    std::mt19937 spot_g{ spot_seed };
+    const auto spot_scale{ std::uniform_real_distribution< double >{ 0.5, 1.5 }( spot_g ) };
+
+    std::seed_seq seed{ s._seed, c, spot, shot + 1 };
+    std::mt19937 g{ seed };
+    std::uniform_real_distribution< double > uniform{ 0, 1 };
+    const auto scale{ spot_scale * std::exp( std::normal_distribution< double >{ 0, 0.1 }( g ) ) };
+    const auto slope{ uniform( g ) - 0.5 };
+    const auto wave{ uniform( g ) };
+    const auto phase{ 2 * std::numbers::pi * uniform( g ) };
+
+    dat::Spectrum ret;
+    std::normal_distribution< double > noise{ 0, s._noise };
+    for( unsigned i {}; i < N; ++i )
+    {
+        const auto x{ double( i ) / N };
+        ret._y[ i ] = s._baseline + s._drift * ( slope * x + wave * std::sin( 2 * std::numbers::pi * x + phase ) ) + noise( g );
+    }
+
+    for( const auto & l : lines )
+    {
+        // Far enough for the tail to fall below the noise.
+        const auto reach{ l._width * ( l._lorentz ? 50 : 5 ) };
+        const auto from{ static_cast< unsigned >( std::clamp( l._at - reach, 0., double( N ) ) ) };
+        const auto to{ static_cast< unsigned >( std::clamp( l._at + reach + 1, 0., double( N ) ) ) };
+        const auto height{ l._height * scale };
+        for( auto i{ from }; i < to; ++i )
+        {
+            const auto d{ ( i - l._at ) / l._width };
+            ret._y[ i ] += l._lorentz ? height / ( 1 + d * d ) : height * std::exp( -0.5 * d * d );
+        }
+    }
+    return ret;
+}
+
+
+// Zero padded to the width of the largest of 'count'.
+std::string name( const std::string & prefix, unsigned i, unsigned count )
+{
+    const auto digits{ std::to_string( std::max( count, 1u ) - 1 ).size() };
+    auto ret{ std::to_string( i ) };
+    return prefix + std::string( std::max( digits, ret.size() ) - ret.size(), '0' ) + ret;
+}
+
+
+// As exported by the spectrometer, see io::read_csv.
+void write_csv( const fs::path & p, const dat::Spectrum & s )
+{
+    // The wavelength column is the same in every file.
+    static const auto wavelengths{ []
+        {
+            std::vector< std::string > ret;
+            char buffer[ 32 ];
+            for( const auto x : dat::Spectrum::_x )
+            {
+                std::snprintf( buffer, sizeof( buffer ), "%.8f,", x );
+                ret.push_back( buffer );
+            }
+            return ret;
+        }() };
+
+    std::string out{ "wavelength,intensity\r\n" };
+    out.reserve( N * 32 );
+    char buffer[ 32 ];
+    for( unsigned i {}; i < N; ++i )
+    {
+        out += wavelengths[ i ];
+        const auto end{ std::to_chars( buffer, buffer + sizeof( buffer ), s._y[ i ], std::chars_format::fixed, 4 ).ptr };
+        out.append( buffer, end );
+        out += "\r\n";
+    }
+
+    std::ofstream f{ p, std::ios::binary };
+    f.write( out.data(), static_cast< std::streamsize >( out.size() ) );
+    if( ! f )
+    {
+        throw Exception{ "Failed writing '" + p.string() + "'." };
+    }
+}
+
+
+void generate( const fs::path & out )
+{
+    const auto s{ setup() };
+    std::vector< std::vector< Line > > classes;
+    for( unsigned c {}; c < s._classes; ++c )
+    {
+        classes.push_back( lines( s, c ) );
+    }
+    const auto label = [ & ] ( unsigned c, unsigned spot )
+    {
+        return name( "class", c, s._classes ) + io::SEPARATOR + name( "spot", spot, s._spots );
+    };
+    const size_t per_class{ size_t{ s._spots } * s._shots };
+    const auto total{ s._classes * per_class };
+    print::info( "Generating " + std::to_string( total ) + " spectra into '" + out.string() + "'." );
+
+    const auto format{ opt::get< std::string >( "gen.format", "csv" ) };
+    if( format == "csv" )
+    {
+        for( unsigned c {}; c < s._classes; ++c )
+        {
+            for( unsigned spot {}; spot < s._spots; ++spot )
+            {
+                fs::create_directories( out / label( c, spot ) );
+            }
+        }
+        task::parallel_for( total, [ & ] ( size_t i )
+            {
+                const auto c{ static_cast< unsigned >( i / per_class ) };
+                const auto spot{ static_cast< unsigned >( i % per_class / s._shots ) };
+                const auto shot{ static_cast< unsigned >( i % s._shots ) };
+                write_csv( out / label( c, spot ) / ( name( "shot", shot, s._shots ) + ".csv" )
+                         , spectrum( s, classes[ c ], c, spot, shot ) );
+            } );
+    }
+    else if( format == "cache" )
+    {
+        if( out.has_parent_path() )
+        {
+            fs::create_directories( out.parent_path() );
+        }
+        // A batch of shots at a time, generated in parallel and written in order.
+        constexpr unsigned BATCH{ 256 };
+        io::CacheWriter w{ out, size_t{ s._classes } * s._spots };
+        std::vector< dat::Spectrum > batch;
+        for( unsigned c {}; c < s._classes; ++c )
+        {
+            for( unsigned spot {}; spot < s._spots; ++spot )
+            {
+                w.label( io::SEPARATOR + label( c, spot ), s._shots );
+                for( unsigned first {}; first < s._shots; first += BATCH )
+                {
+                    batch.resize( std::min( BATCH, s._shots - first ) );
+                    task::parallel_for( batch.size(), [ & ] ( size_t i )
+                        {
+                            batch[ i ] = spectrum( s, classes[ c ], c, spot, first + static_cast< unsigned >( i ) );
+                        } );
+                    for( const auto & b : batch )
+                    {
+                        w.spectrum( b );
+                    }
+                }
+            }
+        }
+        w.close();
+    }
+    else
+    {
+        throw Exception{ "Unknown dataset format '" + format + "'." };
+    }
+}
+
+
+}  // namespace gen
@@ -0,0 +1,41 @@
+#ifndef GEN_H_
+#define GEN_H_
+
+
+// In this file: synthetic LIBS spectra, to test loaders and models at scale.
+//
+// A dataset of classes, each with emission lines of its own, shot at several
+// spots, laid out as 'io::read' expects at labels depth 2, or 1 for classes:
+//     out/class03/spot12/shot0042.csv
+// A spectrum sums a baseline drifting slowly along the wavelengths, the lines
+// of its class, Gaussian or Lorentzian, scaled by its spot and shot, and
+// Gaussian noise; a low baseline leaves some intensities negative, as in the
+// measurements. Every spectrum is generated in parallel from its own seed, so
+// the same options give the same dataset on any number of threads.
+
+
+#include <filesystem>
+
+
+namespace gen
+{
+
+
+// Into a tree of .csv files under 'out', or a single dataset cache file,
+// see io::write_cache, at labels depth 2. Either is read by 'io::read()'.
+// Options: gen.classes - 4 by default, gen.spots - per class, 4 by default,
+//          gen.shots - per spot, 25 by default,
+//          gen.lines - emission lines per class, 12 by default,
+//          gen.wavelengths - nm the lines are picked from, anywhere by default,
+//          gen.profile - of the lines, 'gauss', 'lorentz' or 'mixed', the default,
+//          gen.width - half width of the lines in nm, 0.2 by default,
+//          gen.baseline - level, 20 by default, gen.drift - of the baseline, 30 by default,
+//          gen.noise - standard deviation, 5 by default, gen.seed - 0 by default,
+//          gen.format - 'csv', the default, or 'cache'.
+void generate( const std::filesystem::path & out );
+
+
+}  // namespace gen
+
+
+#endif  // defined(GEN_H_)
@@ -1,13 +1,18 @@
 #include "io.h"
 
+#include "art.h"
 #include "except.h"
 #include "print.h"
+#include "shm.h"
+#include "task.h"
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <optional>
 #include <ranges>
 #include <vector>
 
@@ -113,18 +118,27 @@ std::vector< dat::Spectrum > recursively_read_csvs( const std::string & path )
 {
     const auto files{ recursively_list_csvs( path ) };
 
+    // Unreadable files are skipped, the rest keep their order.
+    std::vector< std::optional< dat::Spectrum > > read( files.size() );
+    task::parallel_for( files.size(), [ & ] ( size_t i )
+        {
+            try
+            {
+                read[ i ] = read_csv( files[ i ] );
+            }
+            catch( ... )
+            {
+            }
+        } );
+
     std::vector< dat::Spectrum > ret;
-    for( const auto & file : files)
+    for( auto & s : read )
     {
-        try
-        {
-            ret.push_back( read_csv( file ) );
-        }
-        catch( ... )
+        if( s )
         {
+            ret.push_back( std::move( * s ) );
         }
     }
-
     return ret;
 }
 
@@ -137,6 +151,23 @@ dat::DataRaw read( const fs::path & dataset_dir
                  , const std::string & labels_prefix
                  )
 {
+    if( labels_prefix.empty() && dataset_dir.string().starts_with( shm::PREFIX ) )
+    {
+        const auto name{ dataset_dir.string().substr( std::strlen( shm::PREFIX ) ) };
+        return shm::Segment::attach( name ).copy( labels_depth );
+    }
+    if( labels_prefix.empty() && fs::is_regular_file( dataset_dir ) )
+    {
+        auto ret{ read_cache( dataset_dir ) };
+        const auto cached{ ret.empty() ? 0u : static_cast< unsigned >( std::ranges::count( ret.begin()->first, SEPARATOR ) ) };
+        if( labels_depth > cached )
+        {
+            throw Exception{ "Dataset cache '" + dataset_dir.string() + "' holds labels depth "
+                           + std::to_string( cached ) + " only." };
+        }
+        return labels_depth < cached ? dat::coarsen( ret, labels_depth ) : ret;
+    }
+
     dat::DataRaw ret{};
 
     if( labels_depth > 0 )
@@ -171,4 +202,156 @@ dat::DataRaw read( const fs::path & dataset_dir
 }
 
 
+std::string identity( const fs::path & dataset_dir )
+{
+    if( dataset_dir.string().starts_with( shm::PREFIX ) )
+    {
+        return dataset_dir.string();
+    }
+    if( fs::is_regular_file( dataset_dir ) )
+    {
+        return fs::weakly_canonical( fs::absolute( dataset_dir ) ).string() + ", "
+             + std::to_string( fs::file_size( dataset_dir ) ) + " bytes";
+    }
+
+    std::uintmax_t bytes {};
+    const auto files{ recursively_list_csvs( dataset_dir ) };
+    for( const auto & f : files )
+    {
+        bytes += fs::file_size( f );
+    }
+    return fs::weakly_canonical( fs::absolute( dataset_dir ) ).string() + ", " + std::to_string( files.size() )
+         + " files, " + std::to_string( bytes ) + " bytes";
+}
+
+
+bool csvs_above( const fs::path & dataset_dir, unsigned labels_depth )
+{
+    if( dataset_dir.string().starts_with( shm::PREFIX ) || fs::is_regular_file( dataset_dir ) )
+    {
+        return false;
+    }
+
+    // The label dirs of one level at a time.
+    std::vector< fs::path > dirs{ dataset_dir };
+    for( unsigned level{ 1 }; level < labels_depth; ++level )
+    {
+        std::vector< fs::path > next;
+        for( const auto & d : dirs )
+        {
+            for( const auto & e : fs::directory_iterator( d ) )
+            {
+                if( e.is_directory() )
+                {
+                    next.push_back( e.path() );
+                }
+            }
+        }
+        dirs = std::move( next );
+        for( const auto & d : dirs )
+        {
+            for( const auto & e : fs::directory_iterator( d ) )
+            {
+                if( ! e.is_directory() && ends_with( e.path().filename(), ".csv" ) )
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+
+constexpr char CACHE_MAGIC[]{ "rocks-dataset" };
+constexpr std::uint32_t CACHE_VERSION{ 1 };
+
+
+// Spectra are streamed rather than buffered, the dataset being large.
+CacheWriter::CacheWriter( const fs::path & p, size_t labels )
+    : _path{ p }
+    , _f{ p, std::ios::binary }
+{
+    art::Writer w;
+    w.put( std::string{ CACHE_MAGIC } );
+    w.put( CACHE_VERSION );
+    w.put( std::uint64_t{ labels } );
+    _f.write( w._bytes.data(), static_cast< std::streamsize >( w._bytes.size() ) );
+}
+
+
+void CacheWriter::label( const label::Raw & l, size_t spectra )
+{
+    art::Writer w;
+    w.put( l );
+    w.put( std::uint64_t{ spectra } );
+    _f.write( w._bytes.data(), static_cast< std::streamsize >( w._bytes.size() ) );
+}
+
+
+void CacheWriter::spectrum( const dat::Spectrum & s )
+{
+    _f.write( reinterpret_cast< const char * >( s._y.data() ), sizeof( s._y ) );
+}
+
+
+void CacheWriter::close()
+{
+    _f.close();
+    if( ! _f )
+    {
+        throw Exception{ "Failed writing dataset cache '" + _path.string() + "'." };
+    }
+}
+
+
+void write_cache( const dat::DataRaw & raw, const fs::path & p )
+{
+    CacheWriter w{ p, raw.size() };
+    for( const auto & [ label, spectra ] : raw )
+    {
+        w.label( label, spectra.size() );
+        for( const auto & s : spectra )
+        {
+            w.spectrum( s );
+        }
+    }
+    w.close();
+}
+
+
+dat::DataRaw read_cache( const fs::path & p )
+{
+    const art::Mapped m{ p };
+    art::Reader r{ m.begin(), m.end() };
+    const auto cache = [ & ]
+    {
+        try
+        {
+            return r.get_string() == CACHE_MAGIC && r.get< std::uint32_t >() == CACHE_VERSION;
+        }
+        catch( const Exception & )
+        {
+            return false;
+        }
+    };
+    if( ! cache() )
+    {
+        throw Exception{ "'" + p.string() + "' is not a dataset cache of this version." };
+    }
+
+    dat::DataRaw ret;
+    for( auto labels{ r.get< std::uint64_t >() }; labels; --labels )
+    {
+        auto & spectra{ ret[ r.get_string() ] };
+        spectra.resize( r.get< std::uint64_t >() );
+        for( auto & s : spectra )
+        {
+            s._y = r.get< dat::Spectrum::Axis >();
+        }
+    }
+    return ret;
+}
+
+
 }  // namespace io
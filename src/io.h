@@ -28,7 +28,9 @@
 #include "dat.h"
 
 #include <filesystem>
+#include <fstream>
 #include <string>
+#include <vector>
 
 
 namespace io
@@ -45,12 +47,60 @@ constexpr const char SEPARATOR{ fs::path::preferred_separator };
 // 'labels_depth == 0' -> no classification, extract measures e.g. mean
 // 'labels_depth == 1' -> '/azurite'
 // 'labels_depth == 2' -> '/azurite/spot00' and an error for '99.csv'
+// A 'dataset_dir' of "shm:<name>" is copied from a shared dataset, see 'shm.h',
+// and a file is read as a dataset cache, see 'read_cache()', both coarsened
+// from the labels depth they hold to 'labels_depth'.
 dat::DataRaw read( const fs::path & dataset_dir
                  , unsigned labels_depth = 1
                  , const std::string & labels_prefix = ""
                  );
 
 
+// Tells datasets apart for the results store: the dataset's full path with the
+// count and total size of its .csv files, e.g. "/data/rocks, 1200 files, 1843200 bytes".
+// A shared dataset is told by its "shm:<name>", a cache by its path and size.
+std::string identity( const fs::path & dataset_dir );
+
+
+// Whether .csv files lie directly in label dirs above 'labels_depth', which
+// reads at shallower depths include and a read at this one skips.
+bool csvs_above( const fs::path & dataset_dir, unsigned labels_depth );
+
+
+// A single .csv file, as exported by the spectrometer.
+dat::Spectrum read_csv( const fs::path & );
+
+// The intensity of one of its lines, e.g. "213.00000000,14.0001\r" -> 14.0001.
+double parse( const std::string & line );
+
+// All .csv files under 'dir' and its subdirs.
+std::vector< fs::path > recursively_list_csvs( const std::string & dir );
+
+
+// A dataset as read, saved into a binary file to be read back without parsing,
+// by 'read()' given its path too. Holds every label, its spectra count and the
+// spectra, in native byte order; the labels depth is that of the labels.
+void write_cache( const dat::DataRaw &, const fs::path & );
+dat::DataRaw read_cache( const fs::path & );
+
+
+// Writes a cache label by label, for a dataset too large to hold whole.
+// Exactly 'labels' labels must follow, each with exactly its count of spectra.
+struct CacheWriter
+{
+    CacheWriter( const fs::path &, size_t labels );
+
+    void label( const label::Raw &, size_t spectra );
+    void spectrum( const dat::Spectrum & );
+    // Throws if any writing failed.
+    void close();
+
+private:
+    const fs::path _path;
+    std::ofstream _f;
+};
+
+
 }  // namespace io
 
 
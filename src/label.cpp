@@ -46,18 +46,26 @@ const Raw & Codec::decode( Num i ) const
 }
 
 
+std::vector< Raw > Codec::labels() const
+{
+    std::vector< Raw > ret( _reverse.size() );
+    for( const auto & kv : _reverse )
+    {
+        assert( kv.first < ret.size() );
+        ret[ kv.first ] = kv.second;
+    }
+    return ret;
+}
+
+
+// Heads are numbered in the order of the first full label they head.
 Codec Codec::headonly() const
 {
     Codec ret;
-    unsigned count{};
-
-    for( const auto & kv : _encoding)
+    for( const auto & l : labels() )
     {
-        const auto & label{ kv.first };
-        const auto h{ head( label ) };
-        ret._encoding[ h ] = count++;
+        ret.encode( head( l ) );
     }
-
     return ret;
 }
 
@@ -81,17 +89,47 @@ std::string head( const std::string & full_label )
 }
 
 
+Raw truncate( const Raw & full_label, unsigned depth )
+{
+    size_t pos {};
+    for( unsigned i {}; i < depth; ++i )
+    {
+        pos = full_label.find_first_of( '/', pos + 1 );
+        if( pos == Raw::npos )
+        {
+            return full_label;
+        }
+    }
+    return full_label.substr( 0, pos );
+}
+
+
+std::vector< Num > headonly_table( const Codec & full, const Codec & headonly )
+{
+    std::vector< Num > ret;
+    for( const auto & l : full.labels() )
+    {
+        ret.push_back( headonly.encode( head( l ) ) );
+    }
+    return ret;
+}
+
+
 std::vector< Num > headonly_recode( const std::vector< Num > & in
                                   , const Codec & full
                                   , const Codec & headonly )
 {
+    const auto table{ headonly_table( full, headonly ) };
     std::vector< Num > ret;
+    ret.reserve( in.size() );
     for( const auto i : in )
     {
-        const auto raw{ full.decode( i ) };
-        const auto h{ head( raw ) };
-        const auto recoded{ headonly.encode( h ) };
-        ret.push_back( recoded );
+        if( i >= table.size() )
+        {
+            throw Exception{ "Label decoding failed. "
+                             "Value " + std::to_string( i ) + " not found." };
+        }
+        ret.push_back( table[ i ] );
     }
 
     return ret;
@@ -31,6 +31,9 @@ struct Codec
     Num encode( const Raw & l ) const;
     const Raw & decode( Num i ) const;
 
+    // All labels, indexed by their encoding.
+    std::vector< Raw > labels() const;
+
     // Respect only head labels (i.e. labels_depth == 1).
     Codec headonly() const;
 
@@ -44,6 +47,12 @@ std::ostream & operator<<( std::ostream &, const Codec & );
 
 Raw head( const Raw & );
 
+// The first 'depth' parts of a label, all of them if it has fewer.
+Raw truncate( const Raw &, unsigned depth );
+
+// The head label of every full label, indexed by the full one.
+std::vector< Num > headonly_table( const Codec & full, const Codec & headonly );
+
 std::vector< Num > headonly_recode( const std::vector< Num > &
                                   , const Codec & full
                                   , const Codec & headonly );
@@ -1,8 +1,12 @@
 #include "model.h"
 
+#include "ann.h"
 #include "dim.h"
 #include "label.h"
+#include "opt.h"
 #include "print.h"
+#include "task.h"
+#include "tree.h"
 
 #ifdef CMAKE_USE_DLIB
 #include <dlib/dnn.h>
@@ -13,8 +17,17 @@
 #endif
 
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <random>
+#include <set>
+#include <sstream>
 #include <vector>
 
 
@@ -22,6 +35,48 @@ namespace model
 {
 
 
+Scored Base::score( const dat::Spectrum & s ) const
+{
+    return { predict( s ), 0 };
+}
+
+
+std::vector< Scored > Base::score_batch( const std::vector< dat::Spectrum > & spectra ) const
+{
+    std::vector< Scored > ret;
+    ret.reserve( spectra.size() );
+    for( const auto & s : spectra )
+    {
+        ret.push_back( score( s ) );
+    }
+    return ret;
+}
+
+
+void Base::partial_fit( const dat::Dataset & )
+{
+    throw Exception{ "This model cannot be updated, only trained from scratch." };
+}
+
+
+void Base::save( art::Writer & ) const
+{
+    throw Exception{ "This model cannot be saved." };
+}
+
+
+Linear Base::linear() const
+{
+    throw Exception{ "This model is not linear." };
+}
+
+
+std::string Base::stats() const
+{
+    return {};
+}
+
+
 auto count_fequencies( const auto & d )
 {
     std::unordered_map<int, double> ret;
@@ -56,9 +111,38 @@ RandomChance::RandomChance( const dat::DatasetCompressed & d )
 }
 
 
+RandomChance::RandomChance( art::Reader & r )
+    : _probs{ [ & ] ()
+        {
+            std::unordered_map< int, double > ret;
+            const auto size{ r.get< std::uint64_t >() };
+            for( std::uint64_t i {}; i < size; ++i )
+            {
+                const auto l{ r.get< int >() };
+                ret[ l ] = r.get< double >();
+            }
+            return ret;
+        } () }
+{
+}
+
+
+void RandomChance::save( art::Writer & w ) const
+{
+    const std::map< int, double > sorted{ _probs.cbegin(), _probs.cend() };
+    w.put( std::uint64_t{ sorted.size() } );
+    for( const auto & kv : sorted )
+    {
+        w.put( kv.first );
+        w.put( kv.second );
+    }
+}
+
+
 label::Num RandomChance::predict( const dat::Spectrum & ) const
 {
-    std::random_device generator;
+    // Seeding is far slower than drawing.
+    thread_local std::mt19937_64 generator{ std::random_device{}() };
     std::uniform_real_distribution<double> distribution( 0, 1 );
     const auto rand = distribution( generator );
 
@@ -95,6 +179,225 @@ std::vector< label::Num > construct_labels( const dat::Dataset & d )
 }
 
 
+// Average every 'pool' adjacent wavelengths, then center and scale to unit length.
+// The inner product of two such vectors is their Pearson correlation.
+unsigned pooled_dims( unsigned pool )
+{
+    return ( dat::Spectrum::_num_points + pool - 1 ) / pool;
+}
+
+
+std::vector< float > project( const dat::Spectrum & s, unsigned pool )
+{
+    const auto dims{ pooled_dims( pool ) };
+    std::vector< float > ret( dims );
+    for( unsigned i {}; i < dims; ++i )
+    {
+        const auto begin{ s._y.cbegin() + i * pool };
+        const auto end{ s._y.cbegin() + std::min( ( i + 1 ) * pool, dat::Spectrum::_num_points ) };
+        ret[ i ] = static_cast< float >( std::accumulate( begin, end, 0. ) / ( end - begin ) );
+    }
+
+    const auto mean{ std::accumulate( ret.cbegin(), ret.cend(), 0. ) / dims };
+    double norm {};
+    for( auto & v : ret )
+    {
+        v -= static_cast< float >( mean );
+        norm += v * v;
+    }
+    norm = std::sqrt( norm );
+    if( norm > 0 )
+    {
+        for( auto & v : ret )
+        {
+            v = static_cast< float >( v / norm );
+        }
+    }
+
+    return ret;
+}
+
+
+struct Neighbours::Impl
+{
+    Impl( const dat::Dataset & d )
+        : _pool{ std::max( opt::get( "ann.pool", 1u ), 1u ) }
+        , _k{ std::max( opt::get( "ann.k", 1u ), 1u ) }
+        , _labels{ construct_labels( d ) }
+        , _index{ load_or_build( d ) }
+    {
+    }
+
+
+    Impl( art::Reader & r )
+        : _pool{ r.get< std::uint32_t >() }
+        , _k{ r.get< std::uint32_t >() }
+        , _labels{ r.get_vector< label::Num >() }
+        , _index{ [ & ] ()
+            {
+                std::istringstream s{ r.get_string() };
+                return ann::Hnsw{ s };
+            } () }
+    {
+        // As checked of a saved index in 'load_or_build()'.
+        if( ! _pool || ! _k || _index.size() != _labels.size() || _index.dim() != pooled_dims( _pool ) )
+        {
+            throw Exception{ "Corrupt nearest neighbours model." };
+        }
+        if( ! opt::find( "ann.ef" ).empty() )
+        {
+            _index.set_ef( index_params().ef_search );
+        }
+    }
+
+
+    void save( art::Writer & w ) const
+    {
+        w.put( std::uint32_t{ _pool } );
+        w.put( std::uint32_t{ _k } );
+        w.put( _labels );
+        std::ostringstream s;
+        _index.save( s );
+        w.put( s.str() );
+    }
+
+
+    Scored score( const dat::Spectrum & s ) const
+    {
+        const auto query{ project( s, _pool ) };
+        const auto found{ _index.search( query.data(), _k ) };
+        if( found.empty() )
+        {
+            throw Exception{ "Cannot predict with an empty nearest neighbours index." };
+        }
+
+        // Majority vote, ties go to the label of the most similar neighbour.
+        std::map< label::Num, unsigned > votes;
+        for( const auto & f : found )
+        {
+            ++votes[ _labels[ f.first ] ];
+        }
+        auto ret{ _labels[ found.front().first ] };
+        for( const auto & kv : votes )
+        {
+            if( kv.second > votes[ ret ] )
+            {
+                ret = kv.first;
+            }
+        }
+        return { ret, 1.0 * votes[ ret ] / found.size() };
+    }
+
+
+private:
+    static ann::Params index_params()
+    {
+        ann::Params p;
+        p.m = opt::get( "ann.m", p.m );
+        p.ef_construction = opt::get( "ann.ef_construction", p.ef_construction );
+        p.ef_search = opt::get( "ann.ef", p.ef_search );
+        p.threads = opt::get( "ann.threads", task::concurrency() );
+        return p;
+    }
+
+
+    // A saved index replaces the graph of 'd' if built from the same dataset,
+    // told by its fingerprint, and with the same 'ann.pool'; else it is rebuilt.
+    ann::Hnsw load_or_build( const dat::Dataset & d )
+    {
+        const auto path{ opt::get< std::string >( "ann.index", "" ) };
+        const auto fingerprint{ path.empty() ? 0 : dat::fingerprint( d ) };
+        if( ! path.empty() && ! d.first.empty() && std::filesystem::exists( path ) )
+        {
+            std::ifstream f{ path, std::ios::binary };
+            std::uint64_t saved {};
+            std::uint32_t pool {};
+            f.read( reinterpret_cast< char * >( & saved ), sizeof( saved ) );
+            f.read( reinterpret_cast< char * >( & pool ), sizeof( pool ) );
+            if( ! f )
+            {
+                throw Exception{ "Truncated nearest neighbours index '" + path + "'." };
+            }
+            if( saved == fingerprint && pool == _pool )
+            {
+                print::info( "Loading the nearest neighbours index from '" + path + "'." );
+                ann::Hnsw ret{ f };
+                if( ret.size() != _labels.size() || ret.dim() != pooled_dims( _pool ) )
+                {
+                    throw Exception{ "Index '" + path + "' does not match its dataset." };
+                }
+                ret.set_ef( index_params().ef_search );
+                return ret;
+            }
+            print::info( "The nearest neighbours index '" + path + "' is of another dataset or 'ann.pool', rebuilding it." );
+        }
+
+        std::vector< float > rows;
+        dat::apply( [ & ] ( label::Num, const dat::Spectrum & s )
+            {
+                const auto p{ project( s, _pool ) };
+                rows.insert( rows.end(), p.cbegin(), p.cend() );
+            }
+                 , d );
+        ann::Hnsw ret{ pooled_dims( _pool ), std::move( rows ), index_params() };
+
+        if( ! path.empty() && ret.size() )
+        {
+            print::info( "Saving the nearest neighbours index to '" + path + "'." );
+            std::ofstream f{ path, std::ios::binary };
+            const std::uint32_t pool{ _pool };
+            f.write( reinterpret_cast< const char * >( & fingerprint ), sizeof( fingerprint ) );
+            f.write( reinterpret_cast< const char * >( & pool ), sizeof( pool ) );
+            ret.save( f );
+        }
+
+        return ret;
+    }
+
+
+private:
+    const unsigned _pool;
+    const unsigned _k;
+    std::vector< label::Num > _labels;
+    ann::Hnsw _index;
+};
+
+
+Neighbours::Neighbours( const dat::Dataset & d )
+    : _impl{ std::make_unique< Impl >( d ) }
+{
+}
+
+
+label::Num Neighbours::predict( const dat::Spectrum & s ) const
+{
+    return _impl->score( s ).label;
+}
+
+
+Scored Neighbours::score( const dat::Spectrum & s ) const
+{
+    return _impl->score( s );
+}
+
+
+Neighbours::Neighbours( art::Reader & r )
+    : _impl{ std::make_unique< Impl >( r ) }
+{
+}
+
+
+void Neighbours::save( art::Writer & w ) const
+{
+    _impl->save( w );
+}
+
+
+Neighbours::~Neighbours()
+{
+}
+
+
 #ifdef CMAKE_USE_DLIB
 Correlation::Correlation( const dat::Dataset & d )
     : _training_set{ d }
@@ -121,7 +424,61 @@ std::vector<double> compute_correlation_row( const dat::Dataset & train
 }
 
 
+// Spectra grouped by label, labels in increasing order.
+dat::Dataset read_training_set( art::Reader & r )
+{
+    dat::Dataset ret;
+    const auto num_labels{ r.get< std::uint64_t >() };
+    for( std::uint64_t i {}; i < num_labels; ++i )
+    {
+        auto & spectra{ ret.first[ r.get< label::Num >() ] };
+        spectra.resize( r.get< std::uint64_t >() );
+        for( auto & s : spectra )
+        {
+            s._y = r.get< dat::Spectrum::Axis >();
+        }
+    }
+    return ret;
+}
+
+
+Correlation::Correlation( art::Reader & r )
+    : _training_set{ read_training_set( r ) }
+    , _labels{ construct_labels( _training_set ) }
+{
+}
+
+
+void Correlation::save( art::Writer & w ) const
+{
+    std::vector< label::Num > labels;
+    for( const auto & kv : _training_set.first )
+    {
+        labels.push_back( kv.first );
+    }
+    std::sort( labels.begin(), labels.end() );
+
+    w.put( std::uint64_t{ labels.size() } );
+    for( const auto l : labels )
+    {
+        const auto & spectra{ _training_set.first.at( l ) };
+        w.put( l );
+        w.put( std::uint64_t{ spectra.size() } );
+        for( const auto & s : spectra )
+        {
+            w.put( s._y );
+        }
+    }
+}
+
+
 label::Num Correlation::predict( const dat::Spectrum & test ) const
+{
+    return score( test ).label;
+}
+
+
+Scored Correlation::score( const dat::Spectrum & test ) const
 {
     const auto row = compute_correlation_row( _training_set, test );
 
@@ -132,7 +489,7 @@ label::Num Correlation::predict( const dat::Spectrum & test ) const
     assert( static_cast<size_t>( index ) < _labels.size() );
     const auto l = _labels[ static_cast<size_t>( index ) ];
 
-    return l;
+    return { l, * m };
 }
 
 
@@ -143,7 +500,16 @@ struct SVM::Impl
     using Trainer = dlib::svm_multiclass_linear_trainer< Kernel, label::Num >;
 
 
-    Impl( const dat::Dataset & d )
+    struct Params
+    {
+        double c{ 1 };
+        double epsilon{ 1e-3 };
+        unsigned threads{ 1 };
+        unsigned long max_iterations{ 10000 };
+    };
+
+
+    Impl( const dat::Dataset & d, Tune t )
         : _svm{ [ & ] () -> Classifier
             {
                 if( d.first.empty() )
@@ -151,92 +517,1712 @@ struct SVM::Impl
                     return {};
                 }
 
+                if( t == Tune::grid )
+                {
+                    // Converted once, into the folds shared by all candidates of a search,
+                    // then together the whole training set again.
+                    auto [ fold, validation ]{ holdout( d ) };
+                    const auto p{ grid_search( fold, validation ) };
+                    std::move( validation.first.begin(), validation.first.end(), std::back_inserter( fold.first ) );
+                    fold.second.insert( fold.second.end(), validation.second.cbegin(), validation.second.cend() );
+                    return train( fold, p );
+                }
+
                 dat::DlibFlattened all;
-                std::vector< label::Num > i( d.first.size(), 0 );
                 dat::apply( [ & ] ( label::Num l, const dat::Spectrum & s )
                 {
                     addto( all, l, s );
                 }         , d );
+                return train( all, options() );
+            } () }
+    {
+    }
 
-                Trainer trainer;
-                trainer.set_num_threads( 10 );
-                trainer.set_c( 1e0 );
 
-                const Classifier svm{ trainer.train( all.first, all.second ) };
-                return svm;
+    Impl( art::Reader & r )
+        : _svm{ [ & ] ()
+            {
+                Classifier ret;
+                std::istringstream s{ r.get_string() };
+                dlib::deserialize( ret, s );
+                return ret;
             } () }
     {
     }
 
 
-    label::Num predict( const dat::Spectrum & test ) const
+    void save( art::Writer & w ) const
+    {
+        std::ostringstream s;
+        dlib::serialize( _svm, s );
+        w.put( s.str() );
+    }
+
+
+    // The label and the decision value of its one-vs-rest classifier.
+    Scored score( const dat::Spectrum & test ) const
     {
         const auto s = dat::to_dlib_sample( test );
         const auto ret = _svm.predict( s );
-        return ret.first;  // what is ret.second?
+        return { ret.first, ret.second };
+    }
+
+
+    // dlib decides by 'weights x - b'.
+    Linear linear() const
+    {
+        Linear ret;
+        ret._labels = _svm.get_labels();
+        for( long c {}; c < _svm.weights.nr(); ++c )
+        {
+            for( long j {}; j < _svm.weights.nc(); ++j )
+            {
+                ret._w.push_back( static_cast< float >( _svm.weights( c, j ) ) );
+            }
+            ret._b.push_back( static_cast< float >( - _svm.b( c ) ) );
+        }
+        return ret;
     }
 
 
 private:
-    void addto( dat::DlibFlattened & f, label::Num l, const dat::Spectrum & s )
+    static void addto( dat::DlibFlattened & f, label::Num l, const dat::Spectrum & s )
     {
         f.first.push_back( to_dlib_sample( s ) );
         f.second.push_back( l );
     }
 
 
+    static Params options()
+    {
+        Params p;
+        p.c = opt::get( "svm.c", p.c );
+        p.epsilon = opt::get( "svm.epsilon", p.epsilon );
+        p.threads = task::concurrency();
+        return p;
+    }
+
+
+    static Classifier train( const dat::DlibFlattened & f, const Params & p )
+    {
+        Trainer trainer;
+        trainer.set_num_threads( p.threads );
+        trainer.set_c( p.c );
+        trainer.set_epsilon( p.epsilon );
+        trainer.set_max_iterations( p.max_iterations );
+
+        return trainer.train( f.first, f.second );
+    }
+
+
+    // A random quarter of 'd' as the validation fold, the rest to train on.
+    static std::pair< dat::DlibFlattened, dat::DlibFlattened > holdout( const dat::Dataset & d )
+    {
+        std::vector< size_t > order( dat::count( d ) );
+        std::iota( order.begin(), order.end(), 0 );
+        std::default_random_engine engine;
+        engine.seed( 0 );
+        std::shuffle( order.begin(), order.end(), engine );
+        std::vector< bool > validation( order.size() );
+        for( size_t i {}; i < order.size() / 4; ++i )
+        {
+            validation[ order[ i ] ] = true;
+        }
+
+        std::pair< dat::DlibFlattened, dat::DlibFlattened > ret;
+        size_t i {};
+        dat::apply( [ & ] ( label::Num l, const dat::Spectrum & s )
+        {
+            addto( validation[ i++ ] ? ret.second : ret.first, l, s );
+        }         , d );
+        return ret;
+    }
+
+
+    // Successive halving: train every candidate briefly on 'fold', keep the
+    // better half by accuracy on 'validation', repeat with a 4x larger iteration
+    // budget until one is left. Candidates of a round train concurrently,
+    // sharing the '-j' threads.
+    static Params grid_search( const dat::DlibFlattened & fold, const dat::DlibFlattened & validation )
+    {
+        std::vector< Params > survivors;
+        for( const auto c : opt::get_list( "svm.grid.c", std::vector{ 1e-2, 1e-1, 1e0, 1e1, 1e2 } ) )
+        {
+            for( const auto e : opt::get_list( "svm.grid.epsilon", std::vector{ 1e-2, 1e-3 } ) )
+            {
+                survivors.push_back( { c, e } );
+            }
+        }
+        if( survivors.empty() )
+        {
+            throw Exception{ "SVM grid search needs at least one C and one epsilon." };
+        }
+
+        if( validation.first.empty() )
+        {
+            return survivors.front();
+        }
+
+        auto budget{ opt::get( "svm.grid.iterations", 16ul ) };
+        while( survivors.size() > 1 )
+        {
+            const auto parallel{ std::min< unsigned >( task::concurrency()
+                                                     , static_cast< unsigned >( survivors.size() ) ) };
+            const auto threads_each{ std::max( task::concurrency() / parallel, 1u ) };
+
+            std::vector< double > accuracy( survivors.size() );
+            task::parallel_for( survivors.size(), [ & ] ( size_t i )
+            {
+                auto p{ survivors[ i ] };
+                p.threads = threads_each;
+                p.max_iterations = budget;
+                const auto svm{ train( fold, p ) };
+
+                size_t correct {};
+                for( size_t v {}; v < validation.first.size(); ++v )
+                {
+                    correct += svm.predict( validation.first[ v ] ).first == validation.second[ v ];
+                }
+                accuracy[ i ] = 1.0 * correct / validation.first.size();
+            }
+                              , parallel );
+
+            std::vector< size_t > rank( survivors.size() );
+            std::iota( rank.begin(), rank.end(), 0 );
+            std::stable_sort( rank.begin(), rank.end(), [ & ] ( size_t a, size_t b )
+                { return accuracy[ a ] > accuracy[ b ]; } );
+
+            std::vector< Params > better;
+            for( size_t i {}; i < ( rank.size() + 1 ) / 2; ++i )
+            {
+                const auto & p{ survivors[ rank[ i ] ] };
+                print::info( "SVM grid, " + std::to_string( budget ) + " iterations: C="
+                           + std::to_string( p.c ) + " epsilon=" + std::to_string( p.epsilon )
+                           + " validation accuracy " + std::to_string( accuracy[ rank[ i ] ] ) );
+                better.push_back( p );
+            }
+            survivors = std::move( better );
+            budget *= 4;
+        }
+
+        auto best{ survivors.front() };
+        print::info( "SVM grid picked C=" + std::to_string( best.c )
+                   + " epsilon=" + std::to_string( best.epsilon )
+                   + ", retraining on the whole training set." );
+        best.threads = task::concurrency();
+        return best;
+    }
+
+
 private:
     const Classifier _svm;
 };
 
 
-SVM::SVM( const dat::Dataset & d )
-    : _impl{ std::make_unique< Impl >( d ) }
+SVM::SVM( const dat::Dataset & d, Tune t )
+    : _impl{ std::make_unique< Impl >( d, t ) }
 {
 }
 
 
 label::Num SVM::predict( const dat::Spectrum & test ) const
 {
-    return _impl->predict( test );
+    return _impl->score( test ).label;
 }
 
 
-SVM::~SVM()
+Scored SVM::score( const dat::Spectrum & test ) const
 {
+    return _impl->score( test );
 }
-#endif // CMAKE_USE_DLIB
 
 
-#ifdef CMAKE_USE_SHARK
-// ID of the commit with Andres' implementation: a8410b05.
-auto train_forest_model( const shark::ClassificationDataset & dataset
-                       , unsigned num_trees
-                       )
+SVM::SVM( art::Reader & r )
+    : _impl{ std::make_unique< Impl >( r ) }
 {
-    shark::RFClassifier< label::Num > model;
-    shark::RFTrainer< label::Num > trainer;
-
-    if( dataset.empty() )
-    {
-        return model;
-    }
+}
 
-    trainer.setNTrees( num_trees );
-    trainer.train( model, dataset );
 
-    return model;
+void SVM::save( art::Writer & w ) const
+{
+    _impl->save( w );
 }
 
 
-Forest::Forest( const dat::Dataset & d )
-    : _model{ train_forest_model( to_shark_dataset( d ), _num_trees ) }
+Linear SVM::linear() const
 {
+    return _impl->linear();
 }
 
 
-Forest::Forest( const shark::ClassificationDataset & d )
-    : _model{ train_forest_model( d, _num_trees ) }
+SVM::~SVM()
+{
+}
+
+
+struct KernelSVM::Impl
+{
+    using Features = dlib::matrix< double, 0, 1 >;
+    using Kernel = dlib::linear_kernel< Features >;
+    using Classifier = dlib::multiclass_linear_decision_function< Kernel, label::Num >;
+    using Trainer = dlib::svm_multiclass_linear_trainer< Kernel, label::Num >;
+
+    static constexpr auto N{ dat::Spectrum::_num_points };
+
+
+    Impl( const dat::Dataset & d )
+        : _chi2{ [] ()
+            {
+                const auto k{ opt::get< std::string >( "nystrom.kernel", "rbf" ) };
+                if( k != "rbf" && k != "chi2" )
+                {
+                    throw Exception{ "nystrom.kernel must be 'rbf' or 'chi2', not '" + k + "'." };
+                }
+                return k == "chi2";
+            } () }
+    {
+        std::vector< const dat::Spectrum * > spectra;
+        std::vector< label::Num > labels;
+        dat::apply( [ & ] ( label::Num l, const dat::Spectrum & s )
+        {
+            spectra.push_back( & s );
+            labels.push_back( l );
+        }         , d );
+        if( spectra.empty() )
+        {
+            return;
+        }
+
+        sample_landmarks( spectra );
+        _gamma = opt::get( "nystrom.gamma", median_gamma() );
+        whiten();
+        print::info( "Nystroem map of rank " + std::to_string( _rank ) + " from "
+                   + std::to_string( num_landmarks() ) + " landmarks, gamma "
+                   + std::to_string( _gamma ) + '.' );
+
+        std::vector< Features > features( spectra.size() );
+        task::parallel_for( spectra.size(), [ & ] ( size_t i )
+            { features[ i ] = map( spectra[ i ]->_y.data() ); } );
+
+        Trainer trainer;
+        trainer.set_num_threads( task::concurrency() );
+        trainer.set_c( opt::get( "nystrom.c", 1. ) );
+        _svm = trainer.train( features, labels );
+    }
+
+
+    Impl( art::Reader & r )
+        : _chi2{ r.get< bool >() }
+        , _gamma{ r.get< double >() }
+        , _landmarks{ r.get_vector< double >() }
+        , _norms{ r.get_vector< double >() }
+        , _map{ r.get_vector< double >() }
+        , _rank{ r.get< std::uint64_t >() }
+    {
+        if( ! _rank || _norms.empty()
+         || _landmarks.size() != _norms.size() * N
+         || _map.size() / _rank != _norms.size() || _map.size() % _rank )
+        {
+            throw Exception{ "Corrupt kernel SVM." };
+        }
+        std::istringstream s{ r.get_string() };
+        dlib::deserialize( _svm, s );
+        if( _svm.weights.nc() != static_cast< long >( _rank ) || _svm.b.size() != _svm.weights.nr() )
+        {
+            throw Exception{ "Corrupt kernel SVM." };
+        }
+    }
+
+
+    void save( art::Writer & w ) const
+    {
+        w.put( _chi2 );
+        w.put( _gamma );
+        w.put( _landmarks );
+        w.put( _norms );
+        w.put( _map );
+        w.put( std::uint64_t{ _rank } );
+        std::ostringstream s;
+        dlib::serialize( _svm, s );
+        w.put( s.str() );
+    }
+
+
+    Scored score( const dat::Spectrum & test ) const
+    {
+        const auto ret = _svm.predict( map( test._y.data() ) );
+        return { ret.first, ret.second };
+    }
+
+
+private:
+    size_t num_landmarks() const
+    {
+        return _norms.size();
+    }
+
+
+    void sample_landmarks( std::vector< const dat::Spectrum * > spectra )
+    {
+        std::default_random_engine engine;
+        engine.seed( 0 );
+        std::shuffle( spectra.begin(), spectra.end(), engine );
+        spectra.resize( std::min< size_t >( spectra.size()
+                                          , opt::get( "nystrom.landmarks", 500u ) ) );
+
+        for( const auto s : spectra )
+        {
+            _landmarks.insert( _landmarks.end(), s->_y.cbegin(), s->_y.cend() );
+            _norms.push_back( std::inner_product( s->_y.cbegin(), s->_y.cend(), s->_y.cbegin(), 0. ) );
+        }
+    }
+
+
+    const double * landmark( size_t i ) const
+    {
+        return & _landmarks[ i * N ];
+    }
+
+
+    // Squared euclidean distance, via the cached landmark norms,
+    // or the chi-squared distance, skipping the non-positive bins.
+    double distance( const double * x, double x_norm, size_t l ) const
+    {
+        const auto y{ landmark( l ) };
+        if( ! _chi2 )
+        {
+            return std::max( x_norm + _norms[ l ] - 2 * std::inner_product( x, x + N, y, 0. ), 0. );
+        }
+
+        double ret {};
+        for( unsigned i {}; i < N; ++i )
+        {
+            const auto sum{ x[ i ] + y[ i ] };
+            if( sum > 0 )
+            {
+                ret += ( x[ i ] - y[ i ] ) * ( x[ i ] - y[ i ] ) / sum;
+            }
+        }
+        return ret;
+    }
+
+
+    std::vector< double > kernel_row( const double * x ) const
+    {
+        const auto x_norm{ std::inner_product( x, x + N, x, 0. ) };
+        std::vector< double > ret( num_landmarks() );
+        for( size_t l {}; l < ret.size(); ++l )
+        {
+            ret[ l ] = std::exp( - _gamma * distance( x, x_norm, l ) );
+        }
+        return ret;
+    }
+
+
+    // Inverse of the median distance between landmarks.
+    double median_gamma() const
+    {
+        const auto n{ std::min< size_t >( num_landmarks(), 100 ) };
+        std::vector< double > distances;
+        for( size_t i {}; i < n; ++i )
+        {
+            for( auto j{ i + 1 }; j < n; ++j )
+            {
+                distances.push_back( distance( landmark( i ), _norms[ i ], j ) );
+            }
+        }
+        if( distances.empty() )
+        {
+            return 1;
+        }
+
+        const auto median{ distances.begin() + distances.size() / 2 };
+        std::nth_element( distances.begin(), median, distances.end() );
+        return * median > 0 ? 1 / * median : 1;
+    }
+
+
+    // K_mm = V diag( lambda ) V', the map is diag( lambda )^-1/2 V',
+    // dropping the numerically null directions.
+    void whiten()
+    {
+        const auto m{ static_cast< long >( num_landmarks() ) };
+        dlib::matrix< double > kmm( m, m );
+        task::parallel_for( num_landmarks(), [ & ] ( size_t i )
+        {
+            const auto row{ kernel_row( landmark( i ) ) };
+            for( long j {}; j < m; ++j )
+            {
+                kmm( static_cast< long >( i ), j ) = row[ static_cast< size_t >( j ) ];
+            }
+        } );
+
+        const dlib::eigenvalue_decomposition< dlib::matrix< double > > eig( dlib::make_symmetric( kmm ) );
+        const auto values{ eig.get_real_eigenvalues() };
+        const auto vectors{ eig.get_pseudo_v() };
+
+        double largest {};
+        for( long j {}; j < m; ++j )
+        {
+            largest = std::max( largest, values( j ) );
+        }
+
+        _map.clear();
+        _rank = 0;
+        for( long j {}; j < m; ++j )
+        {
+            if( values( j ) <= largest * 1e-8 )
+            {
+                continue;
+            }
+            const auto scale{ 1 / std::sqrt( values( j ) ) };
+            for( long i {}; i < m; ++i )
+            {
+                _map.push_back( vectors( i, j ) * scale );
+            }
+            ++_rank;
+        }
+    }
+
+
+    Features map( const double * x ) const
+    {
+        const auto k{ kernel_row( x ) };
+        Features ret( static_cast< long >( _rank ) );
+        for( size_t r {}; r < _rank; ++r )
+        {
+            ret( static_cast< long >( r ) ) = std::inner_product( k.cbegin()
+                                                                , k.cend()
+                                                                , _map.cbegin() + static_cast< long >( r * k.size() )
+                                                                , 0. );
+        }
+        return ret;
+    }
+
+
+private:
+    const bool _chi2;
+    double _gamma{ 1 };
+    // Landmarks one after another, and their cached squared norms.
+    std::vector< double > _landmarks;
+    std::vector< double > _norms;
+    // '_rank' rows, one per kept eigenvector, of 'num_landmarks()' each.
+    std::vector< double > _map;
+    size_t _rank {};
+    Classifier _svm;
+};
+
+
+KernelSVM::KernelSVM( const dat::Dataset & d )
+    : _impl{ std::make_unique< Impl >( d ) }
+{
+}
+
+
+label::Num KernelSVM::predict( const dat::Spectrum & test ) const
+{
+    return _impl->score( test ).label;
+}
+
+
+Scored KernelSVM::score( const dat::Spectrum & test ) const
+{
+    return _impl->score( test );
+}
+
+
+KernelSVM::KernelSVM( art::Reader & r )
+    : _impl{ std::make_unique< Impl >( r ) }
+{
+}
+
+
+void KernelSVM::save( art::Writer & w ) const
+{
+    _impl->save( w );
+}
+
+
+KernelSVM::~KernelSVM()
+{
+}
+#endif // CMAKE_USE_DLIB
+
+
+struct Softmax::Impl
+{
+    static constexpr size_t DIMS{ dat::Spectrum::_num_points };
+
+
+    Impl( const dat::Dataset & d )
+        : _mean( DIMS )
+        , _inv_deviation( DIMS )
+        , _step{}
+    {
+        standardise( d );
+        fit( d, opt::get( "softmax.epochs", 20u ) );
+    }
+
+
+    Impl( art::Reader & r )
+        : _labels{ r.get_vector< label::Num >() }
+        , _mean{ r.get_vector< float >() }
+        , _inv_deviation{ r.get_vector< float >() }
+        , _w{ r.get_vector< float >() }
+        , _b{ r.get_vector< float >() }
+        , _mw{ r.get_vector< float >() }
+        , _vw{ r.get_vector< float >() }
+        , _mb{ r.get_vector< float >() }
+        , _vb{ r.get_vector< float >() }
+        , _step{ r.get< std::uint64_t >() }
+    {
+        const auto k{ _labels.size() };
+        if( _mean.size() != DIMS || _inv_deviation.size() != DIMS
+         || _w.size() != k * DIMS || _mw.size() != k * DIMS || _vw.size() != k * DIMS
+         || _b.size() != k || _mb.size() != k || _vb.size() != k )
+        {
+            throw Exception{ "Corrupt softmax regression." };
+        }
+    }
+
+
+    void save( art::Writer & w ) const
+    {
+        w.put( _labels );
+        w.put( _mean );
+        w.put( _inv_deviation );
+        w.put( _w );
+        w.put( _b );
+        w.put( _mw );
+        w.put( _vw );
+        w.put( _mb );
+        w.put( _vb );
+        w.put( _step );
+    }
+
+
+    // Mini-batch Adam, 'epochs' times over 'd' only.
+    void fit( const dat::Dataset & d, unsigned epochs )
+    {
+        const auto batch{ std::max( opt::get( "softmax.batch", 64u ), 1u ) };
+        const auto rate{ opt::get( "softmax.rate", 1e-3f ) };
+        const auto l2{ opt::get( "softmax.l2", 1e-4f ) };
+
+        // Contiguous and standardised.
+        std::vector< float > x;
+        std::vector< std::uint32_t > y;
+        for( const auto & kv : d.first )
+        {
+            const auto c{ add_class( kv.first ) };
+            for( const auto & s : kv.second )
+            {
+                x.resize( x.size() + DIMS );
+                standardised( s, & x[ x.size() - DIMS ] );
+                y.push_back( c );
+            }
+        }
+        if( y.empty() )
+        {
+            return;
+        }
+
+        const auto k{ _labels.size() };
+        std::vector< std::uint32_t > order( y.size() );
+        std::iota( order.begin(), order.end(), 0 );
+        std::mt19937_64 rng{ opt::get( "softmax.seed", std::uint64_t{} ) + _step };
+
+        // Per batch: probabilities minus targets, then gradients.
+        std::vector< float > g( batch * k );
+        std::vector< float > gw( k * DIMS );
+        std::vector< float > gb( k );
+        for( unsigned e {}; e < epochs; ++e )
+        {
+            std::shuffle( order.begin(), order.end(), rng );
+            for( size_t begin {}; begin < order.size(); begin += batch )
+            {
+                const auto size{ std::min< size_t >( batch, order.size() - begin ) };
+                task::parallel_for( size
+                                  , [ & ] ( size_t i )
+                    {
+                        const auto row{ order[ begin + i ] };
+                        probabilities( & x[ size_t{ row } * DIMS ], & g[ i * k ] );
+                        g[ i * k + y[ row ] ] -= 1;
+                    }
+                                  , size * k * DIMS < ( 1u << 20 ) ? 1 : task::concurrency() );
+
+                ++_step;
+                const auto scale{ 1.f / static_cast< float >( size ) };
+                task::parallel_for( k
+                                  , [ & ] ( size_t c )
+                    {
+                        const auto gradient{ & gw[ c * DIMS ] };
+                        const auto w{ & _w[ c * DIMS ] };
+                        std::fill_n( gradient, DIMS, 0.f );
+                        gb[ c ] = 0;
+                        for( size_t i {}; i < size; ++i )
+                        {
+                            const auto gi{ g[ i * k + c ] * scale };
+                            const auto row{ & x[ size_t{ order[ begin + i ] } * DIMS ] };
+                            for( size_t j {}; j < DIMS; ++j )
+                            {
+                                gradient[ j ] += gi * row[ j ];
+                            }
+                            gb[ c ] += gi;
+                        }
+                        for( size_t j {}; j < DIMS; ++j )
+                        {
+                            gradient[ j ] += l2 * w[ j ];
+                        }
+                        adam( w, gradient, & _mw[ c * DIMS ], & _vw[ c * DIMS ], DIMS, rate );
+                        adam( & _b[ c ], & gb[ c ], & _mb[ c ], & _vb[ c ], 1, rate );
+                    }
+                                  , k * size * DIMS < ( 1u << 20 ) ? 1 : task::concurrency() );
+            }
+        }
+    }
+
+
+    // Scaling by the deviation goes into the weights, centering stays a shift.
+    Linear linear() const
+    {
+        Linear ret{ _w, _b, _labels, _mean };
+        for( size_t c {}; c < _labels.size(); ++c )
+        {
+            for( size_t j {}; j < DIMS; ++j )
+            {
+                ret._w[ c * DIMS + j ] *= _inv_deviation[ j ];
+            }
+        }
+        return ret;
+    }
+
+
+    std::vector< Scored > score( const std::vector< dat::Spectrum > & spectra, unsigned threads ) const
+    {
+        std::vector< Scored > ret( spectra.size() );
+        task::parallel_for( spectra.size()
+                          , [ & ] ( size_t i )
+            {
+                std::vector< float > x( DIMS );
+                std::vector< float > p( _labels.size() );
+                standardised( spectra[ i ], x.data() );
+                probabilities( x.data(), p.data() );
+                const auto best{ std::max_element( p.cbegin(), p.cend() ) };
+                ret[ i ] = { _labels[ static_cast< size_t >( best - p.cbegin() ) ], * best };
+            }
+                          , threads );
+        return ret;
+    }
+
+
+private:
+    // From the first training set, kept for updates.
+    void standardise( const dat::Dataset & d )
+    {
+        std::vector< double > sum( DIMS );
+        std::vector< double > squares( DIMS );
+        size_t n {};
+        dat::apply( [ & ] ( label::Num, const dat::Spectrum & s )
+            {
+                for( size_t j {}; j < DIMS; ++j )
+                {
+                    sum[ j ] += s._y[ j ];
+                    squares[ j ] += s._y[ j ] * s._y[ j ];
+                }
+                ++n;
+            }
+                  , d );
+        for( size_t j {}; n && j < DIMS; ++j )
+        {
+            const auto mean{ sum[ j ] / static_cast< double >( n ) };
+            const auto variance{ squares[ j ] / static_cast< double >( n ) - mean * mean };
+            _mean[ j ] = static_cast< float >( mean );
+            _inv_deviation[ j ] = variance > 0 ? static_cast< float >( 1 / std::sqrt( variance ) ) : 0.f;
+        }
+    }
+
+
+    void standardised( const dat::Spectrum & s, float * out ) const
+    {
+        for( size_t j {}; j < DIMS; ++j )
+        {
+            out[ j ] = ( static_cast< float >( s._y[ j ] ) - _mean[ j ] ) * _inv_deviation[ j ];
+        }
+    }
+
+
+    // The class of a label, a new one with zero weights if unseen.
+    std::uint32_t add_class( label::Num l )
+    {
+        const auto it{ std::find( _labels.cbegin(), _labels.cend(), l ) };
+        if( it != _labels.cend() )
+        {
+            return static_cast< std::uint32_t >( it - _labels.cbegin() );
+        }
+        _labels.push_back( l );
+        for( auto v : { & _w, & _mw, & _vw } )
+        {
+            v->resize( v->size() + DIMS );
+        }
+        for( auto v : { & _b, & _mb, & _vb } )
+        {
+            v->push_back( 0 );
+        }
+        return static_cast< std::uint32_t >( _labels.size() - 1 );
+    }
+
+
+    void probabilities( const float * x, float * out ) const
+    {
+        const auto k{ _labels.size() };
+        for( size_t c {}; c < k; ++c )
+        {
+            const auto w{ & _w[ c * DIMS ] };
+            float dot {};
+            for( size_t j {}; j < DIMS; ++j )
+            {
+                dot += w[ j ] * x[ j ];
+            }
+            out[ c ] = dot + _b[ c ];
+        }
+        const auto max{ * std::max_element( out, out + k ) };
+        float sum {};
+        for( size_t c {}; c < k; ++c )
+        {
+            out[ c ] = std::exp( out[ c ] - max );
+            sum += out[ c ];
+        }
+        for( size_t c {}; c < k; ++c )
+        {
+            out[ c ] /= sum;
+        }
+    }
+
+
+    void adam( float * w, const float * g, float * m, float * v, size_t n, float rate ) const
+    {
+        constexpr float beta1{ 0.9f };
+        constexpr float beta2{ 0.999f };
+        constexpr float epsilon{ 1e-8f };
+        const auto t{ static_cast< float >( _step ) };
+        const auto step{ rate * std::sqrt( 1 - std::pow( beta2, t ) ) / ( 1 - std::pow( beta1, t ) ) };
+        for( size_t j {}; j < n; ++j )
+        {
+            m[ j ] = beta1 * m[ j ] + ( 1 - beta1 ) * g[ j ];
+            v[ j ] = beta2 * v[ j ] + ( 1 - beta2 ) * g[ j ] * g[ j ];
+            w[ j ] -= step * m[ j ] / ( std::sqrt( v[ j ] ) + epsilon );
+        }
+    }
+
+
+    std::vector< label::Num > _labels;
+    std::vector< float > _mean;
+    std::vector< float > _inv_deviation;
+    // A row of 'DIMS' weights per class, and Adam's moments.
+    std::vector< float > _w;
+    std::vector< float > _b;
+    std::vector< float > _mw;
+    std::vector< float > _vw;
+    std::vector< float > _mb;
+    std::vector< float > _vb;
+    std::uint64_t _step;
+};
+
+
+Softmax::Softmax( const dat::Dataset & d )
+    : _impl{ std::make_unique< Impl >( d ) }
+{
+}
+
+
+Softmax::Softmax( art::Reader & r )
+    : _impl{ std::make_unique< Impl >( r ) }
+{
+}
+
+
+label::Num Softmax::predict( const dat::Spectrum & s ) const
+{
+    return score( s ).label;
+}
+
+
+Scored Softmax::score( const dat::Spectrum & s ) const
+{
+    return _impl->score( { s }, 1 ).front();
+}
+
+
+std::vector< Scored > Softmax::score_batch( const std::vector< dat::Spectrum > & spectra ) const
+{
+    return _impl->score( spectra, task::concurrency() );
+}
+
+
+void Softmax::partial_fit( const dat::Dataset & d )
+{
+    _impl->fit( d, opt::get( "softmax.partial_epochs", 5u ) );
+}
+
+
+void Softmax::save( art::Writer & w ) const
+{
+    _impl->save( w );
+}
+
+
+Linear Softmax::linear() const
+{
+    return _impl->linear();
+}
+
+
+Softmax::~Softmax() = default;
+
+
+auto cascade_stages()
+{
+    const auto first{ Registry::get().contains( "svm" ) ? "svm" : "centroid" };
+    const auto ret{ opt::get_list( "cascade.stages", std::vector< std::string >{ first, "rf" } ) };
+    if( ret.size() < 2 )
+    {
+        throw Exception{ "A cascade needs at least two stages, see option cascade.stages." };
+    }
+    for( const auto & name : ret )
+    {
+        check( name );
+        if( name == "cascade" )
+        {
+            throw Exception{ "A cascade cannot be a stage of itself." };
+        }
+    }
+    return ret;
+}
+
+
+// The lowest score at which the spectra scoring at least that are
+// predicted with 'target' accuracy; infinity if there is none.
+double calibrate( const std::vector< Scored > & scored
+                , const std::vector< label::Num > & truth
+                , double target )
+{
+    std::vector< std::pair< double, bool > > sorted;
+    for( size_t i {}; i < scored.size(); ++i )
+    {
+        sorted.emplace_back( scored[ i ].score, scored[ i ].label == truth[ i ] );
+    }
+    std::sort( sorted.begin(), sorted.end()
+             , [] ( const auto & a, const auto & b ) { return a.first > b.first; } );
+
+    auto ret{ std::numeric_limits< double >::infinity() };
+    size_t correct {};
+    for( size_t i {}; i < sorted.size(); ++i )
+    {
+        correct += sorted[ i ].second;
+        if( static_cast< double >( correct ) >= target * static_cast< double >( i + 1 ) )
+        {
+            ret = sorted[ i ].first;
+        }
+    }
+    return ret;
+}
+
+
+Cascade::Cascade( const dat::Dataset & d )
+    : _names{ cascade_stages() }
+    , _hits( _names.size() )
+{
+    const auto target{ opt::get( "cascade.target", 0.99 ) };
+    const auto validation{ opt::get( "cascade.validation", 0.2 ) };
+    if( validation <= 0 || validation >= 1 )
+    {
+        throw Exception{ "Option cascade.validation is a share between 0 and 1." };
+    }
+    const auto fitval{ dat::split( d, 1 - validation ) };
+
+    for( const auto & name : _names )
+    {
+        print::info( "Training cascade stage " + name + '.' );
+        _stages.push_back( create( name, fitval.first ) );
+    }
+
+    // Each stage is calibrated on the spectra the previous ones passed on.
+    std::vector< dat::Spectrum > spectra;
+    std::vector< label::Num > truth;
+    for( const auto & kv : fitval.second.first )
+    {
+        spectra.insert( spectra.end(), kv.second.cbegin(), kv.second.cend() );
+        truth.insert( truth.end(), kv.second.size(), kv.first );
+    }
+    for( size_t i {}; i + 1 < _stages.size(); ++i )
+    {
+        const auto scored{ _stages[ i ]->score_batch( spectra ) };
+        _thresholds.push_back( calibrate( scored, truth, target ) );
+
+        std::vector< dat::Spectrum > passed;
+        std::vector< label::Num > passed_truth;
+        for( size_t j {}; j < scored.size(); ++j )
+        {
+            if( scored[ j ].score < _thresholds.back() )
+            {
+                passed.push_back( std::move( spectra[ j ] ) );
+                passed_truth.push_back( truth[ j ] );
+            }
+        }
+        print::info( "Cascade stage " + _names[ i ] + " keeps scores from "
+                   + std::to_string( _thresholds.back() ) + ", "
+                   + std::to_string( scored.size() - passed.size() ) + " of "
+                   + std::to_string( scored.size() ) + " held out spectra." );
+        spectra = std::move( passed );
+        truth = std::move( passed_truth );
+    }
+}
+
+
+Cascade::Cascade( art::Reader & r )
+    : _thresholds{ r.get_vector< double >() }
+    , _hits( _thresholds.size() + 1 )
+{
+    for( size_t i {}; i < _hits.size(); ++i )
+    {
+        _names.push_back( r.get_string() );
+        _stages.push_back( load( _names.back(), r ) );
+    }
+}
+
+
+label::Num Cascade::predict( const dat::Spectrum & s ) const
+{
+    return score( s ).label;
+}
+
+
+Scored Cascade::score( const dat::Spectrum & s ) const
+{
+    for( size_t i {}; i < _thresholds.size(); ++i )
+    {
+        const auto ret{ _stages[ i ]->score( s ) };
+        if( ret.score >= _thresholds[ i ] )
+        {
+            ++_hits[ i ];
+            return ret;
+        }
+    }
+    ++_hits.back();
+    return _stages.back()->score( s );
+}
+
+
+std::vector< Scored > Cascade::score_batch( const std::vector< dat::Spectrum > & spectra ) const
+{
+    std::vector< Scored > ret( spectra.size() );
+    std::vector< size_t > pending;
+    for( size_t j {}; j < spectra.size(); ++j )
+    {
+        pending.push_back( j );
+    }
+
+    // Only the spectra passed on are copied.
+    std::vector< dat::Spectrum > passed;
+    for( size_t i {}; i < _stages.size() && ! pending.empty(); ++i )
+    {
+        const auto scored{ _stages[ i ]->score_batch( i ? passed : spectra ) };
+        const auto last{ i + 1 == _stages.size() };
+        std::vector< size_t > still;
+        std::vector< dat::Spectrum > next;
+        for( size_t j {}; j < scored.size(); ++j )
+        {
+            if( last || scored[ j ].score >= _thresholds[ i ] )
+            {
+                ret[ pending[ j ] ] = scored[ j ];
+                ++_hits[ i ];
+            }
+            else
+            {
+                still.push_back( pending[ j ] );
+                next.push_back( spectra[ pending[ j ] ] );
+            }
+        }
+        pending = std::move( still );
+        passed = std::move( next );
+    }
+    return ret;
+}
+
+
+void Cascade::save( art::Writer & w ) const
+{
+    w.put( _thresholds );
+    for( size_t i {}; i < _stages.size(); ++i )
+    {
+        w.put( _names[ i ] );
+        _stages[ i ]->save( w );
+    }
+}
+
+
+std::string Cascade::stats() const
+{
+    std::uint64_t total {};
+    std::uint64_t stages_run {};
+    for( size_t i {}; i < _hits.size(); ++i )
+    {
+        total += _hits[ i ];
+        stages_run += _hits[ i ] * ( i + 1 );
+    }
+    total = std::max< std::uint64_t >( total, 1 );
+
+    std::ostringstream s;
+    for( size_t i {}; i < _hits.size(); ++i )
+    {
+        s << "cascade_" << _names[ i ] << "_share " << 1. * _hits[ i ] / total << '\n';
+    }
+    s << "cascade_stages_per_spectrum " << 1. * stages_run / total << '\n';
+    return s.str();
+}
+
+
+quant::Linear quantise( const Linear & l )
+{
+    if( l._labels.empty() || l._labels.size() != l._b.size() )
+    {
+        throw Exception{ "Cannot quantise a linear model without labels." };
+    }
+    return { l._w, l._b, l._shift, l._w.size() / l._labels.size() };
+}
+
+
+Int8::Int8( std::unique_ptr< Base > && m )
+    : _float{ std::move( m ) }
+    , _labels{ _float->linear()._labels }
+    , _q{ quantise( _float->linear() ) }
+{
+    if( _q.dims() != dat::Spectrum::_num_points )
+    {
+        throw Exception{ "Only models linear in whole spectra can be quantised." };
+    }
+    print::info( std::string{ "Quantised the model to int8, dot products on " } + quant::isa() + '.' );
+}
+
+
+label::Num Int8::predict( const dat::Spectrum & s ) const
+{
+    return score( s ).label;
+}
+
+
+Scored Int8::score( const dat::Spectrum & s ) const
+{
+    thread_local std::vector< float > decisions;
+    decisions.resize( _labels.size() );
+    _q.decide( s._y.data(), decisions.data() );
+    const auto best{ std::max_element( decisions.cbegin(), decisions.cend() ) };
+    return { _labels[ static_cast< size_t >( best - decisions.cbegin() ) ], * best };
+}
+
+
+std::vector< Scored > Int8::score_batch( const std::vector< dat::Spectrum > & spectra ) const
+{
+    std::vector< Scored > ret( spectra.size() );
+    task::parallel_for( spectra.size()
+                      , [ & ] ( size_t i ) { ret[ i ] = score( spectra[ i ] ); } );
+    return ret;
+}
+
+
+void Int8::partial_fit( const dat::Dataset & d )
+{
+    _float->partial_fit( d );
+    const auto l{ _float->linear() };
+    _labels = l._labels;
+    _q = quantise( l );
+}
+
+
+void Int8::save( art::Writer & w ) const
+{
+    _float->save( w );
+}
+
+
+Linear Int8::linear() const
+{
+    return _float->linear();
+}
+
+
+// Sorted, to number the classes of tree models.
+std::vector< label::Num > distinct_labels( const dat::Dataset & d )
+{
+    std::vector< label::Num > ret;
+    for( const auto & kv : d.first )
+    {
+        ret.push_back( kv.first );
+    }
+    std::sort( ret.begin(), ret.end() );
+    return ret;
+}
+
+
+// Every spectrum of 'd' and the number of its label in 'labels'.
+std::pair< std::vector< const double * >, std::vector< std::uint32_t > >
+tree_rows( const dat::Dataset & d, const std::vector< label::Num > & labels )
+{
+    std::pair< std::vector< const double * >, std::vector< std::uint32_t > > ret;
+    for( size_t c {}; c < labels.size(); ++c )
+    {
+        for( const auto & s : d.first.at( labels[ c ] ) )
+        {
+            ret.first.push_back( s._y.data() );
+            ret.second.push_back( static_cast< std::uint32_t >( c ) );
+        }
+    }
+    return ret;
+}
+
+
+// The most probable label of each row, given 'labels.size()' probabilities per row.
+std::vector< Scored > most_probable( const std::vector< float > & probs
+                                   , const std::vector< label::Num > & labels )
+{
+    std::vector< Scored > ret;
+    ret.reserve( probs.size() / std::max< size_t >( labels.size(), 1 ) );
+    for( auto p{ probs.cbegin() }; p != probs.cend(); p += static_cast< std::ptrdiff_t >( labels.size() ) )
+    {
+        const auto best{ std::max_element( p, p + static_cast< std::ptrdiff_t >( labels.size() ) ) };
+        ret.push_back( { labels[ static_cast< size_t >( best - p ) ], * best } );
+    }
+    return ret;
+}
+
+
+// Independent partial sums, so the compiler vectorises it.
+double dot( const double * a, const double * b, size_t n )
+{
+    constexpr size_t LANES{ 8 };
+    std::array< double, LANES > sums {};
+    size_t i {};
+    for( ; i + LANES <= n; i += LANES )
+    {
+        for( size_t l {}; l < LANES; ++l )
+        {
+            sums[ l ] += a[ i + l ] * b[ i + l ];
+        }
+    }
+    for( ; i < n; ++i )
+    {
+        sums[ 0 ] += a[ i ] * b[ i ];
+    }
+    return std::accumulate( sums.cbegin(), sums.cend(), 0. );
+}
+
+
+// Per class the count, and per class and wavelength the mean and the sum
+// of squared deviations from it, in one pass over the spectra (Welford).
+struct ClassMoments
+{
+    static constexpr size_t DIMS{ dat::Spectrum::_num_points };
+
+    ClassMoments( const dat::Dataset & d )
+        : _labels{ distinct_labels( d ) }
+        , _count( _labels.size() )
+        , _mean( _labels.size() * DIMS )
+        , _m2( _labels.size() * DIMS )
+    {
+        if( _labels.empty() )
+        {
+            throw Exception{ "Cannot train on an empty dataset." };
+        }
+        dat::apply( [ & ] ( label::Num l, const dat::Spectrum & s )
+            {
+                const auto c{ static_cast< size_t >( std::lower_bound( _labels.cbegin(), _labels.cend(), l )
+                                                   - _labels.cbegin() ) };
+                const auto n{ ++_count[ c ] };
+                const auto mean{ & _mean[ c * DIMS ] };
+                const auto m2{ & _m2[ c * DIMS ] };
+                for( size_t j {}; j < DIMS; ++j )
+                {
+                    const auto delta{ s._y[ j ] - mean[ j ] };
+                    mean[ j ] += delta / n;
+                    m2[ j ] += delta * ( s._y[ j ] - mean[ j ] );
+                }
+            }
+                  , d );
+    }
+
+    std::vector< label::Num > _labels;
+    std::vector< double > _count;
+    std::vector< double > _mean;
+    std::vector< double > _m2;
+};
+
+
+NearestCentroid::NearestCentroid( const dat::Dataset & d )
+    : _mean( ClassMoments::DIMS )
+{
+    constexpr auto DIMS{ ClassMoments::DIMS };
+    const ClassMoments m{ d };
+    const auto k{ m._labels.size() };
+    _labels = m._labels;
+
+    // Weights of the wavelengths in the distance.
+    std::vector< double > w( DIMS, 1. );
+    const auto total{ std::accumulate( m._count.cbegin(), m._count.cend(), 0. ) };
+    if( opt::get( "centroid.variance", 0u ) && total > static_cast< double >( k ) )
+    {
+        for( size_t j {}; j < DIMS; ++j )
+        {
+            double pooled {};
+            for( size_t c {}; c < k; ++c )
+            {
+                pooled += m._m2[ c * DIMS + j ];
+            }
+            pooled /= total - static_cast< double >( k );
+            w[ j ] = pooled > 0 ? 1 / pooled : 0;
+        }
+    }
+
+    // | x - mean |^2 = x^2 - 2 mean x + mean^2, weighted.
+    _a.resize( k * DIMS );
+    _k.resize( k );
+    for( size_t c {}; c < k; ++c )
+    {
+        for( size_t j {}; j < DIMS; ++j )
+        {
+            const auto mean{ m._mean[ c * DIMS + j ] };
+            _a[ c * DIMS + j ] = -2 * w[ j ] * mean;
+            _k[ c ] += w[ j ] * mean * mean;
+            _mean[ j ] += mean * m._count[ c ] / total;
+        }
+    }
+}
+
+
+NearestCentroid::NearestCentroid( art::Reader & r )
+    : _labels{ r.get_vector< label::Num >() }
+    , _a{ r.get_vector< double >() }
+    , _k{ r.get_vector< double >() }
+    , _mean{ r.get_vector< double >() }
+{
+    if( _labels.empty() || _k.size() != _labels.size() || _a.size() != _labels.size() * ClassMoments::DIMS
+     || _mean.size() != ClassMoments::DIMS )
+    {
+        throw Exception{ "Corrupt nearest centroid model." };
+    }
+}
+
+
+label::Num NearestCentroid::predict( const dat::Spectrum & s ) const
+{
+    return score( s ).label;
+}
+
+
+Scored NearestCentroid::score( const dat::Spectrum & s ) const
+{
+    constexpr auto DIMS{ ClassMoments::DIMS };
+    auto best{ std::numeric_limits< double >::infinity() };
+    auto second{ best };
+    size_t winner {};
+    for( size_t c {}; c < _labels.size(); ++c )
+    {
+        const auto distance{ dot( & _a[ c * DIMS ], s._y.data(), DIMS ) + _k[ c ] };
+        if( distance < best )
+        {
+            second = best;
+            best = distance;
+            winner = c;
+        }
+        else if( distance < second )
+        {
+            second = distance;
+        }
+    }
+    return { _labels[ winner ], _labels.size() > 1 ? second - best : 0 };
+}
+
+
+std::vector< Scored > NearestCentroid::score_batch( const std::vector< dat::Spectrum > & spectra ) const
+{
+    std::vector< Scored > ret( spectra.size() );
+    task::parallel_for( spectra.size()
+                      , [ & ] ( size_t i ) { ret[ i ] = score( spectra[ i ] ); } );
+    return ret;
+}
+
+
+void NearestCentroid::save( art::Writer & w ) const
+{
+    w.put( _labels );
+    w.put( _a );
+    w.put( _k );
+    w.put( _mean );
+}
+
+
+// The negated distance 'a x + k' is '-a ( x - mean ) - k - a mean'.
+// Biases are large and close, so their least is subtracted before they become floats.
+Linear NearestCentroid::linear() const
+{
+    constexpr auto DIMS{ ClassMoments::DIMS };
+    Linear ret;
+    ret._labels = _labels;
+    std::vector< double > b;
+    for( size_t c {}; c < _labels.size(); ++c )
+    {
+        for( size_t j {}; j < DIMS; ++j )
+        {
+            ret._w.push_back( static_cast< float >( - _a[ c * DIMS + j ] ) );
+        }
+        b.push_back( - _k[ c ] - dot( & _a[ c * DIMS ], _mean.data(), DIMS ) );
+    }
+    const auto least{ * std::min_element( b.cbegin(), b.cend() ) };
+    for( const auto v : b )
+    {
+        ret._b.push_back( static_cast< float >( v - least ) );
+    }
+    ret._shift.assign( _mean.cbegin(), _mean.cend() );
+    return ret;
+}
+
+
+GaussianNB::GaussianNB( const dat::Dataset & d )
+{
+    constexpr auto DIMS{ ClassMoments::DIMS };
+    const ClassMoments m{ d };
+    const auto k{ m._labels.size() };
+    _labels = m._labels;
+
+    std::vector< double > variance( k * DIMS );
+    for( size_t c {}; c < k; ++c )
+    {
+        for( size_t j {}; j < DIMS; ++j )
+        {
+            variance[ c * DIMS + j ] = m._m2[ c * DIMS + j ] / std::max( m._count[ c ], 1. );
+        }
+    }
+    // Keeps constant wavelengths from dominating.
+    const auto smoothing{ opt::get( "nb.smoothing", 1e-9 )
+                        * std::max( * std::max_element( variance.cbegin(), variance.cend() ), 1e-300 ) };
+
+    // log N( x | mean, variance ) = -( x - mean )^2 / 2 variance - log( 2 pi variance ) / 2
+    const auto total{ std::accumulate( m._count.cbegin(), m._count.cend(), 0. ) };
+    _p.resize( k * DIMS );
+    _q.resize( k * DIMS );
+    _r.resize( k );
+    for( size_t c {}; c < k; ++c )
+    {
+        _r[ c ] = std::log( m._count[ c ] / total );
+        for( size_t j {}; j < DIMS; ++j )
+        {
+            const auto v{ variance[ c * DIMS + j ] + smoothing };
+            const auto mean{ m._mean[ c * DIMS + j ] };
+            _p[ c * DIMS + j ] = -0.5 / v;
+            _q[ c * DIMS + j ] = mean / v;
+            _r[ c ] -= 0.5 * ( mean * mean / v + std::log( 2 * M_PI * v ) );
+        }
+    }
+}
+
+
+GaussianNB::GaussianNB( art::Reader & r )
+    : _labels{ r.get_vector< label::Num >() }
+    , _p{ r.get_vector< double >() }
+    , _q{ r.get_vector< double >() }
+    , _r{ r.get_vector< double >() }
+{
+    const auto size{ _labels.size() * ClassMoments::DIMS };
+    if( _labels.empty() || _r.size() != _labels.size() || _p.size() != size || _q.size() != size )
+    {
+        throw Exception{ "Corrupt naive Bayes model." };
+    }
+}
+
+
+label::Num GaussianNB::predict( const dat::Spectrum & s ) const
+{
+    return score( s ).label;
+}
+
+
+Scored GaussianNB::score( const dat::Spectrum & s ) const
+{
+    constexpr auto DIMS{ ClassMoments::DIMS };
+    thread_local std::vector< double > squares;
+    thread_local std::vector< double > log_likelihoods;
+    squares.resize( DIMS );
+    for( size_t j {}; j < DIMS; ++j )
+    {
+        squares[ j ] = s._y[ j ] * s._y[ j ];
+    }
+    log_likelihoods.resize( _labels.size() );
+    for( size_t c {}; c < _labels.size(); ++c )
+    {
+        log_likelihoods[ c ] = dot( & _p[ c * DIMS ], squares.data(), DIMS )
+                             + dot( & _q[ c * DIMS ], s._y.data(), DIMS )
+                             + _r[ c ];
+    }
+
+    const auto best{ std::max_element( log_likelihoods.cbegin(), log_likelihoods.cend() ) };
+    double sum {};
+    for( const auto l : log_likelihoods )
+    {
+        sum += std::exp( l - * best );
+    }
+    return { _labels[ static_cast< size_t >( best - log_likelihoods.cbegin() ) ], 1 / sum };
+}
+
+
+std::vector< Scored > GaussianNB::score_batch( const std::vector< dat::Spectrum > & spectra ) const
+{
+    std::vector< Scored > ret( spectra.size() );
+    task::parallel_for( spectra.size()
+                      , [ & ] ( size_t i ) { ret[ i ] = score( spectra[ i ] ); } );
+    return ret;
+}
+
+
+void GaussianNB::save( art::Writer & w ) const
+{
+    w.put( _labels );
+    w.put( _p );
+    w.put( _q );
+    w.put( _r );
+}
+
+
+struct RandomForest::Impl
+{
+    Impl( const dat::Dataset & d )
+        : _labels{ distinct_labels( d ) }
+        , _forest{ grow( d ) }
+    {
+    }
+
+
+    Impl( art::Reader & r )
+        : _labels{ r.get_vector< label::Num >() }
+        , _forest{ r, dat::Spectrum::_num_points }
+    {
+        if( _forest.num_classes() != _labels.size() )
+        {
+            throw Exception{ "Random forest does not match its labels." };
+        }
+    }
+
+
+    void save( art::Writer & w ) const
+    {
+        w.put( _labels );
+        _forest.save( w );
+    }
+
+
+    std::vector< Scored > score( const std::vector< const double * > & rows, unsigned threads ) const
+    {
+        return most_probable( _forest.predict( rows, threads ), _labels );
+    }
+
+
+private:
+    tree::Forest grow( const dat::Dataset & d ) const
+    {
+        tree::ForestParams p;
+        p.trees = opt::get( "rf.trees", p.trees );
+        p.max_depth = opt::get( "rf.depth", p.max_depth );
+        p.min_leaf = opt::get( "rf.min_leaf", p.min_leaf );
+        p.features = opt::get( "rf.features", p.features );
+        p.bins = opt::get( "rf.bins", p.bins );
+        p.seed = opt::get( "rf.seed", p.seed );
+        p.threads = task::concurrency();
+        const auto rows{ tree_rows( d, _labels ) };
+        return { rows.first, dat::Spectrum::_num_points, rows.second, static_cast< unsigned >( _labels.size() ), p };
+    }
+
+
+    const std::vector< label::Num > _labels;
+    const tree::Forest _forest;
+};
+
+
+RandomForest::RandomForest( const dat::Dataset & d )
+    : _impl{ std::make_unique< Impl >( d ) }
+{
+}
+
+
+RandomForest::RandomForest( art::Reader & r )
+    : _impl{ std::make_unique< Impl >( r ) }
+{
+}
+
+
+label::Num RandomForest::predict( const dat::Spectrum & s ) const
+{
+    return score( s ).label;
+}
+
+
+Scored RandomForest::score( const dat::Spectrum & s ) const
+{
+    return _impl->score( { s._y.data() }, 1 ).front();
+}
+
+
+std::vector< Scored > RandomForest::score_batch( const std::vector< dat::Spectrum > & spectra ) const
+{
+    std::vector< const double * > rows;
+    rows.reserve( spectra.size() );
+    for( const auto & s : spectra )
+    {
+        rows.push_back( s._y.data() );
+    }
+    return _impl->score( rows, task::concurrency() );
+}
+
+
+void RandomForest::save( art::Writer & w ) const
+{
+    _impl->save( w );
+}
+
+
+RandomForest::~RandomForest() = default;
+
+
+struct Boosting::Impl
+{
+    Impl( const dat::Dataset & d )
+        : _labels{ distinct_labels( d ) }
+        , _trees{ grow( d ) }
+    {
+        print::info( "Boosting kept " + std::to_string( _trees.rounds() ) + " rounds." );
+    }
+
+
+    Impl( art::Reader & r )
+        : _labels{ r.get_vector< label::Num >() }
+        , _trees{ r, dat::Spectrum::_num_points }
+    {
+        if( _trees.num_classes() != _labels.size() )
+        {
+            throw Exception{ "Boosted trees do not match their labels." };
+        }
+    }
+
+
+    void save( art::Writer & w ) const
+    {
+        w.put( _labels );
+        _trees.save( w );
+    }
+
+
+    std::vector< Scored > score( const std::vector< const double * > & rows, unsigned threads ) const
+    {
+        return most_probable( _trees.predict( rows, threads ), _labels );
+    }
+
+
+private:
+    tree::Boosted grow( const dat::Dataset & d ) const
+    {
+        tree::BoostParams p;
+        p.rounds = opt::get( "gbdt.rounds", p.rounds );
+        p.leaves = opt::get( "gbdt.leaves", p.leaves );
+        p.learning_rate = opt::get( "gbdt.rate", p.learning_rate );
+        p.min_leaf = opt::get( "gbdt.min_leaf", p.min_leaf );
+        p.lambda = opt::get( "gbdt.lambda", p.lambda );
+        p.features = opt::get( "gbdt.features", p.features );
+        p.validation = opt::get( "gbdt.validation", p.validation );
+        p.patience = opt::get( "gbdt.patience", p.patience );
+        p.seed = opt::get( "gbdt.seed", p.seed );
+        p.threads = task::concurrency();
+        const auto rows{ tree_rows( d, _labels ) };
+        return { rows.first, dat::Spectrum::_num_points, rows.second, static_cast< unsigned >( _labels.size() ), p };
+    }
+
+
+    const std::vector< label::Num > _labels;
+    const tree::Boosted _trees;
+};
+
+
+Boosting::Boosting( const dat::Dataset & d )
+    : _impl{ std::make_unique< Impl >( d ) }
+{
+}
+
+
+Boosting::Boosting( art::Reader & r )
+    : _impl{ std::make_unique< Impl >( r ) }
+{
+}
+
+
+label::Num Boosting::predict( const dat::Spectrum & s ) const
+{
+    return score( s ).label;
+}
+
+
+Scored Boosting::score( const dat::Spectrum & s ) const
+{
+    return _impl->score( { s._y.data() }, 1 ).front();
+}
+
+
+std::vector< Scored > Boosting::score_batch( const std::vector< dat::Spectrum > & spectra ) const
+{
+    std::vector< const double * > rows;
+    rows.reserve( spectra.size() );
+    for( const auto & s : spectra )
+    {
+        rows.push_back( s._y.data() );
+    }
+    return _impl->score( rows, task::concurrency() );
+}
+
+
+void Boosting::save( art::Writer & w ) const
+{
+    _impl->save( w );
+}
+
+
+Boosting::~Boosting() = default;
+
+
+
+#ifdef CMAKE_USE_SHARK
+// ID of the commit with Andres' implementation: a8410b05.
+auto train_forest_model( const shark::ClassificationDataset & dataset
+                       , unsigned num_trees
+                       )
+{
+    shark::RFClassifier< label::Num > model;
+    shark::RFTrainer< label::Num > trainer;
+
+    if( dataset.empty() )
+    {
+        return model;
+    }
+
+    trainer.setNTrees( num_trees );
+    trainer.train( model, dataset );
+
+    return model;
+}
+
+
+Forest::Forest( const dat::Dataset & d )
+    : _model{ train_forest_model( to_shark_dataset( d ), _num_trees ) }
+{
+}
+
+
+Forest::Forest( const shark::ClassificationDataset & d )
+    : _model{ train_forest_model( d, _num_trees ) }
 {
 
 }
@@ -257,15 +2243,247 @@ label::Num Forest::predict( const shark::RealVector & v ) const
 #endif  // CMAKE_USE_SHARK
 
 
-const std::vector< std::string > ALL_MODELS{ "chance"
+auto ensemble_members()
+{
+    std::vector< std::string > fallback;
+    for( const auto name : { "svm", "cor", "rf" } )
+    {
+        if( Registry::get().contains( name ) )
+        {
+            fallback.push_back( name );
+        }
+    }
+
+    const auto ret{ opt::get_list( "ensemble.members", fallback ) };
+    if( ret.empty() )
+    {
+        throw Exception{ "An ensemble needs members, see option ensemble.members." };
+    }
+    for( const auto & name : ret )
+    {
+        check( name );
+        if( name == "ensemble" )
+        {
+            throw Exception{ "An ensemble cannot be a member of itself." };
+        }
+    }
+    return ret;
+}
+
+
+auto ensemble_weights( size_t num_members )
+{
+    const auto ret{ opt::get_list( "ensemble.weights", std::vector< double >( num_members, 1. ) ) };
+    if( ret.size() != num_members )
+    {
+        throw Exception{ "Option ensemble.weights needs one weight per member." };
+    }
+    return ret;
+}
+
+
+bool ensemble_by_score()
+{
+    const auto vote{ opt::get< std::string >( "ensemble.vote", "majority" ) };
+    if( vote != "majority" && vote != "score" )
+    {
+        throw Exception{ "Option ensemble.vote is either majority or score." };
+    }
+    return vote == "score";
+}
+
+
+Ensemble::Ensemble( const dat::Dataset & d )
+    : _names{ ensemble_members() }
+    , _weights{ ensemble_weights( _names.size() ) }
+    , _by_score{ ensemble_by_score() }
+    , _members( _names.size() )
+{
+    if( _by_score && std::set< std::string >( _names.cbegin(), _names.cend() ).size() > 1 )
+    {
+        print::warn( "Ensemble members of different models score on different scales, "
+                     "the one of the largest can decide the vote by itself, see option ensemble.vote." );
+    }
+
+    // Members only read the dataset, so they share it.
+    // The ensemble takes about as long as its slowest member.
+    task::parallel_for( _members.size()
+                      , [ & ] ( size_t i )
+                        {
+                            print::info( "Training ensemble member " + _names[ i ] + '.' );
+                            _members[ i ] = create( _names[ i ], d );
+                        }
+                      , static_cast< unsigned >( _members.size() ) );
+}
+
+
+// As trained: members, none an ensemble, each with a finite weight.
+Ensemble::Ensemble( art::Reader & r )
+    : _by_score{ r.get< bool >() }
+{
+    const auto num_members{ r.get< std::uint64_t >() };
+    if( ! num_members )
+    {
+        throw Exception{ "Corrupt ensemble." };
+    }
+    for( std::uint64_t i {}; i < num_members; ++i )
+    {
+        _names.push_back( r.get_string() );
+        _weights.push_back( r.get< double >() );
+        if( _names.back() == "ensemble" || ! std::isfinite( _weights.back() ) )
+        {
+            throw Exception{ "Corrupt ensemble." };
+        }
+        _members.push_back( load( _names.back(), r ) );
+    }
+}
+
+
+label::Num Ensemble::predict( const dat::Spectrum & s ) const
+{
+    return score( s ).label;
+}
+
+
+// A single spectrum is not worth a thread per member.
+Scored Ensemble::score( const dat::Spectrum & s ) const
+{
+    std::vector< Scored > votes;
+    for( const auto & m : _members )
+    {
+        votes.push_back( _by_score ? m->score( s ) : Scored{ m->predict( s ), 0 } );
+    }
+    return combine( votes );
+}
+
+
+std::vector< Scored > Ensemble::score_batch( const std::vector< dat::Spectrum > & spectra ) const
+{
+    std::vector< std::vector< Scored > > per_member( _members.size() );
+    task::parallel_for( _members.size()
+                      , [ & ] ( size_t i )
+                        {
+                            per_member[ i ] = _members[ i ]->score_batch( spectra );
+                        }
+                      , static_cast< unsigned >( _members.size() ) );
+
+    std::vector< Scored > ret;
+    ret.reserve( spectra.size() );
+    std::vector< Scored > votes( _members.size() );
+    for( size_t s {}; s < spectra.size(); ++s )
+    {
+        for( size_t m {}; m < _members.size(); ++m )
+        {
+            votes[ m ] = per_member[ m ][ s ];
+        }
+        ret.push_back( combine( votes ) );
+    }
+    return ret;
+}
+
+
+void Ensemble::save( art::Writer & w ) const
+{
+    w.put( _by_score );
+    w.put( std::uint64_t{ _members.size() } );
+    for( size_t i {}; i < _members.size(); ++i )
+    {
+        w.put( _names[ i ] );
+        w.put( _weights[ i ] );
+        _members[ i ]->save( w );
+    }
+}
+
+
+Scored Ensemble::combine( const std::vector< Scored > & votes ) const
+{
+    // Ordered, so ties go to the lowest label.
+    std::map< label::Num, double > totals;
+    for( size_t i {}; i < votes.size(); ++i )
+    {
+        totals[ votes[ i ].label ] += _weights[ i ] * ( _by_score ? votes[ i ].score : 1. );
+    }
+
+    Scored ret{ totals.cbegin()->first, totals.cbegin()->second };
+    for( const auto & kv : totals )
+    {
+        if( kv.second > ret.score )
+        {
+            ret = { kv.first, kv.second };
+        }
+    }
+    return ret;
+}
+
+
+void check( const std::string & name )
+{
+    if( ! Registry::get().contains( name ) )
+    {
+        throw Exception( name + " : no such model found. "
+                         "Use -s to see all available models. Or see 'model.h'"
+                       );
+    }
+}
+
+
+bool serializable( const std::string & name )
+{
+    check( name );
+    if( ! Registry::get().at( name )._traits.serializable )
+    {
+        return false;
+    }
+    const auto members{ name == "ensemble" ? ensemble_members()
+                      : name == "cascade" ? cascade_stages()
+                      : std::vector< std::string >{} };
+    return std::all_of( members.begin(), members.end()
+                      , [] ( const auto & m ) { return serializable( m ); } );
+}
+
+
+std::unique_ptr< Base > create( const std::string & name
+                              , const dat::Dataset & d )
+{
+    check( name );
+    return Registry::get().at( name )._create( d );
+}
+
+
+std::unique_ptr< Base > load( const std::string & name
+                            , art::Reader & r )
+{
+    check( name );
+    const auto & l{ Registry::get().at( name )._load };
+    if( ! l )
+    {
+        throw Exception( name + " : no such model can be loaded." );
+    }
+    return l( r );
+}
+
+
+const reg::Add< Base, RandomChance > add_chance{ "chance", { .serializable = true } };
+const reg::Add< Base, Neighbours > add_ann{ "ann", { .serializable = true } };
+const reg::Add< Base, NearestCentroid > add_centroid{ "centroid", { .batch = true, .serializable = true } };
+const reg::Add< Base, GaussianNB > add_nb{ "nb", { .batch = true, .serializable = true } };
 #ifdef CMAKE_USE_DLIB
-                                           , "cor"
-                                           , "svm"
-#endif
+const reg::Add< Base, Correlation > add_cor{ "cor", { .serializable = true } };
+const reg::Add< Base, SVM > add_svm{ "svm", { .serializable = true } };
+const reg::Add< Base, SVM > add_svm_grid{ "svm-grid"
+                                        , [] ( const dat::Dataset & d ) -> std::unique_ptr< Base >
+                                            { return std::make_unique< SVM >( d, SVM::Tune::grid ); }
+                                        , { .serializable = true } };
+const reg::Add< Base, KernelSVM > add_nystrom{ "nystrom", { .serializable = true } };
+#endif  // CMAKE_USE_DLIB
 #ifdef CMAKE_USE_SHARK
-                                           , "forest"
-#endif
-                                           };
+const reg::Add< Base, Forest > add_forest{ "forest", {} };
+#endif  // CMAKE_USE_SHARK
+const reg::Add< Base, Softmax > add_softmax{ "softmax", { .batch = true, .online = true, .serializable = true } };
+const reg::Add< Base, RandomForest > add_rf{ "rf", { .batch = true, .serializable = true } };
+const reg::Add< Base, Boosting > add_gbdt{ "gbdt", { .batch = true, .serializable = true } };
+const reg::Add< Base, Ensemble > add_ensemble{ "ensemble", { .batch = true, .serializable = true } };
+const reg::Add< Base, Cascade > add_cascade{ "cascade", { .batch = true, .serializable = true } };
 
 
 }  // namespace model
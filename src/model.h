@@ -4,19 +4,26 @@
 
 // In this file:
 //               1. models predicting the class of stone,
-//               2. factory from std::string (at the end).
+//               2. their registry, with factory from std::string (at the end).
 //
 // note: the `const dat::Dataset &` is not expected to
 // survive/still exist after ctor completion.
+//
+// Models supporting 'save()' also have a ctor from 'art::Reader &',
+// restoring the model in the state it was saved.
 
+#include "art.h"
 #include "dat.h"
 #include "except.h"
+#include "quant.h"
+#include "reg.h"
 
 #ifdef CMAKE_USE_SHARK
 #include <shark/Data/Dataset.h>
 #include <shark/Algorithms/Trainers/RFTrainer.h>
 #endif
 
+#include <atomic>
 #include <filesystem>
 #include <memory>
 #include <unordered_map>
@@ -27,9 +34,48 @@ namespace model
 {
 
 
+// A predicted label and the model's confidence in it.
+// Higher is more confident, the scale is specific to each model;
+// 0 for models without a notion of confidence.
+struct Scored
+{
+    label::Num label;
+    double score;
+};
+
+
+// A linear decision function, the label with the highest 'w ( x - shift ) + b' wins.
+struct Linear
+{
+    // 'dat::Spectrum::_num_points' weights per label.
+    std::vector< float > _w;
+    std::vector< float > _b;
+    std::vector< label::Num > _labels;
+    // Empty for none.
+    std::vector< float > _shift;
+};
+
+
 struct Base
 {
     virtual label::Num predict( const dat::Spectrum & ) const = 0;
+    virtual Scored score( const dat::Spectrum & ) const;
+
+    // Many spectra at once; models with a faster batch path override it.
+    virtual std::vector< Scored > score_batch( const std::vector< dat::Spectrum > & ) const;
+
+    // Continue training on new spectra only.
+    // Throws for models that can only be trained from scratch.
+    virtual void partial_fit( const dat::Dataset & );
+
+    // Throws for models that cannot be persisted.
+    virtual void save( art::Writer & ) const;
+
+    // Throws for models that are not linear in the spectrum.
+    virtual Linear linear() const;
+
+    // Counters of the model's own, a "name value" line each; none by default.
+    virtual std::string stats() const;
 
     virtual ~Base() = default;
 };
@@ -39,18 +85,72 @@ struct RandomChance : Base
 {
     RandomChance( const dat::Dataset & );
     RandomChance( const dat::DatasetCompressed & d );
+    RandomChance( art::Reader & );
 
     label::Num predict( const dat::Spectrum & ) const override;
+    void save( art::Writer & ) const override;
 
     const std::unordered_map<int, double> _probs;
 };
 
 
+// The class with the nearest mean spectrum. With option centroid.variance=1
+// wavelengths are weighed by the inverse of their pooled within-class variance.
+// Trains in one streaming pass; scores all classes at once as dot products
+// with a contiguous class by wavelength matrix, hence it is linear too.
+struct NearestCentroid : Base
+{
+    NearestCentroid( const dat::Dataset & );
+    NearestCentroid( art::Reader & );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // How much farther the second nearest centroid is.
+    Scored score( const dat::Spectrum & ) const override;
+    std::vector< Scored > score_batch( const std::vector< dat::Spectrum > & ) const override;
+    void save( art::Writer & ) const override;
+    Linear linear() const override;
+
+private:
+    std::vector< label::Num > _labels;
+    // The squared distance to a class, less the squared length of the
+    // weighted spectrum, is '_a x + _k'; a row of '_a' per class.
+    std::vector< double > _a;
+    std::vector< double > _k;
+    // Of all spectra, to center them for 'linear()'.
+    std::vector< double > _mean;
+};
+
+
+// Gaussian naive Bayes, a mean and variance per class and wavelength.
+// Trains in one streaming pass; the log likelihood of every class is
+// '_p x^2 + _q x + _r', dot products with contiguous class by wavelength matrices.
+// Options: nb.smoothing - share of the largest variance added to all of them.
+struct GaussianNB : Base
+{
+    GaussianNB( const dat::Dataset & );
+    GaussianNB( art::Reader & );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // The posterior probability of the label.
+    Scored score( const dat::Spectrum & ) const override;
+    std::vector< Scored > score_batch( const std::vector< dat::Spectrum > & ) const override;
+    void save( art::Writer & ) const override;
+
+private:
+    std::vector< label::Num > _labels;
+    std::vector< double > _p;
+    std::vector< double > _q;
+    std::vector< double > _r;
+};
+
+
 #ifdef CMAKE_USE_DLIB
 struct Correlation : Base
 {
     Correlation( const dat::Dataset & );
+    Correlation( art::Reader & );
     label::Num predict( const dat::Spectrum & ) const override;
+    // The highest correlation.
+    Scored score( const dat::Spectrum & ) const override;
+    void save( art::Writer & ) const override;
 
 private:
     const dat::Dataset _training_set;
@@ -58,10 +158,22 @@ private:
 };
 
 
+// Multiclass linear SVM.
+// Options: svm.c, svm.epsilon; trains on '-j' threads.
+// Tune::grid picks C and epsilon instead, by successive halving of the
+// candidates in options svm.grid.c and svm.grid.epsilon on a validation fold,
+// starting from svm.grid.iterations optimiser iterations per candidate.
 struct SVM : Base
 {
-    SVM( const dat::Dataset & );
+    enum class Tune { no, grid };
+
+    SVM( const dat::Dataset &, Tune = Tune::no );
+    SVM( art::Reader & );
     label::Num predict( const dat::Spectrum & ) const override;
+    // The decision value of the winning class.
+    Scored score( const dat::Spectrum & ) const override;
+    void save( art::Writer & ) const override;
+    Linear linear() const override;
     ~SVM() override;
 
 private:
@@ -70,6 +182,28 @@ private:
 };
 
 
+// A linear SVM over the Nystroem approximation of a kernel's feature space.
+// Features are the kernel values against landmark spectra sampled from the
+// training set, whitened by the landmarks' own kernel matrix.
+// Options: nystrom.kernel - rbf or chi2, nystrom.landmarks - their count,
+//          nystrom.gamma - kernel width, median heuristic by default,
+//          nystrom.c - SVM regularisation.
+struct KernelSVM : Base
+{
+    KernelSVM( const dat::Dataset & );
+    KernelSVM( art::Reader & );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // The decision value of the winning class.
+    Scored score( const dat::Spectrum & ) const override;
+    void save( art::Writer & ) const override;
+    ~KernelSVM() override;
+
+private:
+    struct Impl;
+    std::unique_ptr< Impl > _impl;
+};
+
+
 struct LDAandSVM : Base
 {
     LDAandSVM( const dat::Dataset & );
@@ -83,6 +217,152 @@ private:
 #endif  // CMAKE_USE_DLIB
 
 
+// Approximates 'Correlation' with the nearest neighbours in a HNSW graph
+// of centered, unit length spectra, see ann.h.
+// Options: ann.m, ann.ef_construction, ann.ef, ann.threads - see ann::Params,
+//          ann.k - number of voting neighbours,
+//          ann.pool - average that many adjacent wavelengths, reducing dimensions,
+//          ann.index - file to load the index from if built from the same dataset,
+//                      or to save it to once built.
+struct Neighbours : Base
+{
+    Neighbours( const dat::Dataset & );
+    Neighbours( art::Reader & );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // The share of voting neighbours agreeing on the label.
+    Scored score( const dat::Spectrum & ) const override;
+    void save( art::Writer & ) const override;
+    ~Neighbours() override;
+
+private:
+    struct Impl;
+    std::unique_ptr< Impl > _impl;
+};
+
+
+// Multinomial logistic regression on standardised spectra,
+// trained by mini-batch Adam over a contiguous copy of the dataset.
+// 'partial_fit()' costs time in the new spectra only; new labels add classes.
+// Options: softmax.epochs - over the training set,
+//          softmax.partial_epochs - over the spectra given to 'partial_fit()',
+//          softmax.batch, softmax.rate - Adam step size, softmax.l2, softmax.seed.
+struct Softmax : Base
+{
+    Softmax( const dat::Dataset & );
+    Softmax( art::Reader & );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // The probability of the label.
+    Scored score( const dat::Spectrum & ) const override;
+    std::vector< Scored > score_batch( const std::vector< dat::Spectrum > & ) const override;
+    void partial_fit( const dat::Dataset & ) override;
+    void save( art::Writer & ) const override;
+    // The probabilities' logits, scaling by the deviation folded into the weights.
+    Linear linear() const override;
+    ~Softmax() override;
+
+private:
+    struct Impl;
+    std::unique_ptr< Impl > _impl;
+};
+
+
+// Models of increasing cost in stages; a spectrum stops at the first stage
+// scoring it at least that stage's threshold, the last stage takes the rest.
+// Thresholds are calibrated on held out spectra as the lowest at which
+// the spectra a stage keeps are classified with the target accuracy.
+// Options: cascade.stages - model names, cheapest first; by default svm,
+//                           or centroid without dlib, then rf,
+//          cascade.target - accuracy of the kept spectra,
+//          cascade.validation - share of spectra held out for calibration.
+struct Cascade : Base
+{
+    Cascade( const dat::Dataset & );
+    Cascade( art::Reader & );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // The score of the stage deciding.
+    Scored score( const dat::Spectrum & ) const override;
+    // Each stage scores together the spectra reaching it.
+    std::vector< Scored > score_batch( const std::vector< dat::Spectrum > & ) const override;
+    void save( art::Writer & ) const override;
+    // The share of spectra each stage decided, and stages run per spectrum.
+    std::string stats() const override;
+
+private:
+    std::vector< std::string > _names;
+    std::vector< std::unique_ptr< Base > > _stages;
+    // For every stage but the last.
+    std::vector< double > _thresholds;
+    // Spectra decided per stage.
+    mutable std::vector< std::atomic< std::uint64_t > > _hits;
+};
+
+
+// Int8 inference of a linear model, see quant.h.
+// Keeps the float model, to save and update it; updates requantise.
+struct Int8 : Base
+{
+    Int8( std::unique_ptr< Base > && );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // The decision value of the winning class.
+    Scored score( const dat::Spectrum & ) const override;
+    std::vector< Scored > score_batch( const std::vector< dat::Spectrum > & ) const override;
+    void partial_fit( const dat::Dataset & ) override;
+    void save( art::Writer & ) const override;
+    Linear linear() const override;
+
+private:
+    std::unique_ptr< Base > _float;
+    std::vector< label::Num > _labels;
+    quant::Linear _q;
+};
+
+
+// Random forest over histogram-binned features, see tree.h.
+// Options: rf.trees, rf.depth - deepest leaf, rf.min_leaf - fewest spectra per leaf,
+//          rf.features - wavelengths tried per split, square root of their count by default,
+//          rf.bins - up to 256 per wavelength, rf.seed; trains and predicts on '-j' threads.
+struct RandomForest : Base
+{
+    RandomForest( const dat::Dataset & );
+    RandomForest( art::Reader & );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // The share of the trees' votes for the label.
+    Scored score( const dat::Spectrum & ) const override;
+    std::vector< Scored > score_batch( const std::vector< dat::Spectrum > & ) const override;
+    void save( art::Writer & ) const override;
+    ~RandomForest() override;
+
+private:
+    struct Impl;
+    std::unique_ptr< Impl > _impl;
+};
+
+
+// Gradient boosted trees with the softmax loss, see tree::Boosted.
+// Options: gbdt.rounds - most trees per class, gbdt.leaves - most leaves per tree,
+//          gbdt.rate - learning rate, gbdt.min_leaf - fewest spectra per leaf,
+//          gbdt.lambda - L2 regularisation of leaf values,
+//          gbdt.features - share of wavelengths per tree,
+//          gbdt.validation - share of spectra held out for early stopping, 0 disables it,
+//          gbdt.patience - rounds without improvement before stopping,
+//          gbdt.seed; trains and predicts on '-j' threads.
+struct Boosting : Base
+{
+    Boosting( const dat::Dataset & );
+    Boosting( art::Reader & );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // The probability of the label.
+    Scored score( const dat::Spectrum & ) const override;
+    std::vector< Scored > score_batch( const std::vector< dat::Spectrum > & ) const override;
+    void save( art::Writer & ) const override;
+    ~Boosting() override;
+
+private:
+    struct Impl;
+    std::unique_ptr< Impl > _impl;
+};
+
+
 #ifdef CMAKE_USE_SHARK
 struct Forest : Base
 {
@@ -99,43 +379,55 @@ struct Forest : Base
 #endif  // CMAKE_USE_SHARK
 
 
-// TODO: this is a mess!
-// - remove useless copy ctors from std::make_unique()
-// - investigate why it isn't used everywhere
-inline std::unique_ptr< Base > create( const std::string & name
-                                      , const dat::Dataset & d )
+// Votes across member models, trained concurrently on the same dataset
+// and predicting each batch concurrently, one thread per member.
+// Options: ensemble.members - model names, the available ones of svm, cor and rf by default,
+//          ensemble.weights - one per member, 1 by default,
+//          ensemble.vote - majority: sum the weights of the members predicting a label,
+//                          score: sum weight * score, for members with comparable scores.
+// Scores are not normalised: e.g. svm's are decision values, cor's correlations
+// and rf's probabilities, so among different models voting by score, the one of
+// the largest scores decides alone unless the weights scale them alike.
+struct Ensemble : Base
 {
-    const auto is = [ & name ] ( const char * p )
-        { return ( name.compare( p ) == 0 ); };
+    Ensemble( const dat::Dataset & );
+    Ensemble( art::Reader & );
+    label::Num predict( const dat::Spectrum & ) const override;
+    // The winning label's summed vote.
+    Scored score( const dat::Spectrum & ) const override;
+    std::vector< Scored > score_batch( const std::vector< dat::Spectrum > & ) const override;
+    void save( art::Writer & ) const override;
+
+private:
+    // One vote per member, in member order.
+    Scored combine( const std::vector< Scored > & ) const;
+
+    std::vector< std::string > _names;
+    std::vector< double > _weights;
+    bool _by_score;
+    std::vector< std::unique_ptr< Base > > _members;
+};
+
+
+// Models register themselves at the end of model.cpp, see reg.h.
+using Registry = reg::Registry< Base, const dat::Dataset & >;
+
+
+// Throws unless 'name' is a registered model, without constructing it.
+void check( const std::string & name );
+
+
+// Whether 'name' can be saved, with the members or stages it is configured
+// with, see options ensemble.members and cascade.stages.
+bool serializable( const std::string & name );
 
-    if( is( "chance" ) )
-    {
-        return std::make_unique< RandomChance >( RandomChance( d ) );
-    }
-#ifdef CMAKE_USE_DLIB
-    if( is( "cor" ) )
-    {
-        return std::make_unique< Correlation >( Correlation( d ) );
-    }
-    if( is( "svm" ) )
-    {
-        return std::unique_ptr< SVM >( new SVM( d ) );
-    }
-#endif  // CMAKE_USE_DLIB
-#ifdef CMAKE_USE_SHARK
-    if( is( "forest" ) )
-    {
-        return std::unique_ptr< Forest >( new Forest( d ) );
-    }
-#endif
 
-    throw Exception( name + " : no such model found. "
-                     "Use -s to see all available models. Or see 'model.h'"
-                    );
-}
+// Factory from std::string, use -s to see all available models.
+std::unique_ptr< Base > create( const std::string & name, const dat::Dataset & );
 
 
-extern const std::vector< std::string > ALL_MODELS;
+// Restore a model written by 'Base::save()'.
+std::unique_ptr< Base > load( const std::string & name, art::Reader & );
 
 
 }  // namespace model
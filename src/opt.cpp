@@ -0,0 +1,47 @@
+#include "opt.h"
+
+#include <unordered_map>
+
+
+namespace opt
+{
+
+
+std::unordered_map< std::string, std::string > & storage()
+{
+    static std::unordered_map< std::string, std::string > s;
+    return s;
+}
+
+
+void set( const std::string & key_value )
+{
+    const auto eq{ key_value.find( '=' ) };
+    if( eq == std::string::npos || eq == 0 )
+    {
+        throw Exception{ "Option '" + key_value + "' is not of the form key=value." };
+    }
+
+    storage()[ key_value.substr( 0, eq ) ] = key_value.substr( eq + 1 );
+}
+
+
+std::string find( const std::string & key )
+{
+    const auto it{ storage().find( key ) };
+    return it == storage().cend() ? std::string{} : it->second;
+}
+
+
+std::vector< std::string > all()
+{
+    std::vector< std::string > ret;
+    for( const auto & [ key, value ] : storage() )
+    {
+        ret.push_back( key + '=' + value );
+    }
+    return ret;
+}
+
+
+}  // namespace opt
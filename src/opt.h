@@ -0,0 +1,113 @@
+#ifndef OPT_H_
+#define OPT_H_
+
+
+// In this file: tunable parameters of the algorithms.
+//
+// Given on the command line as '-x key=value', read by the algorithm owning
+// the key at construction time. Keys are namespaced by the algorithm,
+// e.g. 'ann.ef=128'. Set all options before starting any work,
+// reading is not synchronised against writing.
+
+
+#include "except.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace opt
+{
+
+
+// Parse and store "key=value".
+void set( const std::string & key_value );
+
+// Empty if not given.
+std::string find( const std::string & key );
+
+// Every option given, as "key=value", e.g. to pass on to another process.
+std::vector< std::string > all();
+
+
+template< typename T >
+T get( const std::string & key, T fallback )
+{
+    const auto value{ find( key ) };
+    if( value.empty() )
+    {
+        return fallback;
+    }
+
+    std::istringstream s{ value };
+    T ret{};
+    s >> ret;
+    if( s.fail() || ! s.eof() )
+    {
+        throw Exception{ "Option '" + key + "' has invalid value '" + value + "'." };
+    }
+    return ret;
+}
+
+
+template<>
+inline std::string get( const std::string & key, std::string fallback )
+{
+    const auto value{ find( key ) };
+    return value.empty() ? fallback : value;
+}
+
+
+// "true" or "1", "false" or "0".
+template<>
+inline bool get( const std::string & key, bool fallback )
+{
+    const auto value{ find( key ) };
+    if( value.empty() )
+    {
+        return fallback;
+    }
+    if( value == "true" || value == "1" )
+    {
+        return true;
+    }
+    if( value == "false" || value == "0" )
+    {
+        return false;
+    }
+    throw Exception{ "Option '" + key + "' has invalid value '" + value + "', true or false expected." };
+}
+
+
+// A comma separated list, e.g. 'svm.grid.c=0.1,1,10'.
+template< typename T >
+std::vector< T > get_list( const std::string & key, const std::vector< T > & fallback )
+{
+    const auto value{ find( key ) };
+    if( value.empty() )
+    {
+        return fallback;
+    }
+
+    std::vector< T > ret;
+    std::istringstream s{ value };
+    for( std::string item; std::getline( s, item, ',' ); )
+    {
+        std::istringstream is{ item };
+        T v{};
+        is >> v;
+        if( is.fail() || ! is.eof() )
+        {
+            throw Exception{ "Option '" + key + "' has invalid item '" + item + "'." };
+        }
+        ret.push_back( v );
+    }
+    return ret;
+}
+
+
+}  // namespace opt
+
+
+#endif  // defined(OPT_H_)
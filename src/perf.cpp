@@ -0,0 +1,246 @@
+#include "perf.h"
+
+#include "opt.h"
+#include "print.h"
+#include "task.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+
+
+namespace perf
+{
+
+
+const char * name( Event e )
+{
+    static const char * const names[]{ "cycles", "instructions", "llc_misses", "branch_misses" };
+    return names[ e ];
+}
+
+
+Counts operator-( const Counts & a, const Counts & b )
+{
+    Counts ret {};
+    for( unsigned e {}; e < EVENTS; ++e )
+    {
+        ret[ e ] = a[ e ] - b[ e ];
+    }
+    return ret;
+}
+
+
+Counts & operator+=( Counts & a, const Counts & b )
+{
+    for( unsigned e {}; e < EVENTS; ++e )
+    {
+        a[ e ] += b[ e ];
+    }
+    return a;
+}
+
+
+int open_counter( Event e, pid_t thread )
+{
+    // The generic cache miss event is the last level's on x86 and most ARM cores.
+    static const std::uint64_t configs[]{ PERF_COUNT_HW_CPU_CYCLES
+                                        , PERF_COUNT_HW_INSTRUCTIONS
+                                        , PERF_COUNT_HW_CACHE_MISSES
+                                        , PERF_COUNT_HW_BRANCH_MISSES };
+    perf_event_attr a {};
+    a.size = sizeof( a );
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = configs[ e ];
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast< int >( ::syscall( SYS_perf_event_open, & a, thread, -1, -1, PERF_FLAG_FD_CLOEXEC ) );
+}
+
+
+Counters::Counters()
+{
+    task::parallel_for( task::concurrency(), [] ( size_t ) {} );
+
+    std::array< int, EVENTS > errors {};
+    for( const auto & entry : std::filesystem::directory_iterator{ "/proc/self/task" } )
+    {
+        const auto thread{ static_cast< pid_t >( std::stol( entry.path().filename().string() ) ) };
+        auto & fds{ _fds.emplace_back() };
+        for( unsigned e {}; e < EVENTS; ++e )
+        {
+            fds[ e ] = open_counter( static_cast< Event >( e ), thread );
+            if( fds[ e ] >= 0 )
+            {
+                _available[ e ] = true;
+            }
+            else if( ! errors[ e ] )
+            {
+                errors[ e ] = errno;
+            }
+        }
+    }
+
+    std::string missing;
+    int error {};
+    for( unsigned e {}; e < EVENTS; ++e )
+    {
+        if( ! _available[ e ] )
+        {
+            missing += ( missing.empty() ? "" : ", " ) + std::string{ name( static_cast< Event >( e ) ) };
+            error = error ? error : errors[ e ];
+        }
+    }
+    if( ! missing.empty() )
+    {
+        print::warn( "No hardware counters of " + missing + ": " + std::strerror( error ) + '.' );
+    }
+}
+
+
+Counters::~Counters()
+{
+    for( const auto & fds : _fds )
+    {
+        for( const auto fd : fds )
+        {
+            if( fd >= 0 )
+            {
+                ::close( fd );
+            }
+        }
+    }
+}
+
+
+bool Counters::any() const
+{
+    for( const auto a : _available )
+    {
+        if( a )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+Counts Counters::read() const
+{
+    Counts ret {};
+    for( const auto & fds : _fds )
+    {
+        for( unsigned e {}; e < EVENTS; ++e )
+        {
+            // Value, time enabled and time running.
+            std::uint64_t v[ 3 ];
+            if( fds[ e ] < 0 || ::read( fds[ e ], v, sizeof( v ) ) != sizeof( v ) || ! v[ 2 ] )
+            {
+                continue;
+            }
+            ret[ e ] += v[ 2 ] < v[ 1 ]
+                      ? static_cast< std::uint64_t >( static_cast< double >( v[ 0 ] ) * v[ 1 ] / v[ 2 ] )
+                      : v[ 0 ];
+        }
+    }
+    return ret;
+}
+
+
+const Counters & process()
+{
+    static const Counters c;
+    return c;
+}
+
+
+// Of the stages counting, see 'Scope'.
+std::atomic< unsigned > open_scopes {};
+std::atomic< std::uint64_t > started_scopes {};
+
+
+Scope::Scope( const char * name, size_t items )
+    : Scope{ name, {}, items }
+{
+}
+
+
+// The trace starts once the counters are read, not to time their reading.
+Scope::Scope( const char * name, const std::string & detail, size_t items )
+    : _items{ items }
+    , _start{ opt::get( "perf.stages", false ) && process().any() ? std::optional{ process().read() } : std::nullopt }
+    , _trace{ name, detail, items }
+{
+    if( _start )
+    {
+        _name = name + detail;
+        _overlapped = open_scopes++ > 0;
+        _started = ++started_scopes;
+    }
+}
+
+
+void Scope::count( size_t items )
+{
+    _items = items;
+    _trace.count( items );
+}
+
+
+Scope::~Scope()
+{
+    if( ! _start )
+    {
+        return;
+    }
+    const auto counts{ process().read() - * _start };
+    --open_scopes;
+    if( _overlapped || started_scopes != _started )
+    {
+        print::info( _name + ": overlapped other stages, not counted." );
+        return;
+    }
+    print::info( _name + ": " + describe( counts, process().available(), _items ) + '.' );
+}
+
+
+std::string describe( const Counts & c, const Available & a, size_t items )
+{
+    std::ostringstream ret;
+    ret.precision( 3 );
+    if( a[ CYCLES ] && a[ INSTRUCTIONS ] )
+    {
+        ret << "IPC " << ( c[ CYCLES ] ? static_cast< double >( c[ INSTRUCTIONS ] ) / c[ CYCLES ] : 0. );
+    }
+    else if( a[ CYCLES ] )
+    {
+        ret << c[ CYCLES ] << " cycles";
+    }
+    std::string misses;
+    for( const auto e : { LLC_MISSES, BRANCH_MISSES } )
+    {
+        if( a[ e ] )
+        {
+            std::ostringstream m;
+            m.precision( 3 );
+            m << ( items ? static_cast< double >( c[ e ] ) / items : static_cast< double >( c[ e ] ) ) << ' ' << name( e );
+            misses += ( misses.empty() ? "" : " and " ) + m.str();
+        }
+    }
+    if( ! misses.empty() )
+    {
+        ret << ( ret.tellp() ? ", " : "" ) << misses << ( items ? " per spectrum" : "" );
+    }
+    return ret.tellp() ? ret.str() : "no counters";
+}
+
+
+}  // namespace perf
@@ -0,0 +1,107 @@
+#ifndef PERF_H_
+#define PERF_H_
+
+
+// In this file: hardware performance counters, from Linux 'perf_event_open'.
+//
+// Wall time tells how long a stage takes, counters tell why: few instructions
+// per cycle with many cache misses per spectrum point at memory layout, many
+// branch misses at data dependent control flow. User space only, so they work
+// at the default 'perf_event_paranoid'. Where the kernel or the machine lacks
+// a counter, e.g. in most virtual machines, it is reported unavailable, once,
+// and left out rather than failing.
+
+
+#include "trace.h"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+namespace perf
+{
+
+
+enum Event { CYCLES, INSTRUCTIONS, LLC_MISSES, BRANCH_MISSES, EVENTS };
+
+// E.g. "llc_misses".
+const char * name( Event );
+
+struct Counts
+{
+    std::uint64_t & operator[]( unsigned e ) { return _n[ e ]; }
+    std::uint64_t operator[]( unsigned e ) const { return _n[ e ]; }
+
+    std::array< std::uint64_t, EVENTS > _n {};
+};
+
+using Available = std::array< bool, EVENTS >;
+
+Counts operator-( const Counts &, const Counts & );
+Counts & operator+=( Counts &, const Counts & );
+
+
+// Counting every thread of the process, the thread pool's included, started
+// here if need be. Counters open only for the threads that exist then: those
+// started later are never counted, e.g. the reader and preprocessor of
+// 'stage::classify' and the handlers and workers of 'srv::serve'.
+struct Counters
+{
+    Counters();
+    ~Counters();
+    Counters( const Counters & ) = delete;
+    Counters & operator=( const Counters & ) = delete;
+
+    const Available & available() const { return _available; }
+    bool any() const;
+
+    // Since opened, scaled up for the time shared with other counters.
+    Counts read() const;
+
+private:
+    // Of every thread, -1 where unavailable.
+    std::vector< std::array< int, EVENTS > > _fds;
+    Available _available {};
+};
+
+
+// A stage, named 'name' followed by 'detail' as a 'trace::Scope', which it
+// records too. Logs what the counters counted from construction to
+// destruction, per item, if option perf.stages is set. The counters are
+// opened on first use. They count the whole process, so stages overlapping
+// in time, e.g. the evaluations of the cells of a sweep, log that they did
+// rather than counts that include each other's.
+struct Scope
+{
+    explicit Scope( const char * name, size_t items = 0 );
+    Scope( const char * name, const std::string & detail, size_t items = 0 );
+    ~Scope();
+    Scope( const Scope & ) = delete;
+    Scope & operator=( const Scope & ) = delete;
+
+    // Known only once done.
+    void count( size_t items );
+
+private:
+    std::string _name;
+    size_t _items;
+    std::optional< Counts > _start;
+    // Whether another stage was counting at construction, and the stages counted
+    // since the start of the process, this one included, to tell if others started.
+    bool _overlapped {};
+    std::uint64_t _started {};
+    trace::Scope _trace;
+};
+
+
+// E.g. "IPC 1.52, 0.31 llc_misses and 2.8 branch_misses per spectrum", of what is available.
+std::string describe( const Counts &, const Available &, size_t items );
+
+
+}  // namespace perf
+
+
+#endif  // defined(PERF_H_)
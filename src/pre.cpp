@@ -1,12 +1,14 @@
 #include "pre.h"
 
 #include "label.h"
+#include "task.h"
 
 #ifdef CMAKE_USE_DLIB
 #include <dlib/statistics.h>
 #include <dlib/svm.h>
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -15,7 +17,19 @@ namespace pre
 {
 
 
-dat::Dataset logarithm( const dat::Dataset & d )
+dat::Dataset Base::operator()( const dat::Dataset & d ) const
+{
+    dat::Dataset ret{ d };
+    for( auto & kv : ret.first )
+    {
+        task::parallel_for( kv.second.size()
+                          , [ this, & kv ] ( size_t i ) { ( * this )( kv.second[ i ] ); } );
+    }
+    return ret;
+}
+
+
+double find_min( const dat::Dataset & d )
 {
     double min {};
     dat::apply( [ & ] ( label::Num, const dat::Spectrum & s )
@@ -28,64 +42,73 @@ dat::Dataset logarithm( const dat::Dataset & d )
                 }
             }
         }     , d );
+    return min;
+}
 
-    dat::Dataset ret{ {}, d.second };
-    dat::apply( [ & ] ( label::Num l, const dat::Spectrum & s )
-        {
-            dat::Spectrum transformed{};
-            unsigned i {};
-            for( const auto & intensity : s._y )
-            {
-                const auto positive = intensity - min + 1;
-                const auto point = std::log( positive );
-                transformed._y[ i++ ] = point;
-            }
-            ret.first[ l ].push_back( transformed );
-        }      , ret );
 
-    return ret;
+Log::Log( const dat::Dataset & d )
+    : _min{ find_min( d ) }
+{
+}
+
+
+Log::Log( art::Reader & r )
+    : _min{ r.get< double >() }
+{
 }
 
 
-Log::Log( const dat::Dataset & )
+// Intensities below the fitted minimum are clamped to it.
+void Log::operator()( dat::Spectrum & s ) const
 {
+    for( auto & intensity : s._y )
+    {
+        const auto positive = std::max( intensity - _min + 1, 1. );
+        intensity = std::log( positive );
+    }
 }
 
 
-dat::Dataset Log::operator()( const dat::Dataset & d ) const
+void Log::save( art::Writer & w ) const
 {
-    return logarithm( d );
+    w.put( _min );
 }
 
 
-void normalize( dat::Dataset & d )
+std::vector< double > find_mean( const dat::Dataset & d )
 {
-    dat::Spectrum mean {};
+    std::vector< double > mean( dat::Spectrum::_num_points );
     dat::apply( [ & ] ( label::Num, const dat::Spectrum & s )
     {
         auto src = s._y.cbegin();
         const auto end = s._y.cend();
-        auto dest = mean._y.begin();
+        auto dest = mean.begin();
         while( src < end )
         {
             * dest++ += * src++;
         }
     }      , d );
     const auto c = dat::count( d );
-    for( auto & point : mean._y )
+    for( auto & point : mean )
     {
         point /= c;
     }
+    return mean;
+}
 
-    dat::Spectrum variance;
+
+std::vector< double > find_deviation( const dat::Dataset & d
+                                    , const std::vector< double > & mean )
+{
+    std::vector< double > variance( dat::Spectrum::_num_points );
     dat::apply( [ & ] ( label::Num, const dat::Spectrum & s )
     {
         auto sp = s._y.cbegin();
         const auto end = s._y.cend();
-        auto dest = variance._y.begin();
+        auto dest = variance.begin();
         while( sp < end )
         {
-            const auto a = mean._y[ sp - s._y.cbegin()] ;
+            const auto a = mean[ sp - s._y.cbegin() ];
             const auto diff = * sp - a;
             * dest += diff * diff;
             assert( diff * diff >= 0 );
@@ -93,48 +116,63 @@ void normalize( dat::Dataset & d )
             ++ dest;
         }
     }      , d );
-    for( auto & point : variance._y )
+    const auto c = dat::count( d );
+    for( auto & point : variance )
     {
         point = sqrt( point / ( c - 1 ) );
         assert( point >= 0 );
     }
+    return variance;
+}
 
-    dat::mutate( [ & ] ( label::Num, dat::Spectrum & s )
-    {
-        auto src = s._y.begin();
-        const auto end = s._y.cend();
-        auto m_it = mean._y.cbegin();
-        auto v_it = variance._y.cbegin();
-        while( src < end )
-        {
-            if( * v_it < 1e-12  )
-            {
-                * src = * m_it;
-            }
-            else
-            {
-                * src = ( * src - * m_it ) / * v_it;
-            }
 
-            ++src;
-            ++m_it;
-            ++v_it;
-        }
-    }      , d );
+Norm::Norm( const dat::Dataset & d )
+    : _mean{ find_mean( d ) }
+    , _deviation{ find_deviation( d, _mean ) }
+{
 }
 
 
+Norm::Norm( art::Reader & r )
+    : _mean{ r.get_vector< double >() }
+    , _deviation{ r.get_vector< double >() }
+{
+    if( _mean.size() != dat::Spectrum::_num_points
+     || _deviation.size() != dat::Spectrum::_num_points )
+    {
+        throw Exception{ "Normalisation parameters do not match the spectrum size." };
+    }
+}
+
 
-Norm::Norm( const dat::Dataset & )
+void Norm::operator()( dat::Spectrum & s ) const
 {
+    auto src = s._y.begin();
+    const auto end = s._y.cend();
+    auto m_it = _mean.cbegin();
+    auto v_it = _deviation.cbegin();
+    while( src < end )
+    {
+        if( * v_it < 1e-12  )
+        {
+            * src = * m_it;
+        }
+        else
+        {
+            * src = ( * src - * m_it ) / * v_it;
+        }
+
+        ++src;
+        ++m_it;
+        ++v_it;
+    }
 }
 
 
-dat::Dataset Norm::operator()( const dat::Dataset & d ) const
+void Norm::save( art::Writer & w ) const
 {
-    dat::Dataset ret{ d };
-    normalize( ret );
-    return ret;
+    w.put( _mean );
+    w.put( _deviation );
 }
 
 
@@ -175,6 +213,7 @@ dat::Dataset lda( const dat::Dataset & d )
 #endif // CMAKE_USE_DLIB
 
 
+#ifdef CMAKE_USE_SHARK
 shark::LinearModel<>
 train_encoder( std::vector< shark::RealVector > & inputs
              , unsigned N
@@ -230,40 +269,62 @@ PCA::PCA( const shark::ClassificationDataset & train, unsigned dim )
 }
 
 
-dat::Dataset PCA::operator()( const dat::Dataset & d ) const
+void PCA::operator()( dat::Spectrum & s ) const
 {
-    if( d.first.empty() )
-    {
-        return {};
-    }
+    shark::RealVector enc;
+    _enc.eval( dat::to_shark_vector( s ), enc );
 
-    std::vector< shark::RealVector > inputs;
-    std::vector< label::Num > labels;
-    dat::apply( [&] ( label::Num l, const dat::Spectrum & s )
+    s._y = {};
+    std::copy( enc.begin(), enc.end(), s._y.begin() );
+}
+
+
+void PCA::save( art::Writer & ) const
+{
+    throw Exception{ "Saving shark PCA is not supported." };
+}
+#endif  // CMAKE_USE_SHARK
+
+
+void check( const std::string & name )
+{
+    if( ! Registry::get().contains( name ) )
     {
-        shark::RealVector enc;
-        const auto vec{ dat::to_shark_vector( s ) };
-        _enc.eval( vec, enc );
-        inputs.push_back( std::move( enc ) );
-        labels.push_back( l );
+        throw Exception( name + ": no such preprocessing algorithm found. "
+                         "Use -s to see all available algos."
+                       );
     }
-              , d );
+}
+
 
-    const auto sharked{ shark::createLabeledDataFromRange( inputs, labels ) };
-    return dat::from_shark_dataset( sharked, d.second );
+std::unique_ptr< Base > create( const std::string & name
+                              , const dat::Dataset & d
+                              )
+{
+    check( name );
+    return Registry::get().at( name )._create( d );
 }
 
 
-const std::vector< std::string > ALL_PRE{ "log"
-                                        , "norm"
+std::unique_ptr< Base > load( const std::string & name
+                            , art::Reader & r
+                            )
+{
+    check( name );
+    const auto & l{ Registry::get().at( name )._load };
+    if( ! l )
+    {
+        throw Exception( name + ": preprocessing algorithm cannot be loaded." );
+    }
+    return l( r );
+}
+
 
-#if defined(CMAKE_USE_OPENCV) || defined(CMAKE_USE_SHARK)
-                                         , "pca"
-#endif
-#if defined (CMAKE_USE_OPENCV) || defined (CMAKE_USE_DLIB)
-                                        , "lda"
-#endif
-                                        };
+const reg::Add< Base, Log > add_log{ "log", { .serializable = true } };
+const reg::Add< Base, Norm > add_norm{ "norm", { .serializable = true } };
+#ifdef CMAKE_USE_SHARK
+const reg::Add< Base, PCA > add_pca{ "pca", {} };
+#endif  // CMAKE_USE_SHARK
 
 
 }  // namespace pre
@@ -3,15 +3,21 @@
 
 
 // In this file: preprocessing of a dataset before feeding it to a model.
+//
+// Each algorithm is fitted on the dataset given to its ctor
+// and can then be applied to any spectrum.
 
 
+#include "art.h"
 #include "dat.h"
 #include "except.h"
+#include "reg.h"
 
 #ifdef CMAKE_USE_SHARK
 #include <shark/Algorithms/Trainers/PCA.h>
 #endif
 
+#include <memory>
 #include <vector>
 
 
@@ -21,17 +27,26 @@ namespace pre
 
 struct Base
 {
-    virtual dat::Dataset operator()( const dat::Dataset & ) const = 0;
+    virtual void operator()( dat::Spectrum & ) const = 0;
+    dat::Dataset operator()( const dat::Dataset & ) const;
+
+    // Write the fitted parameters, see 'load()'.
+    virtual void save( art::Writer & ) const = 0;
 
     virtual ~Base() = default;
 };
 
 
-// Apply log10 to each intensity.
+// Apply the natural logarithm to each intensity,
+// shifted so that the lowest one seen while fitting maps to 0.
 struct Log : Base
 {
     Log( const dat::Dataset & );
-    dat::Dataset operator()( const dat::Dataset & ) const override;
+    Log( art::Reader & );
+    void operator()( dat::Spectrum & ) const override;
+    void save( art::Writer & ) const override;
+
+    const double _min;
 };
 
 
@@ -40,7 +55,12 @@ struct Log : Base
 struct Norm : Base
 {
     Norm( const dat::Dataset & );
-    dat::Dataset operator()( const dat::Dataset & ) const override;
+    Norm( art::Reader & );
+    void operator()( dat::Spectrum & ) const override;
+    void save( art::Writer & ) const override;
+
+    const std::vector< double > _mean;
+    const std::vector< double > _deviation;
 };
 
 // 'ret[ 0 ]' is the index of most important frequency.
@@ -53,42 +73,29 @@ struct PCA : Base
 {
     PCA( const dat::Dataset & train, unsigned dim=100 );
     PCA( const shark::ClassificationDataset & train, unsigned dim=100 );
-    dat::Dataset operator()( const dat::Dataset & ) const override;
+
+    // The first 'dim' intensities become the encoding, the rest 0.
+    void operator()( dat::Spectrum & ) const override;
+    void save( art::Writer & ) const override;
 
     const shark::LinearModel<> _enc;
 };
 #endif  // CMAKE_USE_SHARK
 
 
-inline std::unique_ptr< Base > create( const std::string & name
-                                     , const dat::Dataset & d
-                                     )
-{
-    const auto is = [ & name ] ( const char * p )
-    {
-        return ( name.compare( p ) == 0 );
-    };
-
-    if( is( "log" ) )
-    {
-        return std::make_unique< Log >( d );
-    }
-    if( is( "norm" ) )
-    {
-        return std::make_unique< Norm >( d );
-    }
-    if( is( "pca" ) )
-    {
-        return std::make_unique< PCA >( d );
-    }
-
-    throw Exception( name + ": no such preprocessing algorithm found. "
-                     "See 'pre.h' for a list of all algos."
-                   );
-}
-
-
-extern const std::vector< std::string > ALL_PRE;
+// Algorithms register themselves at the end of pre.cpp, see reg.h.
+using Registry = reg::Registry< Base, const dat::Dataset & >;
+
+
+// Throws unless 'name' is a registered algorithm, without constructing it.
+void check( const std::string & name );
+
+
+std::unique_ptr< Base > create( const std::string & name, const dat::Dataset & );
+
+
+// Restore an algorithm written by 'Base::save()'.
+std::unique_ptr< Base > load( const std::string & name, art::Reader & );
 
 
 }  // namespace pre
@@ -1,9 +1,18 @@
 #include "print.h"
 
+#include "except.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
 #include <ctime>
-#include <iomanip>
+#include <exception>
 #include <iostream>
+#include <thread>
 
 
 namespace print
@@ -13,11 +22,281 @@ namespace print
 using Clock = std::chrono::system_clock;
 
 
-void info( char const * s )
+std::atomic< Level > threshold{ Level::INFO };
+// Set once the writer has stopped, at exit; messages are then written in place.
+std::atomic< bool > closed {};
+const char * const names[]{ "debug", "info", "warn", "error" };
+
+
+void set_level( Level l )
+{
+    threshold = l;
+}
+
+
+Level level( const std::string & name )
+{
+    for( const auto l : { Level::DEBUG, Level::INFO, Level::WARN, Level::ERROR } )
+    {
+        if( name == names[ static_cast< int >( l ) ] )
+        {
+            return l;
+        }
+    }
+    throw Exception{ "Unknown log level '" + name + "'." };
+}
+
+
+struct Message
+{
+    std::atomic< Message * > _next {};
+    Level _level;
+    Clock::time_point _time;
+    std::string _text;
+};
+
+
+// Intrusive, multi-producer and single-consumer, after Dmitry Vyukov's.
+// Pushing is an exchange and a store, never waits.
+struct Queue
+{
+    void push( Message * m )
+    {
+        m->_next.store( nullptr, std::memory_order_relaxed );
+        const auto prev{ _head.exchange( m, std::memory_order_acq_rel ) };
+        prev->_next.store( m, std::memory_order_release );
+    }
+
+
+    // By the consumer only, oldest first. Null if empty, or while the push
+    // of the next message is midway.
+    Message * pop()
+    {
+        auto tail{ _tail };
+        auto next{ tail->_next.load( std::memory_order_acquire ) };
+        if( tail == & _stub )
+        {
+            if( ! next )
+            {
+                return nullptr;
+            }
+            _tail = next;
+            tail = next;
+            next = next->_next.load( std::memory_order_acquire );
+        }
+        if( next )
+        {
+            _tail = next;
+            return tail;
+        }
+        if( tail != _head.load( std::memory_order_acquire ) )
+        {
+            return nullptr;
+        }
+        // The last message; the stub takes its place to keep the list non-empty.
+        push( & _stub );
+        next = tail->_next.load( std::memory_order_acquire );
+        if( next )
+        {
+            _tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    Message _stub;
+    std::atomic< Message * > _head{ & _stub };
+    Message * _tail{ & _stub };
+};
+
+
+// The "%c" prefix of lines, formatted anew once a second.
+struct Stamp
+{
+    const std::string & operator()( Clock::time_point t )
+    {
+        const auto seconds{ Clock::to_time_t( t ) };
+        if( seconds != _seconds || _text.empty() )
+        {
+            std::tm calendar;
+            localtime_r( & seconds, & calendar );
+            char buffer[ 128 ];
+            _text.assign( buffer, std::strftime( buffer, sizeof( buffer ), "%c: ", & calendar ) );
+            _seconds = seconds;
+        }
+        return _text;
+    }
+
+    std::time_t _seconds {};
+    std::string _text;
+};
+
+
+// A line in one write, not to interleave with others writing to stderr.
+void write( const Message & m, Stamp & stamp, std::string & line )
+{
+    line = stamp( m._time );
+    if( m._level != Level::INFO )
+    {
+        line += names[ static_cast< int >( m._level ) ];
+        line += ": ";
+    }
+    line += m._text;
+    line += '\n';
+    std::cerr.write( line.data(), static_cast< std::streamsize >( line.size() ) );
+}
+
+
+std::terminate_handler previous_terminate {};
+
+
+void terminate()
+{
+    flush();
+    if( previous_terminate )
+    {
+        previous_terminate();
+    }
+    std::abort();
+}
+
+
+struct Logger
+{
+    Logger()
+        : _writer{ [ this ] { run(); } }
+    {
+        previous_terminate = std::set_terminate( terminate );
+    }
+
+
+    ~Logger()
+    {
+        _stop = true;
+        _sleeping = false;
+        _sleeping.notify_one();
+        _writer.join();
+        closed = true;
+    }
+
+
+    void log( Level l, std::string && s )
+    {
+        const auto m{ new Message{ {}, l, Clock::now(), std::move( s ) } };
+        ++_pushed;
+        _queue.push( m );
+        if( _sleeping.load() && _sleeping.exchange( false ) )
+        {
+            _sleeping.notify_one();
+        }
+    }
+
+
+    void flush()
+    {
+        const auto pushed{ _pushed.load() };
+        for( auto written{ _written.load() }; written < pushed; written = _written.load() )
+        {
+            if( _sleeping.exchange( false ) )
+            {
+                _sleeping.notify_one();
+            }
+            _written.wait( written );
+        }
+    }
+
+private:
+    void run()
+    {
+        // Signals are for the other threads, e.g. waiting for them in 'sigwait'.
+        sigset_t signals;
+        sigfillset( & signals );
+        pthread_sigmask( SIG_BLOCK, & signals, nullptr );
+
+        Stamp stamp;
+        std::string line;
+        size_t written {};
+        for( ;; )
+        {
+            const auto batch{ written };
+            while( const auto m = _queue.pop() )
+            {
+                write( * m, stamp, line );
+                delete m;
+                ++written;
+            }
+            if( written != batch )
+            {
+                std::cerr.flush();
+                _written = written;
+                _written.notify_all();
+                continue;
+            }
+            if( written != _pushed )
+            {
+                // A push midway.
+                std::this_thread::yield();
+                continue;
+            }
+            if( _stop )
+            {
+                return;
+            }
+            // Producers see this, or this sees their messages.
+            _sleeping = true;
+            if( written != _pushed || _stop )
+            {
+                _sleeping = false;
+                continue;
+            }
+            _sleeping.wait( true );
+        }
+    }
+
+    Queue _queue;
+    std::atomic< size_t > _pushed {};
+    std::atomic< size_t > _written {};
+    std::atomic< bool > _sleeping {};
+    std::atomic< bool > _stop {};
+    std::thread _writer;
+};
+
+
+Logger & logger()
+{
+    static Logger l;
+    return l;
+}
+
+
+void log( Level l, std::string && s )
+{
+    if( l < threshold )
+    {
+        return;
+    }
+    if( closed )
+    {
+        thread_local Stamp stamp;
+        std::string line;
+        write( { {}, l, Clock::now(), std::move( s ) }, stamp, line );
+        return;
+    }
+    logger().log( l, std::move( s ) );
+    if( l == Level::ERROR )
+    {
+        logger().flush();
+    }
+}
+
+
+void flush()
 {
-    const auto now_seconds = Clock::to_time_t( Clock::now() );
-    const auto now_calendar = std::localtime( & now_seconds );
-    std::cout << std::put_time( now_calendar, "%c" ) << ": " << s << std::endl;
+    if( ! closed )
+    {
+        logger().flush();
+    }
 }
 
 
@@ -2,18 +2,44 @@
 #define PRINT_H_
 
 
-// In this file: logging to stdout and stderr.
+// In this file: logging to stderr.
+//
+// Asynchronous: a message is timestamped and queued by the calling thread,
+// lock free, and a background thread formats and writes whole lines in
+// batches, so logging neither blocks workers nor interleaves their output.
+// All levels go to stderr, stdout being left to results, e.g. predictions and
+// CSV rows, which are written directly and would interleave. Messages still
+// queued are written at exit, and before terminating on an uncaught exception.
 
 
 #include <string>
+#include <utility>
 
 
 namespace print
 {
 
 
-void info( char const * );
-inline void info( const std::string & s ) { info( s.c_str() ); }
+enum class Level { DEBUG, INFO, WARN, ERROR };
+
+// Messages below 'l' are dropped, INFO by default, see option log.level.
+void set_level( Level l );
+
+// Of "debug", "info", "warn" or "error".
+Level level( const std::string & name );
+
+
+void log( Level, std::string && );
+
+inline void debug( std::string s ) { log( Level::DEBUG, std::move( s ) ); }
+inline void info( std::string s ) { log( Level::INFO, std::move( s ) ); }
+inline void warn( std::string s ) { log( Level::WARN, std::move( s ) ); }
+// Written before returning.
+inline void error( std::string s ) { log( Level::ERROR, std::move( s ) ); }
+
+
+// Block until all logged so far is written.
+void flush();
 
 
 }  // namespace print
@@ -0,0 +1,187 @@
+#include "quant.h"
+
+#include "except.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+
+namespace quant
+{
+
+
+std::int32_t dot_scalar( const std::int8_t * a, const std::int8_t * b, size_t n )
+{
+    std::int32_t ret {};
+    for( size_t i {}; i < n; ++i )
+    {
+        ret += std::int32_t{ a[ i ] } * std::int32_t{ b[ i ] };
+    }
+    return ret;
+}
+
+
+#if defined(__x86_64__)
+// The instructions multiply unsigned by signed bytes, so 'a' lends its sign to 'b'.
+__attribute__(( target( "avx2" ) ))
+std::int32_t dot_avx2( const std::int8_t * a, const std::int8_t * b, size_t n )
+{
+    const auto ones{ _mm256_set1_epi16( 1 ) };
+    auto sum{ _mm256_setzero_si256() };
+    for( size_t i {}; i < n; i += 32 )
+    {
+        const auto va{ _mm256_loadu_si256( reinterpret_cast< const __m256i * >( a + i ) ) };
+        const auto vb{ _mm256_loadu_si256( reinterpret_cast< const __m256i * >( b + i ) ) };
+        // At most 2 * 127 * 127, no saturation.
+        const auto pairs{ _mm256_maddubs_epi16( _mm256_sign_epi8( va, va ), _mm256_sign_epi8( vb, va ) ) };
+        sum = _mm256_add_epi32( sum, _mm256_madd_epi16( pairs, ones ) );
+    }
+    const auto half{ _mm_add_epi32( _mm256_castsi256_si128( sum ), _mm256_extracti128_si256( sum, 1 ) ) };
+    const auto quarter{ _mm_add_epi32( half, _mm_shuffle_epi32( half, 0x4e ) ) };
+    return _mm_cvtsi128_si32( _mm_add_epi32( quarter, _mm_shuffle_epi32( quarter, 0xb1 ) ) );
+}
+
+
+__attribute__(( target( "avx2,avx512f,avx512vl,avx512vnni" ) ))
+std::int32_t dot_vnni( const std::int8_t * a, const std::int8_t * b, size_t n )
+{
+    auto sum{ _mm256_setzero_si256() };
+    for( size_t i {}; i < n; i += 32 )
+    {
+        const auto va{ _mm256_loadu_si256( reinterpret_cast< const __m256i * >( a + i ) ) };
+        const auto vb{ _mm256_loadu_si256( reinterpret_cast< const __m256i * >( b + i ) ) };
+        sum = _mm256_dpbusd_epi32( sum, _mm256_sign_epi8( va, va ), _mm256_sign_epi8( vb, va ) );
+    }
+    const auto half{ _mm_add_epi32( _mm256_castsi256_si128( sum ), _mm256_extracti128_si256( sum, 1 ) ) };
+    const auto quarter{ _mm_add_epi32( half, _mm_shuffle_epi32( half, 0x4e ) ) };
+    return _mm_cvtsi128_si32( _mm_add_epi32( quarter, _mm_shuffle_epi32( quarter, 0xb1 ) ) );
+}
+#endif  // defined(__x86_64__)
+
+
+using Dot = std::int32_t ( * )( const std::int8_t *, const std::int8_t *, size_t );
+
+
+std::pair< Dot, const char * > pick()
+{
+#if defined(__x86_64__)
+    if( __builtin_cpu_supports( "avx512vnni" ) && __builtin_cpu_supports( "avx512vl" ) )
+    {
+        return { dot_vnni, "avx512vnni" };
+    }
+    if( __builtin_cpu_supports( "avx2" ) )
+    {
+        return { dot_avx2, "avx2" };
+    }
+#endif
+    return { dot_scalar, "scalar" };
+}
+
+
+const std::pair< Dot, const char * > & picked()
+{
+    static const auto p{ pick() };
+    return p;
+}
+
+
+std::int32_t dot( const std::int8_t * a, const std::int8_t * b, size_t n )
+{
+    return picked().first( a, b, n );
+}
+
+
+const char * isa()
+{
+    return picked().second;
+}
+
+
+size_t padded( size_t n )
+{
+    return ( n + ALIGN - 1 ) / ALIGN * ALIGN;
+}
+
+
+// Symmetric, the largest magnitude maps to 127; returns the scale back.
+float quantise( const float * in, size_t n, std::int8_t * out )
+{
+    float max {};
+    for( size_t i {}; i < n; ++i )
+    {
+        max = std::max( max, std::abs( in[ i ] ) );
+    }
+    if( max == 0 )
+    {
+        std::fill_n( out, n, std::int8_t{} );
+        return 0;
+    }
+    const auto inverse{ 127 / max };
+    for( size_t i {}; i < n; ++i )
+    {
+        const auto v{ in[ i ] * inverse };
+        out[ i ] = static_cast< std::int8_t >( v + ( v < 0 ? -.5f : .5f ) );
+    }
+    return max / 127;
+}
+
+
+Linear::Linear( const std::vector< float > & w
+              , const std::vector< float > & b
+              , const std::vector< float > & shift
+              , size_t dims )
+    : _dims{ dims }
+    , _padded{ padded( dims ) }
+    , _w( b.size() * padded( dims ) )
+    , _b{ b }
+    , _shift{ shift.empty() ? std::vector< float >( dims ) : shift }
+{
+    if( ! dims || w.size() != b.size() * dims || _shift.size() != dims )
+    {
+        throw Exception{ "Linear weights do not match their biases or shift." };
+    }
+    for( size_t c {}; c < b.size(); ++c )
+    {
+        _scales.push_back( quantise( & w[ c * _dims ], _dims, & _w[ c * _padded ] ) );
+    }
+}
+
+
+void Linear::decide( const double * x, float * out ) const
+{
+    // Reused by the calls on a thread.
+    thread_local std::vector< float > centered;
+    thread_local std::vector< std::int8_t > q;
+    centered.resize( _dims );
+    for( size_t j {}; j < _dims; ++j )
+    {
+        centered[ j ] = static_cast< float >( x[ j ] ) - _shift[ j ];
+    }
+    q.assign( _padded, 0 );
+    const auto scale{ quantise( centered.data(), _dims, q.data() ) };
+
+    for( size_t c {}; c < _b.size(); ++c )
+    {
+        out[ c ] = static_cast< float >( dot( & _w[ c * _padded ], q.data(), _padded ) ) * _scales[ c ] * scale + _b[ c ];
+    }
+}
+
+
+size_t Linear::classes() const
+{
+    return _b.size();
+}
+
+
+size_t Linear::dims() const
+{
+    return _dims;
+}
+
+
+}  // namespace quant
@@ -0,0 +1,62 @@
+#ifndef QUANT_H_
+#define QUANT_H_
+
+
+// In this file: int8 inference of linear decision functions.
+//
+// Weights are quantised symmetrically with a scale per class, inputs with
+// a scale per row, so a decision value is an integer dot product times
+// both scales plus the bias. The dot product runs on AVX-512 VNNI or AVX2
+// when the CPU has them, picked at run time, else in plain C++.
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace quant
+{
+
+
+// Rows are zero padded to a multiple of this many bytes.
+constexpr size_t ALIGN{ 64 };
+
+
+// Sum of products of 'n' pairs, 'n' a multiple of ALIGN.
+// Values are within [-127, 127].
+std::int32_t dot( const std::int8_t *, const std::int8_t *, size_t n );
+
+// The instruction set 'dot()' uses: "avx512vnni", "avx2" or "scalar".
+const char * isa();
+
+
+struct Linear
+{
+    // 'w' holds 'dims' weights per class, 'b' a bias per class.
+    // 'shift', if not empty, centers inputs so they quantise with less loss.
+    Linear( const std::vector< float > & w
+          , const std::vector< float > & b
+          , const std::vector< float > & shift
+          , size_t dims );
+
+    // 'w ( x - shift ) + b' per class, into 'out'.
+    void decide( const double * x, float * out ) const;
+
+    size_t classes() const;
+    size_t dims() const;
+
+private:
+    size_t _dims;
+    size_t _padded;
+    std::vector< std::int8_t > _w;
+    std::vector< float > _scales;
+    std::vector< float > _b;
+    std::vector< float > _shift;
+};
+
+
+}  // namespace quant
+
+
+#endif  // defined(QUANT_H_)
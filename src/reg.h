@@ -0,0 +1,154 @@
+#ifndef REG_H_
+#define REG_H_
+
+
+// In this file: self-registering factories of named algorithms.
+//
+// Each algorithm registers itself, in its own .cpp, with a static 'Add':
+//     const reg::Add< model::Base, Correlation > cor{ "cor", { .serializable = true } };
+// Factories construct in place and names can be checked without constructing.
+
+
+#include "art.h"
+#include "dat.h"
+#include "except.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+namespace reg
+{
+
+
+// What the pipeline may rely on, per algorithm.
+struct Traits
+{
+    // Overrides the batch entry point with something faster than a loop.
+    bool batch{};
+    // Continues training on new spectra, see model::Base::partial_fit().
+    bool online{};
+    // Can be saved into and loaded from an artifact.
+    bool serializable{};
+};
+
+
+// E.g. "batch, serializable".
+inline std::string describe( const Traits & t )
+{
+    std::string ret;
+    const auto add = [ & ret ] ( bool has, const char * name )
+    {
+        if( has )
+        {
+            ret += ( ret.empty() ? "" : ", " ) + std::string{ name };
+        }
+    };
+    add( t.batch, "batch" );
+    add( t.online, "online" );
+    add( t.serializable, "serializable" );
+    return ret;
+}
+
+
+template< typename Base, typename Arg >
+struct Registry
+{
+    using Create = std::function< std::unique_ptr< Base >( Arg ) >;
+    using Load = std::function< std::unique_ptr< Base >( art::Reader & ) >;
+
+    struct Entry
+    {
+        Create _create;
+        Load _load;
+        Traits _traits;
+    };
+
+
+    static Registry & get()
+    {
+        static Registry r;
+        return r;
+    }
+
+
+    void add( const std::string & name, Entry && e )
+    {
+        if( ! _entries.emplace( name, std::move( e ) ).second )
+        {
+            throw Exception{ "'" + name + "' registered twice." };
+        }
+    }
+
+
+    bool contains( const std::string & name ) const
+    {
+        return _entries.count( name );
+    }
+
+
+    // Check 'contains()' first, throws on unknown names.
+    const Entry & at( const std::string & name ) const
+    {
+        const auto it{ _entries.find( name ) };
+        if( it == _entries.cend() )
+        {
+            throw Exception{ "'" + name + "' is not registered." };
+        }
+        return it->second;
+    }
+
+
+    // Sorted.
+    std::vector< std::string > names() const
+    {
+        std::vector< std::string > ret;
+        for( const auto & kv : _entries )
+        {
+            ret.push_back( kv.first );
+        }
+        return ret;
+    }
+
+private:
+    std::map< std::string, Entry > _entries;
+};
+
+
+// Register 'T' for the lifetime of the program.
+template< typename Base, typename T, typename Arg = const dat::Dataset & >
+struct Add
+{
+    using R = Registry< Base, Arg >;
+
+    // Construct 'T' from the argument, load it from its 'art::Reader &' ctor if serializable.
+    Add( const std::string & name, const Traits & t )
+        : Add( name
+             , [] ( Arg a ) -> std::unique_ptr< Base > { return std::make_unique< T >( a ); }
+             , t )
+    {
+    }
+
+    Add( const std::string & name, typename R::Create && c, const Traits & t )
+    {
+        typename R::Load l;
+        if constexpr( std::is_constructible_v< T, art::Reader & > )
+        {
+            if( t.serializable )
+            {
+                l = [] ( art::Reader & r ) -> std::unique_ptr< Base > { return std::make_unique< T >( r ); };
+            }
+        }
+        R::get().add( name, { std::move( c ), std::move( l ), t } );
+    }
+};
+
+
+}  // namespace reg
+
+
+#endif  // defined(REG_H_)
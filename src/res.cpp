@@ -0,0 +1,370 @@
+#include "res.h"
+
+#include "except.h"
+
+#ifdef CMAKE_USE_SQLITE
+#include <sqlite3.h>
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
+
+
+namespace res
+{
+
+
+namespace fs = std::filesystem;
+
+
+std::string join( const std::vector< std::string > & v )
+{
+    std::string ret;
+    for( const auto & s : v )
+    {
+        ret += ( ret.empty() ? "" : " " ) + s;
+    }
+    return ret;
+}
+
+
+std::vector< std::string > split( const std::string & s, char separator )
+{
+    std::vector< std::string > ret;
+    std::istringstream is{ s };
+    for( std::string item; std::getline( is, item, separator ); )
+    {
+        ret.push_back( item );
+    }
+    return ret;
+}
+
+
+// A line per record, tab separated, appended with a single write.
+// A line torn by a crash fails to parse and is ignored; of several lines
+// of one cell the last one counts.
+struct File : Store
+{
+    File( const fs::path & p )
+        : _path{ p }
+    {
+        // Terminate a line torn by a crash, lest the next record be appended to it.
+        std::ifstream f{ _path, std::ios::binary | std::ios::ate };
+        if( f && f.tellg() > 0 )
+        {
+            f.seekg( -1, std::ios::end );
+            if( f.get() != '\n' )
+            {
+                append( "\n" );
+            }
+        }
+    }
+
+
+    std::vector< Record > records() const override
+    {
+        std::map< std::string, Record > last;
+        std::ifstream f{ _path };
+        for( std::string line; std::getline( f, line ); )
+        {
+            if( f.eof() )
+            {
+                // Not terminated, hence torn.
+                break;
+            }
+            if( const auto r{ parse( line ) } )
+            {
+                last.insert_or_assign( r->_dataset + '\t' + sweep::describe( r->_cell ), * r );
+            }
+        }
+
+        std::vector< Record > ret;
+        for( auto & kv : last )
+        {
+            ret.push_back( std::move( kv.second ) );
+        }
+        return ret;
+    }
+
+
+    void put( const Record & r ) override
+    {
+        std::ostringstream s;
+        s << std::setprecision( 17 )
+          << r._dataset << '\t'
+          << r._cell._model << '\t'
+          << join( r._cell._preprocessing ) << '\t'
+          << r._cell._labels_depth << '\t'
+          << r._cell._seed << '\t'
+          << r._accuracy << '\t'
+          << r._preprocessing << '\t'
+          << r._training << '\t'
+          << r._predicting << '\t'
+          << r._classes << '\t';
+        for( size_t i {}; i < r._confusion.size(); ++i )
+        {
+            s << ( i ? " " : "" ) << r._confusion[ i ];
+        }
+        s << '\n';
+        append( s.str() );
+    }
+
+private:
+    // Appending is atomic across processes, syncing makes it survive a crash.
+    void append( const std::string & line )
+    {
+        std::lock_guard lock{ _lock };
+        const auto fd{ ::open( _path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644 ) };
+        if( fd < 0 )
+        {
+            throw Exception{ "Cannot open results '" + _path.string() + "': " + std::strerror( errno ) };
+        }
+        const auto written{ ::write( fd, line.data(), line.size() ) };
+        const auto synced{ ::fsync( fd ) };
+        ::close( fd );
+        if( written != static_cast< ssize_t >( line.size() ) || synced )
+        {
+            throw Exception{ "Cannot write results '" + _path.string() + "'." };
+        }
+    }
+
+
+    static std::optional< Record > parse( const std::string & line )
+    {
+        const auto fields{ split( line, '\t' ) };
+        if( fields.size() != 11 )
+        {
+            return {};
+        }
+        try
+        {
+            Record r;
+            r._dataset = fields[ 0 ];
+            r._cell._model = fields[ 1 ];
+            r._cell._preprocessing = split( fields[ 2 ], ' ' );
+            r._cell._labels_depth = static_cast< unsigned >( std::stoul( fields[ 3 ] ) );
+            r._cell._seed = static_cast< unsigned >( std::stoul( fields[ 4 ] ) );
+            r._accuracy = std::stod( fields[ 5 ] );
+            r._preprocessing = std::stod( fields[ 6 ] );
+            r._training = std::stod( fields[ 7 ] );
+            r._predicting = std::stod( fields[ 8 ] );
+            r._classes = static_cast< unsigned >( std::stoul( fields[ 9 ] ) );
+            for( const auto & c : split( fields[ 10 ], ' ' ) )
+            {
+                r._confusion.push_back( std::stoull( c ) );
+            }
+            if( r._confusion.size() != size_t{ r._classes } * r._classes )
+            {
+                return {};
+            }
+            return r;
+        }
+        catch( const std::exception & )
+        {
+            return {};
+        }
+    }
+
+    const fs::path _path;
+    std::mutex _lock;
+};
+
+
+#ifdef CMAKE_USE_SQLITE
+// A table of cells keyed by their parameters, the confusion a blob of counts.
+// Writes from several processes wait on each other for up to a minute.
+struct Sqlite : Store
+{
+    // Of the table, kept as the database's user version.
+    static constexpr std::int64_t VERSION{ 2 };
+
+
+    Sqlite( const fs::path & p )
+    {
+        if( sqlite3_open_v2( p.c_str(), & _db
+                           , SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX
+                           , nullptr ) != SQLITE_OK )
+        {
+            const std::string error{ _db ? sqlite3_errmsg( _db ) : "out of memory" };
+            sqlite3_close( _db );
+            throw Exception{ "Cannot open results '" + p.string() + "': " + error };
+        }
+        sqlite3_busy_timeout( _db, 60000 );
+        exec( "PRAGMA journal_mode=WAL" );
+        exec( "BEGIN IMMEDIATE" );
+        try
+        {
+            const auto created{ query_int( "SELECT COUNT(*) FROM sqlite_master WHERE name = 'cells'" ) == 0 };
+            if( ! created && query_int( "PRAGMA user_version" ) != VERSION )
+            {
+                throw Exception{ "Results '" + p.string() + "' are of another version, record into a new store." };
+            }
+            exec( "CREATE TABLE IF NOT EXISTS cells( dataset TEXT, model TEXT, preprocessing TEXT"
+                  ", labels_depth INTEGER, seed INTEGER, accuracy REAL, preprocessing_s REAL"
+                  ", training_s REAL, predicting_s REAL, classes INTEGER, confusion BLOB"
+                  ", PRIMARY KEY( dataset, model, preprocessing, labels_depth, seed ) )" );
+            exec( ( "PRAGMA user_version = " + std::to_string( VERSION ) ).c_str() );
+            exec( "COMMIT" );
+        }
+        catch( ... )
+        {
+            sqlite3_exec( _db, "ROLLBACK", nullptr, nullptr, nullptr );
+            sqlite3_close( _db );
+            throw;
+        }
+    }
+
+
+    ~Sqlite()
+    {
+        sqlite3_close( _db );
+    }
+
+
+    std::vector< Record > records() const override
+    {
+        Statement s{ _db, "SELECT dataset, model, preprocessing, labels_depth, seed, accuracy"
+                          ", preprocessing_s, training_s, predicting_s, classes, confusion FROM cells" };
+        std::vector< Record > ret;
+        for( int step{ sqlite3_step( s._s ) }; step != SQLITE_DONE; step = sqlite3_step( s._s ) )
+        {
+            if( step != SQLITE_ROW )
+            {
+                throw Exception{ std::string{ "Cannot read results: " } + sqlite3_errmsg( _db ) };
+            }
+            const auto text = [ & ] ( int c )
+            {
+                const auto t{ sqlite3_column_text( s._s, c ) };
+                return t ? std::string{ reinterpret_cast< const char * >( t ) } : std::string{};
+            };
+            Record r;
+            r._dataset = text( 0 );
+            r._cell._model = text( 1 );
+            r._cell._preprocessing = split( text( 2 ), ' ' );
+            r._cell._labels_depth = static_cast< unsigned >( sqlite3_column_int64( s._s, 3 ) );
+            r._cell._seed = static_cast< unsigned >( sqlite3_column_int64( s._s, 4 ) );
+            r._accuracy = sqlite3_column_double( s._s, 5 );
+            r._preprocessing = sqlite3_column_double( s._s, 6 );
+            r._training = sqlite3_column_double( s._s, 7 );
+            r._predicting = sqlite3_column_double( s._s, 8 );
+            r._classes = static_cast< unsigned >( sqlite3_column_int64( s._s, 9 ) );
+            // Blobs need not be aligned.
+            const auto blob{ sqlite3_column_blob( s._s, 10 ) };
+            r._confusion.resize( static_cast< size_t >( sqlite3_column_bytes( s._s, 10 ) ) / sizeof( std::uint64_t ) );
+            if( blob )
+            {
+                std::memcpy( r._confusion.data(), blob, r._confusion.size() * sizeof( std::uint64_t ) );
+            }
+            ret.push_back( std::move( r ) );
+        }
+        return ret;
+    }
+
+
+    void put( const Record & r ) override
+    {
+        Statement s{ _db, "INSERT OR REPLACE INTO cells VALUES( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )" };
+        const auto preprocessing{ join( r._cell._preprocessing ) };
+        sqlite3_bind_text( s._s, 1, r._dataset.c_str(), -1, SQLITE_TRANSIENT );
+        sqlite3_bind_text( s._s, 2, r._cell._model.c_str(), -1, SQLITE_TRANSIENT );
+        sqlite3_bind_text( s._s, 3, preprocessing.c_str(), -1, SQLITE_TRANSIENT );
+        sqlite3_bind_int64( s._s, 4, r._cell._labels_depth );
+        sqlite3_bind_int64( s._s, 5, r._cell._seed );
+        sqlite3_bind_double( s._s, 6, r._accuracy );
+        sqlite3_bind_double( s._s, 7, r._preprocessing );
+        sqlite3_bind_double( s._s, 8, r._training );
+        sqlite3_bind_double( s._s, 9, r._predicting );
+        sqlite3_bind_int64( s._s, 10, r._classes );
+        sqlite3_bind_blob( s._s, 11, r._confusion.data()
+                         , static_cast< int >( r._confusion.size() * sizeof( std::uint64_t ) ), SQLITE_TRANSIENT );
+        if( sqlite3_step( s._s ) != SQLITE_DONE )
+        {
+            throw Exception{ std::string{ "Cannot write results: " } + sqlite3_errmsg( _db ) };
+        }
+    }
+
+private:
+    struct Statement
+    {
+        Statement( sqlite3 * db, const char * sql )
+        {
+            if( sqlite3_prepare_v2( db, sql, -1, & _s, nullptr ) != SQLITE_OK )
+            {
+                throw Exception{ std::string{ "Bad results query: " } + sqlite3_errmsg( db ) };
+            }
+        }
+
+        ~Statement()
+        {
+            sqlite3_finalize( _s );
+        }
+
+        sqlite3_stmt * _s {};
+    };
+
+
+    std::int64_t query_int( const char * sql )
+    {
+        Statement s{ _db, sql };
+        if( sqlite3_step( s._s ) != SQLITE_ROW )
+        {
+            throw Exception{ std::string{ "Results query failed: " } + sqlite3_errmsg( _db ) };
+        }
+        return sqlite3_column_int64( s._s, 0 );
+    }
+
+
+    void exec( const char * sql )
+    {
+        char * error {};
+        if( sqlite3_exec( _db, sql, nullptr, nullptr, & error ) != SQLITE_OK )
+        {
+            const std::string message{ error ? error : "unknown error" };
+            sqlite3_free( error );
+            throw Exception{ "Results query failed: " + message };
+        }
+    }
+
+    sqlite3 * _db {};
+};
+#endif  // CMAKE_USE_SQLITE
+
+
+bool is_sqlite( const fs::path & p )
+{
+    constexpr char MAGIC[]{ "SQLite format 3" };
+    std::ifstream f{ p, std::ios::binary };
+    char header[ sizeof( MAGIC ) ] {};
+    f.read( header, sizeof( header ) );
+    return f && std::memcmp( header, MAGIC, sizeof( MAGIC ) ) == 0;
+}
+
+
+std::unique_ptr< Store > open( const fs::path & p )
+{
+    const auto exists{ fs::exists( p ) && fs::file_size( p ) > 0 };
+#ifdef CMAKE_USE_SQLITE
+    if( ! exists || is_sqlite( p ) )
+    {
+        return std::make_unique< Sqlite >( p );
+    }
+#else
+    if( exists && is_sqlite( p ) )
+    {
+        throw Exception{ "Results '" + p.string() + "' need a build with SQLite." };
+    }
+#endif  // CMAKE_USE_SQLITE
+    return std::make_unique< File >( p );
+}
+
+
+}  // namespace res
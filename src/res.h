@@ -0,0 +1,60 @@
+#ifndef RES_H_
+#define RES_H_
+
+
+// In this file: the store of sweep results.
+//
+// Every finished sweep cell is recorded at once, with the dataset it ran on,
+// so that a sweep that dies can be rerun and skip the cells done on that
+// dataset; a store may hold several datasets' results. The store is an SQLite database
+// when built with it, else a plain file appended a line per cell; either
+// can be written by several processes at once.
+
+
+#include "sweep.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace res
+{
+
+
+struct Record
+{
+    sweep::Cell _cell;
+    // The cell ran on, see 'io::identity()'; cells are told apart per dataset.
+    std::string _dataset;
+    // Of head labels, '_classes' rows of ground truth by as many of predictions.
+    unsigned _classes;
+    std::vector< std::uint64_t > _confusion;
+    double _accuracy;
+    // Seconds.
+    double _preprocessing;
+    double _training;
+    double _predicting;
+};
+
+
+struct Store
+{
+    virtual ~Store() = default;
+
+    virtual std::vector< Record > records() const = 0;
+    // Replaces a record of the same cell and dataset. Safe to call concurrently.
+    virtual void put( const Record & ) = 0;
+};
+
+
+// Created if missing. An existing store is opened in its own format.
+std::unique_ptr< Store > open( const std::filesystem::path & );
+
+
+}  // namespace res
+
+
+#endif  // defined(RES_H_)
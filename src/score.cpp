@@ -1,11 +1,20 @@
 #include "score.h"
 
+#include "except.h"
+#include "opt.h"
+#include "perf.h"
+#include "print.h"
+#include "task.h"
+#include "trace.h"
+
 #ifdef CMAKE_USE_DLIB
 #include <dlib/matrix.h>
 #endif
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <numeric>
 #include <random>
 #include <set>
 
@@ -14,6 +23,162 @@ namespace score
 {
 
 
+Counts::Counts( size_t n )
+    : _n{ n }
+    , _counts( n * n )
+{
+}
+
+
+void Counts::add( label::Num ground_truth, label::Num predicted )
+{
+    if( ground_truth >= _n || predicted >= _n )
+    {
+        throw Exception{ "Cannot count label " + std::to_string( std::max( ground_truth, predicted ) )
+                       + " of " + std::to_string( _n ) + " classes." };
+    }
+    ++_counts[ ground_truth * _n + predicted ];
+}
+
+
+Counts & Counts::operator+=( const Counts & other )
+{
+    if( other._n != _n )
+    {
+        throw Exception{ "Cannot add counts of different classes." };
+    }
+    for( size_t i {}; i < _counts.size(); ++i )
+    {
+        _counts[ i ] += other._counts[ i ];
+    }
+    return * this;
+}
+
+
+size_t Counts::size() const
+{
+    return _n;
+}
+
+
+std::uint64_t Counts::at( label::Num ground_truth, label::Num predicted ) const
+{
+    return _counts.at( ground_truth * _n + predicted );
+}
+
+
+std::uint64_t Counts::correct() const
+{
+    std::uint64_t ret {};
+    for( size_t i {}; i < _n; ++i )
+    {
+        ret += _counts[ i * _n + i ];
+    }
+    return ret;
+}
+
+
+std::uint64_t Counts::total() const
+{
+    return std::accumulate( _counts.cbegin(), _counts.cend(), std::uint64_t{} );
+}
+
+
+Evaluation evaluate( const dat::Dataset & test
+                   , const model::Base & m
+                   , const reg::Traits & traits
+                   , std::ostream & out
+                   )
+{
+    print::info( "Evaluating the test set." );
+
+    // Reduce to head labels, by table.
+    const auto headonly{ test.second.headonly() };
+    const auto heads{ label::headonly_table( test.second, headonly ) };
+    const auto head = [ & heads ] ( label::Num l )
+    {
+        if( l >= heads.size() )
+        {
+            throw Exception{ "Label decoding failed. "
+                             "Value " + std::to_string( l ) + " not found." };
+        }
+        return heads[ l ];
+    };
+
+    // Spectra of one label each.
+    struct Shard
+    {
+        label::Num _label;
+        const dat::Spectrum * _begin;
+        size_t _size;
+    };
+    const auto shard_size{ std::max< size_t >( opt::get( "eval.shard", 256u ), 1 ) };
+    std::vector< Shard > shards;
+    for( const auto & kv : test.first )
+    {
+        for( size_t begin {}; begin < kv.second.size(); begin += shard_size )
+        {
+            shards.push_back( { kv.first, kv.second.data() + begin, std::min( shard_size, kv.second.size() - begin ) } );
+        }
+    }
+
+    const auto start{ std::chrono::steady_clock::now() };
+    const perf::Scope stage{ "evaluate", dat::count( test ) };
+    // Counts per chunk of shards rather than per shard, a few chunks per thread
+    // still balancing the load; integer sums merge the same in any order.
+    const auto num_chunks{ std::min< size_t >( shards.size(), size_t{ task::concurrency() } * 4 ) };
+    std::vector< Counts > partial( num_chunks, Counts{ headonly.labels().size() } );
+    task::parallel_for( num_chunks, [ & ] ( size_t c )
+        {
+            for( auto i{ c * shards.size() / num_chunks }; i < ( c + 1 ) * shards.size() / num_chunks; ++i )
+            {
+                const auto & shard{ shards[ i ] };
+                const trace::Scope scope{ "predict", shard._size };
+                const auto truth{ head( shard._label ) };
+                if( traits.batch )
+                {
+                    for( const auto & s : m.score_batch( { shard._begin, shard._begin + shard._size } ) )
+                    {
+                        partial[ c ].add( truth, head( s.label ) );
+                    }
+                }
+                else
+                {
+                    for( size_t j {}; j < shard._size; ++j )
+                    {
+                        partial[ c ].add( truth, head( m.predict( shard._begin[ j ] ) ) );
+                    }
+                }
+            }
+        } );
+    Counts counts{ headonly.labels().size() };
+    for( const auto & p : partial )
+    {
+        counts += p;
+    }
+    const std::chrono::duration< double > elapsed{ std::chrono::steady_clock::now() - start };
+    print::info( "Predicted " + std::to_string( counts.total() ) + " spectra in "
+               + std::to_string( elapsed.count() * 1e3 ) + " ms." );
+
+    const auto accuracy{ counts.total() ? static_cast< double >( counts.correct() ) / static_cast< double >( counts.total() )
+                                        : 0. };
+
+#ifdef CMAKE_USE_DLIB
+    const auto conf = calc_confusion( counts );
+
+    out << "Confusion matrix, rows - ground truth, columns - prediction.\n"
+                 "Labels: " << test.second << '\n'
+              << conf
+              << "\naccuracy: " << score::accuracy( conf ) << '\n';
+#else
+    out << "accuracy: " << accuracy << '\n';
+#endif  // CMAKE_USE_DLIB
+    out << m.stats();
+
+    return { std::move( counts ), accuracy, elapsed };
+}
+
+
 #ifdef CMAKE_USE_DLIB
 const dat::Spectrum & find_worst( Comp c, const dat::Dataset & d )
 {
@@ -93,6 +258,35 @@ calc_confusion( const std::vector< label::Num > &ground_truth
 }
 
 
+Confusion calc_confusion( const Counts & counts )
+{
+    std::vector< label::Num > classes;
+    for( label::Num c {}; c < counts.size(); ++c )
+    {
+        for( label::Num other {}; other < counts.size(); ++other )
+        {
+            if( counts.at( c, other ) || counts.at( other, c ) )
+            {
+                classes.push_back( c );
+                break;
+            }
+        }
+    }
+
+    const auto n{ static_cast< long >( classes.size() ) };
+    Confusion ret = dlib::zeros_matrix< unsigned >( n, n );
+    for( long row {}; row < n; ++row )
+    {
+        for( long col {}; col < n; ++col )
+        {
+            ret( row, col ) = static_cast< unsigned >( counts.at( classes[ static_cast< size_t >( row ) ]
+                                                                , classes[ static_cast< size_t >( col ) ] ) );
+        }
+    }
+    return ret;
+}
+
+
 double accuracy( const Confusion & c )
 {
     const auto t{ dlib::trace( c ) };
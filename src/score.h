@@ -7,12 +7,17 @@
 
 #include "dat.h"
 #include "label.h"
+#include "model.h"
+#include "reg.h"
 
 #ifdef CMAKE_USE_DLIB
 #include <dlib/matrix.h>
 #endif
 
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <iostream>
 #include <utility>
 #include <vector>
 
@@ -21,6 +26,47 @@ namespace score
 {
 
 
+// Counts of predictions per ground truth, of classes numbered below 'n'.
+// Partial counts of disjoint parts of a test set add up.
+struct Counts
+{
+    Counts( size_t n );
+
+    void add( label::Num ground_truth, label::Num predicted );
+    Counts & operator+=( const Counts & );
+
+    size_t size() const;
+    std::uint64_t at( label::Num ground_truth, label::Num predicted ) const;
+    std::uint64_t correct() const;
+    std::uint64_t total() const;
+
+private:
+    size_t _n;
+    // Ground truth major.
+    std::vector< std::uint64_t > _counts;
+};
+
+
+struct Evaluation
+{
+    // Of head labels.
+    Counts _counts;
+    double _accuracy;
+    std::chrono::duration< double > _predicting;
+};
+
+
+// Predict the test set and print the accuracy on head labels and the model's stats.
+// Shards of the test set are predicted and counted in parallel, then their
+// counts are added up in the order of the shards. Option eval.shard - most spectra per shard.
+// A stage of its own for option perf.stages, see 'perf.h'.
+Evaluation evaluate( const dat::Dataset & test
+                   , const model::Base &
+                   , const reg::Traits &
+                   , std::ostream & = std::cout
+                   );
+
+
 #ifdef CMAKE_USE_DLIB
 using Confusion = dlib::matrix< unsigned >;
 
@@ -36,6 +82,10 @@ Confusion calc_confusion( const std::vector< label::Num > & ground_truth
                         );
 
 
+// Of the classes counted at least once, in the order of their numbers.
+Confusion calc_confusion( const Counts & );
+
+
 double accuracy( const Confusion & );
 
 
@@ -0,0 +1,360 @@
+#include "shm.h"
+
+#include "except.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+
+namespace shm
+{
+
+
+constexpr char MAGIC[ 16 ]{ "rocks-shm" };
+constexpr std::uint32_t VERSION{ 2 };
+
+
+// After the page of the reference count, which is only ever accessed atomically.
+struct Header
+{
+    char _magic[ 16 ];
+    std::uint32_t _version;
+    std::uint32_t _labels_depth;
+    std::uint32_t _points;
+    std::uint32_t _unused;
+    std::uint64_t _labels;
+    // Offset and size of the spectra.
+    std::uint64_t _data;
+    std::uint64_t _data_size;
+};
+
+
+// A label, its name at an offset from the header, its spectra indices into all of them.
+struct Entry
+{
+    std::uint64_t _name;
+    std::uint64_t _name_size;
+    std::uint64_t _first;
+    std::uint64_t _count;
+};
+
+
+size_t page_size()
+{
+    return static_cast< size_t >( ::sysconf( _SC_PAGESIZE ) );
+}
+
+
+size_t page_aligned( size_t bytes )
+{
+    const auto page{ page_size() };
+    return ( bytes + page - 1 ) / page * page;
+}
+
+
+std::string error( const std::string & what, const std::string & name )
+{
+    return what + " shared dataset '" + name + "': " + std::strerror( errno );
+}
+
+
+Segment Segment::publish( const std::string & name, const dat::DataRaw & raw, unsigned labels_depth )
+{
+    std::vector< const dat::DataRaw::value_type * > labels;
+    size_t names {};
+    size_t spectra {};
+    for( const auto & kv : raw )
+    {
+        labels.push_back( & kv );
+        names += kv.first.size();
+        spectra += kv.second.size();
+    }
+    std::sort( labels.begin(), labels.end(), [] ( const auto a, const auto b ) { return a->first < b->first; } );
+
+    constexpr auto points{ dat::Spectrum::_num_points };
+    const auto page{ page_size() };
+    const auto head_size{ page_aligned( sizeof( Header ) + labels.size() * sizeof( Entry ) + names ) };
+    const auto data_size{ spectra * points * sizeof( double ) };
+    const auto size{ page + head_size + data_size };
+
+    const auto fd{ ::shm_open( name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600 ) };
+    if( fd < 0 )
+    {
+        throw Exception{ error( "Cannot create", name ) };
+    }
+    void * p{ MAP_FAILED };
+    if( ::ftruncate( fd, static_cast< off_t >( size ) ) == 0 )
+    {
+        p = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    }
+    if( p == MAP_FAILED )
+    {
+        const auto e{ error( "Cannot size", name ) };
+        ::close( fd );
+        ::shm_unlink( name.c_str() );
+        throw Exception{ e };
+    }
+
+    const auto bytes{ static_cast< char * >( p ) + page };
+    const auto entries{ reinterpret_cast< Entry * >( bytes + sizeof( Header ) ) };
+    auto name_at{ sizeof( Header ) + labels.size() * sizeof( Entry ) };
+    auto data{ reinterpret_cast< double * >( bytes + head_size ) };
+    std::uint64_t first {};
+    for( size_t i {}; i < labels.size(); ++i )
+    {
+        const auto & [ label, label_spectra ] = * labels[ i ];
+        entries[ i ] = { name_at, label.size(), first, label_spectra.size() };
+        std::memcpy( bytes + name_at, label.data(), label.size() );
+        name_at += label.size();
+        for( const auto & s : label_spectra )
+        {
+            std::memcpy( data, s._y.data(), sizeof( s._y ) );
+            data += points;
+        }
+        first += label_spectra.size();
+    }
+
+    // The magic last, so that a segment being published does not attach.
+    * static_cast< std::uint32_t * >( p ) = 1;
+    const auto h{ reinterpret_cast< Header * >( bytes ) };
+    h->_version = VERSION;
+    h->_labels_depth = labels_depth;
+    h->_points = points;
+    h->_labels = labels.size();
+    h->_data = page + head_size;
+    h->_data_size = data_size;
+    std::atomic_thread_fence( std::memory_order_release );
+    std::memcpy( h->_magic, MAGIC, sizeof( MAGIC ) );
+    ::munmap( p, size );
+
+    try
+    {
+        return { name, fd };
+    }
+    catch( ... )
+    {
+        ::shm_unlink( name.c_str() );
+        throw;
+    }
+}
+
+
+Segment Segment::attach( const std::string & name )
+{
+    const auto fd{ ::shm_open( name.c_str(), O_RDWR, 0 ) };
+    if( fd < 0 )
+    {
+        throw Exception{ error( "Cannot open", name ) };
+    }
+    Segment ret{ name, fd };
+
+    // A count of 0 means the last holder is removing it.
+    std::atomic_ref refs{ * static_cast< std::uint32_t * >( ret._refs ) };
+    for( auto r{ refs.load() }; ; )
+    {
+        if( ! r )
+        {
+            ret._name.clear();
+            throw Exception{ "Shared dataset '" + name + "' is being removed." };
+        }
+        if( refs.compare_exchange_weak( r, r + 1 ) )
+        {
+            return ret;
+        }
+    }
+}
+
+
+// Whether the layout fits a segment of 'size' bytes: the spectra from a page
+// boundary to the end, whole ones, after the header and table of labels.
+bool fits( const Header & h, size_t size )
+{
+    const auto page{ page_size() };
+    constexpr auto spectrum{ dat::Spectrum::_num_points * sizeof( double ) };
+    return h._data % page == 0
+        && h._data >= page + sizeof( Header )
+        && h._data <= size
+        && h._data_size == size - h._data
+        && h._data_size % spectrum == 0
+        && h._labels <= ( h._data - page - sizeof( Header ) ) / sizeof( Entry );
+}
+
+
+// Whether every label's name lies after the table, within the header's pages,
+// and its spectra within the spectra.
+bool fits( const void * head, size_t head_size, const Header & h )
+{
+    const auto names{ sizeof( Header ) + h._labels * sizeof( Entry ) };
+    const auto spectra{ h._data_size / ( dat::Spectrum::_num_points * sizeof( double ) ) };
+    const auto entries{ reinterpret_cast< const Entry * >( static_cast< const char * >( head ) + sizeof( Header ) ) };
+    for( size_t i {}; i < h._labels; ++i )
+    {
+        const auto & e{ entries[ i ] };
+        if( e._name < names || e._name > head_size || e._name_size > head_size - e._name
+         || e._first > spectra || e._count > spectra - e._first )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Maps the page of the count read-write, the header, labels and spectra read-only,
+// once checked to fit the segment. Takes over 'fd' and holds no reference yet.
+Segment::Segment( const std::string & name, int fd )
+    : _name{ name }
+    , _refs{ MAP_FAILED }
+    , _head{ MAP_FAILED }
+    , _head_size{}
+    , _data{ nullptr }
+    , _data_size{}
+{
+    const auto page{ page_size() };
+    struct stat st {};
+    Header h {};
+    const auto ready{ ::fstat( fd, & st ) == 0
+                   && static_cast< size_t >( st.st_size ) >= page + sizeof( Header )
+                   && ::pread( fd, & h, sizeof( h ), static_cast< off_t >( page ) ) == static_cast< ssize_t >( sizeof( h ) )
+                   && std::memcmp( h._magic, MAGIC, sizeof( MAGIC ) ) == 0
+                   && h._version == VERSION
+                   && h._points == dat::Spectrum::_num_points };
+    auto whole{ ready && fits( h, static_cast< size_t >( st.st_size ) ) };
+    if( whole )
+    {
+        _head_size = h._data - page;
+        _refs = ::mmap( nullptr, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        _head = ::mmap( nullptr, _head_size, PROT_READ, MAP_SHARED, fd, static_cast< off_t >( page ) );
+    }
+    if( _head != MAP_FAILED && h._data_size )
+    {
+        _data_size = h._data_size;
+        _data = ::mmap( nullptr, _data_size, PROT_READ, MAP_SHARED, fd, static_cast< off_t >( h._data ) );
+    }
+    ::close( fd );
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+    // The header checked is the one mapped, in case it was written since.
+    const auto mapped{ _refs != MAP_FAILED && _head != MAP_FAILED && _data != MAP_FAILED };
+    whole = whole && ( ! mapped || ( std::memcmp( _head, & h, sizeof( h ) ) == 0 && fits( _head, _head_size, h ) ) );
+    if( mapped && whole )
+    {
+        return;
+    }
+    if( _data && _data != MAP_FAILED )
+    {
+        ::munmap( _data, _data_size );
+    }
+    if( _head != MAP_FAILED )
+    {
+        ::munmap( _head, _head_size );
+    }
+    if( _refs != MAP_FAILED )
+    {
+        ::munmap( _refs, page );
+    }
+    throw Exception{ "Shared dataset '" + name + ( ! ready ? "' is not ready or not of this version."
+                                                  : ! whole ? "' is corrupt."
+                                                            : "' cannot be mapped." ) };
+}
+
+
+Segment::Segment( Segment && other )
+    : _name{ std::move( other._name ) }
+    , _refs{ other._refs }
+    , _head{ other._head }
+    , _head_size{ other._head_size }
+    , _data{ other._data }
+    , _data_size{ other._data_size }
+{
+    other._head = MAP_FAILED;
+    other._data = nullptr;
+}
+
+
+Segment::~Segment()
+{
+    if( _head == MAP_FAILED )
+    {
+        return;
+    }
+    // An empty name holds no reference, see 'attach()'.
+    if( ! _name.empty()
+     && std::atomic_ref{ * static_cast< std::uint32_t * >( _refs ) }.fetch_sub( 1 ) == 1 )
+    {
+        ::shm_unlink( _name.c_str() );
+    }
+    if( _data )
+    {
+        ::munmap( _data, _data_size );
+    }
+    ::munmap( _head, _head_size );
+    ::munmap( _refs, page_size() );
+}
+
+
+unsigned Segment::labels_depth() const
+{
+    return static_cast< const Header * >( _head )->_labels_depth;
+}
+
+
+size_t Segment::labels() const
+{
+    return static_cast< const Header * >( _head )->_labels;
+}
+
+
+const Entry & entry( const void * head, size_t i )
+{
+    return reinterpret_cast< const Entry * >( static_cast< const char * >( head ) + sizeof( Header ) )[ i ];
+}
+
+
+std::string Segment::label( size_t i ) const
+{
+    const auto & e{ entry( _head, i ) };
+    return { static_cast< const char * >( _head ) + e._name, e._name_size };
+}
+
+
+std::span< const double > Segment::spectra( size_t i ) const
+{
+    const auto & e{ entry( _head, i ) };
+    constexpr auto points{ dat::Spectrum::_num_points };
+    return { static_cast< const double * >( _data ) + e._first * points, e._count * points };
+}
+
+
+dat::DataRaw Segment::copy( unsigned labels_depth ) const
+{
+    if( labels_depth > this->labels_depth() )
+    {
+        throw Exception{ "Shared dataset '" + _name + "' was published at labels depth "
+                       + std::to_string( this->labels_depth() ) + " only." };
+    }
+
+    dat::DataRaw ret;
+    for( size_t i {}; i < labels(); ++i )
+    {
+        const auto from{ spectra( i ) };
+        auto & to{ ret[ label( i ) ] };
+        to.resize( from.size() / dat::Spectrum::_num_points );
+        for( size_t j {}; j < to.size(); ++j )
+        {
+            std::memcpy( to[ j ]._y.data(), from.data() + j * dat::Spectrum::_num_points, sizeof( to[ j ]._y ) );
+        }
+    }
+    return labels_depth < this->labels_depth() ? dat::coarsen( ret, labels_depth ) : ret;
+}
+
+
+}  // namespace shm
@@ -0,0 +1,73 @@
+#ifndef SHM_H_
+#define SHM_H_
+
+
+// In this file: a dataset shared by processes in POSIX shared memory.
+//
+// One process publishes a dataset read from disk into a named segment; others
+// on the host attach to it without parsing or copying, and map the spectra
+// read-only. The segment holds, in order:
+//     1. a page of its own for the reference count, the only part mapped writable,
+//     2. a header: magic, version, labels depth and layout,
+//     3. a table of the labels, each with its name and range of spectra,
+//     4. the names,
+//     5. from a page boundary, the intensities of all spectra, label by label.
+// Attaching checks the layout and every label's ranges against the segment.
+// Every process attached, the publisher included, holds a reference; the last
+// one to detach removes the segment. One that crashes leaks its reference, the
+// segment then stays in /dev/shm until removed by hand.
+
+
+#include "dat.h"
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+
+namespace shm
+{
+
+
+// Marks a segment name where a dataset dir is expected, e.g. "shm:/rocks".
+constexpr const char PREFIX[]{ "shm:" };
+
+
+struct Segment
+{
+    // Throws if 'name' is published already.
+    static Segment publish( const std::string & name, const dat::DataRaw &, unsigned labels_depth );
+    // Throws unless 'name' is published and not being removed.
+    static Segment attach( const std::string & name );
+
+    Segment( Segment && );
+    ~Segment();
+    Segment( const Segment & ) = delete;
+    Segment & operator=( const Segment & ) = delete;
+
+    // As published.
+    unsigned labels_depth() const;
+    size_t labels() const;
+    std::string label( size_t i ) const;
+    // The spectra of label 'i', 'dat::Spectrum::_num_points' intensities each.
+    std::span< const double > spectra( size_t i ) const;
+
+    // The dataset as read at 'labels_depth', at most the published one.
+    dat::DataRaw copy( unsigned labels_depth ) const;
+
+private:
+    Segment( const std::string & name, int fd );
+
+    std::string _name;
+    void * _refs;
+    void * _head;
+    size_t _head_size;
+    void * _data;
+    size_t _data_size;
+};
+
+
+}  // namespace shm
+
+
+#endif  // defined(SHM_H_)
@@ -0,0 +1,397 @@
+#include "spool.h"
+
+#include "except.h"
+#include "io.h"
+#include "opt.h"
+#include "print.h"
+#include "res.h"
+#include "shm.h"
+#include "task.h"
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+
+extern char ** environ;
+
+
+namespace spool
+{
+
+
+namespace fs = std::filesystem;
+
+
+std::string slurp( const fs::path & p )
+{
+    std::ifstream f{ p };
+    std::ostringstream s;
+    s << f.rdbuf();
+    return s.str();
+}
+
+
+void dump( const fs::path & p, const std::string & s )
+{
+    std::ofstream f{ p };
+    f << s;
+    if( ! f )
+    {
+        throw Exception{ "Failed writing '" + p.string() + "'." };
+    }
+}
+
+
+// A line per field, the cells one after another.
+std::string encode( const std::vector< sweep::Cell > & cells )
+{
+    std::string ret;
+    for( const auto & c : cells )
+    {
+        std::string chain;
+        for( const auto & p : c._preprocessing )
+        {
+            chain += ( chain.empty() ? "" : " " ) + p;
+        }
+        ret += c._model + '\n' + chain + '\n'
+             + std::to_string( c._labels_depth ) + '\n' + std::to_string( c._seed ) + '\n';
+    }
+    return ret;
+}
+
+
+std::vector< sweep::Cell > decode( const std::string & s )
+{
+    std::istringstream is{ s };
+    std::vector< sweep::Cell > ret;
+    while( is.peek() != std::istringstream::traits_type::eof() )
+    {
+        std::string model, chain;
+        sweep::Cell c {};
+        std::getline( is, model );
+        std::getline( is, chain );
+        is >> c._labels_depth >> c._seed;
+        if( ! is || is.get() != '\n' )
+        {
+            throw Exception{ "Corrupt sweep job '" + s + "'." };
+        }
+        c._model = model;
+        std::istringstream ps{ chain };
+        for( std::string p; ps >> p; )
+        {
+            c._preprocessing.push_back( p );
+        }
+        ret.push_back( std::move( c ) );
+    }
+    return ret;
+}
+
+
+// The cells of a job share a labels depth, a preprocessing chain and a split,
+// so that a worker preprocesses and splits the dataset once for all of them.
+std::vector< std::vector< sweep::Cell > > group( const std::vector< sweep::Cell > & cells )
+{
+    using Key = std::tuple< unsigned, std::vector< std::string >, unsigned >;
+    std::map< Key, size_t > index;
+    std::vector< std::vector< sweep::Cell > > ret;
+    for( const auto & c : cells )
+    {
+        const auto [ it, added ]{ index.emplace( Key{ c._labels_depth, c._preprocessing, c._seed }, ret.size() ) };
+        if( added )
+        {
+            ret.emplace_back();
+        }
+        ret[ it->second ].push_back( c );
+    }
+    return ret;
+}
+
+
+// E.g. every cell of a job failing for 'why'.
+std::string describe( const std::vector< sweep::Cell > & cells, const std::string & why )
+{
+    std::string ret;
+    for( const auto & c : cells )
+    {
+        ret += sweep::describe( c ) + "\nfailed: " + why + '\n';
+    }
+    return ret;
+}
+
+
+// Of the jobs claimed by process 'pid'.
+std::string suffix( pid_t pid )
+{
+    std::string ret{ "." };
+    ret += std::to_string( pid );
+    return ret;
+}
+
+
+// The job won, if any is left. Jobs are tried in the order of the cells.
+std::optional< std::string > claim( const fs::path & dir )
+{
+    std::vector< unsigned long > jobs;
+    for( const auto & e : fs::directory_iterator( dir / "todo" ) )
+    {
+        jobs.push_back( std::stoul( e.path().filename().string() ) );
+    }
+    std::sort( jobs.begin(), jobs.end() );
+
+    for( const auto j : jobs )
+    {
+        const auto job{ std::to_string( j ) };
+        const auto from{ dir / "todo" / job };
+        const auto to{ dir / "claimed" / ( job + suffix( ::getpid() ) ) };
+        if( ::rename( from.c_str(), to.c_str() ) == 0 )
+        {
+            return job;
+        }
+        if( errno != ENOENT )
+        {
+            throw Exception{ "Cannot claim sweep job '" + from.string() + "': " + std::strerror( errno ) };
+        }
+        // Won by another worker.
+    }
+    return {};
+}
+
+
+// Into 'todo' whole, by renaming, so that no worker claims it half written.
+void put( const fs::path & dir, size_t job, const std::vector< sweep::Cell > & cells )
+{
+    const auto name{ std::to_string( job ) };
+    dump( dir / "tmp" / name, encode( cells ) );
+    fs::rename( dir / "tmp" / name, dir / "todo" / name );
+}
+
+
+void work( const fs::path & dir )
+{
+    std::istringstream options{ slurp( dir / "options" ) };
+    for( std::string o; std::getline( options, o ); )
+    {
+        opt::set( o );
+    }
+    // A model at a time, the worker's threads go to it.
+    opt::set( "sweep.parallel=1" );
+    // At the depth published, the deepest of the sweep, each cell coarsening it to its own.
+    const auto raw{ [ & ]
+        {
+            if( ! fs::exists( dir / "segment" ) )
+            {
+                return io::read_cache( dir / "dataset" );
+            }
+            const auto segment{ shm::Segment::attach( slurp( dir / "segment" ) ) };
+            return segment.copy( segment.labels_depth() );
+        }() };
+    const auto store{ res::open( slurp( dir / "store" ) ) };
+    const auto dataset{ slurp( dir / "identity" ) };
+
+    while( const auto job{ claim( dir ) } )
+    {
+        const auto claimed{ dir / "claimed" / ( * job + suffix( ::getpid() ) ) };
+        std::ostringstream report;
+        sweep::run( raw, dataset, decode( slurp( claimed ) ), store.get(), report );
+        dump( claimed, report.str() );
+        fs::rename( claimed, dir / "done" / * job );
+    }
+}
+
+
+// Remove all but the store, which may be in 'dir' too.
+void clean( const fs::path & dir )
+{
+    for( const auto p : { "tmp", "todo", "claimed", "done", "failed", "dataset", "segment", "identity", "options", "store" } )
+    {
+        fs::remove_all( dir / p );
+    }
+}
+
+
+// A worker process running 'work' on 'dir' with 'threads'.
+pid_t spawn( const fs::path & dir, unsigned threads )
+{
+    std::vector< std::string > args{ "rocks", "-j", std::to_string( threads ), "-W", dir.string() };
+    std::vector< char * > argv;
+    for( auto & a : args )
+    {
+        argv.push_back( a.data() );
+    }
+    argv.push_back( nullptr );
+
+    pid_t pid {};
+    if( const auto error{ ::posix_spawn( & pid, "/proc/self/exe", nullptr, nullptr, argv.data(), environ ) } )
+    {
+        throw Exception{ std::string{ "Cannot start a sweep worker: " } + std::strerror( error ) };
+    }
+    return pid;
+}
+
+
+void run( const fs::path & dir
+        , const fs::path & data_dir
+        , const std::vector< sweep::Cell > & cells
+        , const fs::path & store
+        , unsigned workers
+        , std::ostream & out
+        )
+{
+    // Fixes the format of a new store before the workers race to create it.
+    const auto dataset{ io::identity( data_dir ) };
+    const auto todo{ sweep::pending( cells, * res::open( store ), dataset ) };
+    if( todo.empty() )
+    {
+        return;
+    }
+
+    // Of a sweep interrupted before.
+    clean( dir );
+    for( const auto sub : { "tmp", "todo", "claimed", "done", "failed" } )
+    {
+        fs::create_directories( dir / sub );
+    }
+    unsigned deepest {};
+    for( const auto & c : todo )
+    {
+        deepest = std::max( deepest, c._labels_depth );
+    }
+    print::info( "Reading dataset '" + data_dir.string() + "' at labels depth " + std::to_string( deepest ) );
+    if( io::csvs_above( data_dir, deepest ) )
+    {
+        print::warn( "Spectra lie above labels depth " + std::to_string( deepest ) + " in '" + data_dir.string()
+                   + "', they are left out of the shallower depths too." );
+    }
+    std::optional< shm::Segment > segment;
+    if( opt::get< std::string >( "spool.dataset", "cache" ) == "shm" )
+    {
+        const auto name{ "/rocks-spool-" + std::to_string( ::getpid() ) };
+        segment.emplace( shm::Segment::publish( name, io::read( data_dir, deepest ), deepest ) );
+        dump( dir / "segment", name );
+    }
+    else
+    {
+        io::write_cache( io::read( data_dir, deepest ), dir / "dataset" );
+    }
+    std::string options;
+    for( const auto & o : opt::all() )
+    {
+        options += o + '\n';
+    }
+    dump( dir / "options", options );
+    dump( dir / "store", fs::absolute( store ).string() );
+    dump( dir / "identity", dataset );
+    auto jobs{ group( todo ) };
+    for( size_t i {}; i < jobs.size(); ++i )
+    {
+        put( dir, i, jobs[ i ] );
+    }
+
+    workers = std::clamp< unsigned >( workers, 1, static_cast< unsigned >( jobs.size() ) );
+    const auto threads{ std::max( task::concurrency() / workers, 1u ) };
+    print::info( "Running " + std::to_string( todo.size() ) + " cells in " + std::to_string( jobs.size() )
+               + " jobs by " + std::to_string( workers ) + " workers of " + std::to_string( threads ) + " threads." );
+    std::set< pid_t > running;
+    for( unsigned i {}; i < workers; ++i )
+    {
+        running.insert( spawn( dir, threads ) );
+    }
+
+    while( ! running.empty() )
+    {
+        int status {};
+        const auto pid{ ::waitpid( -1, & status, 0 ) };
+        if( pid < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            throw Exception{ std::string{ "Lost the sweep workers: " } + std::strerror( errno ) };
+        }
+        if( ! running.erase( pid ) || ( WIFEXITED( status ) && WEXITSTATUS( status ) == 0 ) )
+        {
+            continue;
+        }
+
+        // Fail the job it held, and replace it if it held one, so a worker failing
+        // to even start is not restarted forever. The cells of the job not recorded
+        // yet are spooled again a job each, so that only the one at fault fails.
+        const auto why{ WIFSIGNALED( status ) ? "signal " + std::to_string( WTERMSIG( status ) )
+                                              : "status " + std::to_string( WEXITSTATUS( status ) ) };
+        print::info( "Sweep worker " + std::to_string( pid ) + " died of " + why + '.' );
+        const auto held_by{ suffix( pid ) };
+        bool held {};
+        for( const auto & e : fs::directory_iterator( dir / "claimed" ) )
+        {
+            const auto name{ e.path().filename().string() };
+            if( name.size() > held_by.size() && name.ends_with( held_by ) )
+            {
+                const auto job{ name.substr( 0, name.size() - held_by.size() ) };
+                const auto cells_held{ jobs.at( std::stoul( job ) ) };
+                if( cells_held.size() == 1 )
+                {
+                    dump( dir / "failed" / job, describe( cells_held, "worker died of " + why ) );
+                }
+                else
+                {
+                    std::set< std::string > left;
+                    for( const auto & c : sweep::pending( cells_held, * res::open( store ), dataset ) )
+                    {
+                        left.insert( sweep::describe( c ) );
+                        put( dir, jobs.size(), { c } );
+                        jobs.push_back( { c } );
+                    }
+                    std::string recorded;
+                    for( const auto & c : cells_held )
+                    {
+                        if( ! left.count( sweep::describe( c ) ) )
+                        {
+                            recorded += sweep::describe( c ) + "\nrecorded, its evaluation lost with the worker\n";
+                        }
+                    }
+                    dump( dir / "failed" / job, recorded );
+                }
+                fs::remove( e.path() );
+                held = true;
+            }
+        }
+        if( held && ! fs::is_empty( dir / "todo" ) )
+        {
+            running.insert( spawn( dir, threads ) );
+        }
+    }
+
+    for( size_t i {}; i < jobs.size(); ++i )
+    {
+        const auto job{ std::to_string( i ) };
+        if( fs::exists( dir / "done" / job ) )
+        {
+            out << slurp( dir / "done" / job );
+        }
+        else if( fs::exists( dir / "failed" / job ) )
+        {
+            out << slurp( dir / "failed" / job );
+        }
+        else
+        {
+            out << describe( jobs[ i ], "not run, the workers died" );
+        }
+    }
+    out << std::flush;
+    clean( dir );
+}
+
+
+}  // namespace spool
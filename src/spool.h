@@ -0,0 +1,64 @@
+#ifndef SPOOL_H_
+#define SPOOL_H_
+
+
+// In this file: the sweep run by worker processes rather than threads.
+//
+// Some libraries hold global state that makes training several models at once
+// in one process risky. Here the sweep is expanded into job files in a spool
+// directory next to the dataset, cached in a binary file or published in
+// shared memory, see 'shm.h'. Worker processes of this very program claim jobs
+// by renaming them, which only one of them can win, run them on the shared
+// dataset and record the results into the store. A job holds the cells of one
+// labels depth, preprocessing chain and split, computed once for all of them;
+// a worker trains its cells one after another. A worker that crashes fails
+// only the job it held. The dataset is read at the deepest labels depth only,
+// so .csv files lying above it are left out of every depth, see 'dat::coarsen()'.
+//
+// The spool directory:
+//     dataset          <- see io::write_cache
+//     segment          <- or the name of the shared memory holding it
+//     identity         <- of the dataset, recorded with the results, see io::identity
+//     options          <- given to the sweep, a "key=value" per line
+//     store            <- the path of the results store, see 'res.h'
+//     tmp/7            <- being written, then renamed into todo
+//     todo/7           <- the 8th job of the sweep, waiting
+//     claimed/7.1234   <- run by the worker of process id 1234
+//     done/7           <- its evaluation, as printed by sweep::run
+//     failed/7         <- or the crash of its worker
+
+
+#include "sweep.h"
+
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+
+namespace spool
+{
+
+
+// Run the cells not in 'store' yet on the dataset under 'data_dir', by 'workers'
+// processes spooled in 'dir', recording the results into 'store'. Print the
+// evaluations to 'out' job by job, once all are done.
+// The threads are shared evenly among the workers.
+// Option: spool.dataset - 'cache' into a file, the default, or 'shm' for shared memory.
+void run( const std::filesystem::path & dir
+        , const std::filesystem::path & data_dir
+        , const std::vector< sweep::Cell > &
+        , const std::filesystem::path & store
+        , unsigned workers
+        , std::ostream & out = std::cout
+        );
+
+
+// Claim and run the jobs spooled in 'dir' until none is left.
+// The body of a worker process.
+void work( const std::filesystem::path & dir );
+
+
+}  // namespace spool
+
+
+#endif  // defined(SPOOL_H_)
@@ -0,0 +1,736 @@
+#include "srv.h"
+
+#include "except.h"
+#include "model.h"
+#include "opt.h"
+#include "print.h"
+#include "task.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <thread>
+
+
+namespace srv
+{
+
+
+using Clock = std::chrono::steady_clock;
+constexpr auto N{ dat::Spectrum::_num_points };
+constexpr std::uint32_t MAX_PAYLOAD{ 1u << 30 };
+
+
+void Latencies::add( std::chrono::nanoseconds d )
+{
+    const auto us{ std::max( d.count() / 1e3, 1. ) };
+    const auto i{ std::min< size_t >( static_cast< size_t >( 4 * std::log2( us ) )
+                                    , _buckets.size() - 1 ) };
+    ++_buckets[ i ];
+}
+
+
+std::uint64_t Latencies::count() const
+{
+    std::uint64_t ret {};
+    for( const auto & b : _buckets )
+    {
+        ret += b;
+    }
+    return ret;
+}
+
+
+// Upper bound of the bucket holding the percentile.
+double Latencies::percentile( double p ) const
+{
+    const auto total{ count() };
+    std::uint64_t seen {};
+    for( size_t i {}; i < _buckets.size(); ++i )
+    {
+        seen += _buckets[ i ];
+        if( seen && seen >= p * total )
+        {
+            return std::exp2( ( i + 1 ) / 4. );
+        }
+    }
+    return 0;
+}
+
+
+void write_all( int fd, const char * p, size_t n )
+{
+    while( n )
+    {
+        const auto w{ ::send( fd, p, n, MSG_NOSIGNAL ) };
+        if( w < 0 )
+        {
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            throw Exception{ std::string{ "Socket write failed: " } + std::strerror( errno ) };
+        }
+        p += w;
+        n -= static_cast< size_t >( w );
+    }
+}
+
+
+// False if the peer closed the connection before sending anything.
+bool read_all( int fd, char * p, size_t n )
+{
+    const auto requested{ n };
+    while( n )
+    {
+        const auto r{ ::recv( fd, p, n, 0 ) };
+        if( r < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if( r <= 0 )
+        {
+            if( r == 0 && n == requested )
+            {
+                return false;
+            }
+            throw Exception{ "Connection lost mid frame." };
+        }
+        p += r;
+        n -= static_cast< size_t >( r );
+    }
+    return true;
+}
+
+
+void send_frame( int fd, char kind, const std::string & payload )
+{
+    char header[ 5 ]{ kind };
+    const auto size{ static_cast< std::uint32_t >( payload.size() ) };
+    std::memcpy( header + 1, & size, sizeof( size ) );
+    write_all( fd, header, sizeof( header ) );
+    write_all( fd, payload.data(), payload.size() );
+}
+
+
+std::optional< std::pair< char, std::string > > receive_frame( int fd )
+{
+    char header[ 5 ];
+    if( ! read_all( fd, header, sizeof( header ) ) )
+    {
+        return {};
+    }
+
+    std::uint32_t size;
+    std::memcpy( & size, header + 1, sizeof( size ) );
+    if( size > MAX_PAYLOAD )
+    {
+        throw Exception{ "Frame too large." };
+    }
+
+    std::string payload( size, '\0' );
+    if( size && ! read_all( fd, payload.data(), size ) )
+    {
+        throw Exception{ "Connection lost mid frame." };
+    }
+    return std::pair{ header[ 0 ], std::move( payload ) };
+}
+
+
+std::string encode_binary( const std::vector< dat::Spectrum > & spectra )
+{
+    const auto count{ static_cast< std::uint32_t >( spectra.size() ) };
+    std::string ret( sizeof( count ) + size_t{ count } * N * sizeof( float ), '\0' );
+    std::memcpy( ret.data(), & count, sizeof( count ) );
+
+    auto p{ ret.data() + sizeof( count ) };
+    for( const auto & s : spectra )
+    {
+        for( const auto v : s._y )
+        {
+            const auto f{ static_cast< float >( v ) };
+            std::memcpy( p, & f, sizeof( f ) );
+            p += sizeof( f );
+        }
+    }
+    return ret;
+}
+
+
+std::vector< dat::Spectrum > decode_binary( const std::string & payload )
+{
+    std::uint32_t count {};
+    if( payload.size() >= sizeof( count ) )
+    {
+        std::memcpy( & count, payload.data(), sizeof( count ) );
+    }
+    if( payload.size() != sizeof( count ) + size_t{ count } * N * sizeof( float ) )
+    {
+        throw Exception{ "Binary batch size does not match its spectra count." };
+    }
+
+    std::vector< dat::Spectrum > ret( count );
+    auto p{ payload.data() + sizeof( count ) };
+    for( auto & s : ret )
+    {
+        for( auto & v : s._y )
+        {
+            float f;
+            std::memcpy( & f, p, sizeof( f ) );
+            v = f;
+            p += sizeof( f );
+        }
+    }
+    return ret;
+}
+
+
+std::vector< dat::Spectrum > decode_csv( const std::string & payload )
+{
+    std::vector< dat::Spectrum > ret;
+    std::istringstream lines{ payload };
+    for( std::string line; std::getline( lines, line ); )
+    {
+        if( line.empty() || line == "\r" )
+        {
+            continue;
+        }
+
+        auto & s{ ret.emplace_back() };
+        const char * p{ line.c_str() };
+        for( auto & v : s._y )
+        {
+            char * end;
+            v = std::strtod( p, & end );
+            if( end == p )
+            {
+                throw Exception{ "CSV spectrum " + std::to_string( ret.size() )
+                               + " has fewer than " + std::to_string( N ) + " values." };
+            }
+            p = * end == ',' ? end + 1 : end;
+        }
+    }
+    return ret;
+}
+
+
+// Requests waiting for a worker.
+struct Job
+{
+    std::vector< dat::Spectrum > _spectra;
+    std::promise< std::vector< model::Scored > > _done;
+};
+
+
+struct Server
+{
+    Server( const art::Pipeline & p )
+        : _pipeline{ p }
+        , _max_batch{ std::max( opt::get( "srv.batch", 64u ), 1u ) }
+        , _window{ opt::get( "srv.window_us", 500u ) }
+    {
+    }
+
+
+    std::vector< model::Scored > predict( std::vector< dat::Spectrum > && spectra )
+    {
+        Job j{ std::move( spectra ), {} };
+        auto done{ j._done.get_future() };
+        {
+            std::lock_guard lock{ _lock };
+            // Workers leave once stopping and the queue is empty.
+            if( _stopping )
+            {
+                throw Exception{ "The server is stopping." };
+            }
+            _queue.push_back( & j );
+        }
+        _ready.notify_one();
+        return done.get();
+    }
+
+
+    // Take the first job waiting, then keep adding jobs
+    // until the batch is full or the window closes.
+    void work()
+    {
+        while( true )
+        {
+            std::vector< Job * > jobs;
+            size_t num_spectra {};
+            {
+                std::unique_lock lock{ _lock };
+                _ready.wait( lock, [ this ] { return _stopping || ! _queue.empty(); } );
+                if( _queue.empty() )
+                {
+                    return;
+                }
+                const auto deadline{ Clock::now() + _window };
+                while( num_spectra < _max_batch )
+                {
+                    if( _queue.empty()
+                     && ! _ready.wait_until( lock, deadline, [ this ] { return ! _queue.empty(); } ) )
+                    {
+                        break;
+                    }
+                    jobs.push_back( _queue.front() );
+                    num_spectra += _queue.front()->_spectra.size();
+                    _queue.pop_front();
+                }
+            }
+
+            try
+            {
+                std::vector< dat::Spectrum > batch;
+                batch.reserve( num_spectra );
+                for( const auto j : jobs )
+                {
+                    batch.insert( batch.end(), j->_spectra.cbegin(), j->_spectra.cend() );
+                }
+
+                const auto scored{ _pipeline.score( std::move( batch ) ) };
+                auto from{ scored.cbegin() };
+                for( const auto j : jobs )
+                {
+                    const auto to{ from + static_cast< long >( j->_spectra.size() ) };
+                    j->_done.set_value( { from, to } );
+                    from = to;
+                }
+            }
+            catch( ... )
+            {
+                for( const auto j : jobs )
+                {
+                    j->_done.set_exception( std::current_exception() );
+                }
+            }
+
+            ++_batches;
+            _batched += num_spectra;
+        }
+    }
+
+
+    std::string answer( char kind, const std::string & payload )
+    {
+        if( kind == 'B' )
+        {
+            const auto scored{ predict( decode_binary( payload ) ) };
+            std::string ret( scored.size() * 2 * sizeof( std::uint32_t ), '\0' );
+            auto p{ ret.data() };
+            for( const auto & s : scored )
+            {
+                const std::uint32_t l{ s.label };
+                const auto f{ static_cast< float >( s.score ) };
+                std::memcpy( p, & l, sizeof( l ) );
+                std::memcpy( p + sizeof( l ), & f, sizeof( f ) );
+                p += sizeof( l ) + sizeof( f );
+            }
+            _spectra += scored.size();
+            return ret;
+        }
+        if( kind == 'C' )
+        {
+            const auto scored{ predict( decode_csv( payload ) ) };
+            std::string ret;
+            for( const auto & s : scored )
+            {
+                ret += _pipeline._codec.decode( s.label ) + ',' + std::to_string( s.score ) + '\n';
+            }
+            _spectra += scored.size();
+            return ret;
+        }
+        if( kind == 'L' )
+        {
+            std::string ret;
+            const auto labels{ _pipeline._codec.labels() };
+            for( size_t i {}; i < labels.size(); ++i )
+            {
+                ret += std::to_string( i ) + ',' + labels[ i ] + '\n';
+            }
+            return ret;
+        }
+        if( kind == 'S' )
+        {
+            const auto batches{ std::max< std::uint64_t >( _batches, 1 ) };
+            std::ostringstream s;
+            s << "requests " << _latencies.count() << '\n'
+              << "spectra " << _spectra << '\n'
+              << "batches " << _batches << '\n'
+              << "mean_batch " << 1.0 * _batched / batches << '\n'
+              << "p50_us " << _latencies.percentile( 0.5 ) << '\n'
+              << "p99_us " << _latencies.percentile( 0.99 ) << '\n'
+              << _pipeline._model->stats();
+            return s.str();
+        }
+
+        throw Exception{ std::string{ "Unknown request kind '" } + kind + "'." };
+    }
+
+
+    // Talk to the connections accepted, one at a time, until stopped.
+    void handle()
+    {
+        while( true )
+        {
+            int fd {};
+            {
+                std::unique_lock lock{ _clients_lock };
+                ++_idle;
+                _room.notify_one();
+                _accepted.wait( lock, [ this ] { return _stopping || ! _clients.empty(); } );
+                --_idle;
+                if( _stopping )
+                {
+                    return;
+                }
+                fd = _clients.front();
+                _clients.pop_front();
+                _talking.insert( fd );
+            }
+            talk( fd );
+            {
+                std::lock_guard lock{ _clients_lock };
+                _talking.erase( fd );
+            }
+            ::close( fd );
+        }
+    }
+
+
+    // Blocks until a handler is free to take the next connection.
+    void wait_for_handler()
+    {
+        std::unique_lock lock{ _clients_lock };
+        _room.wait( lock, [ this ] { return _clients.size() < _idle; } );
+    }
+
+
+    void hand( int fd )
+    {
+        {
+            std::lock_guard lock{ _clients_lock };
+            _clients.push_back( fd );
+        }
+        _accepted.notify_one();
+    }
+
+
+    // Workers finish the jobs queued, connections are shut down.
+    void stop()
+    {
+        {
+            std::lock_guard lock{ _lock };
+            _stopping = true;
+        }
+        _ready.notify_all();
+        {
+            std::lock_guard lock{ _clients_lock };
+            for( const auto fd : _talking )
+            {
+                ::shutdown( fd, SHUT_RDWR );
+            }
+            for( const auto fd : _clients )
+            {
+                ::close( fd );
+            }
+            _clients.clear();
+        }
+        _accepted.notify_all();
+    }
+
+
+    void talk( int fd )
+    {
+        try
+        {
+            while( const auto frame{ receive_frame( fd ) } )
+            {
+                const auto start{ Clock::now() };
+                try
+                {
+                    const auto response{ answer( frame->first, frame->second ) };
+                    if( frame->first == 'B' || frame->first == 'C' )
+                    {
+                        _latencies.add( Clock::now() - start );
+                    }
+                    send_frame( fd, frame->first, response );
+                }
+                catch( const std::exception & e )
+                {
+                    send_frame( fd, 'E', e.what() );
+                }
+            }
+        }
+        catch( const std::exception & e )
+        {
+            print::info( std::string{ "Dropping a client: " } + e.what() );
+        }
+    }
+
+
+private:
+    const art::Pipeline & _pipeline;
+    const unsigned _max_batch;
+    const std::chrono::microseconds _window;
+
+    std::mutex _lock;
+    std::condition_variable _ready;
+    std::deque< Job * > _queue;
+    std::atomic< bool > _stopping {};
+
+    // Connections accepted, waiting for a handler, and being talked to.
+    std::mutex _clients_lock;
+    std::condition_variable _accepted;
+    std::condition_variable _room;
+    std::deque< int > _clients;
+    std::set< int > _talking;
+    unsigned _idle {};
+
+    Latencies _latencies;
+    std::atomic< std::uint64_t > _spectra {};
+    std::atomic< std::uint64_t > _batches {};
+    std::atomic< std::uint64_t > _batched {};
+};
+
+
+sockaddr_un address( const std::filesystem::path & socket )
+{
+    sockaddr_un ret {};
+    ret.sun_family = AF_UNIX;
+    if( socket.string().size() >= sizeof( ret.sun_path ) )
+    {
+        throw Exception{ "Socket path '" + socket.string() + "' is too long." };
+    }
+    std::strcpy( ret.sun_path, socket.c_str() );
+    return ret;
+}
+
+
+// Remove the socket file when killed.
+char socket_to_remove[ sizeof( sockaddr_un::sun_path ) ] {};
+extern "C" void remove_socket( int )
+{
+    ::unlink( socket_to_remove );
+    ::_exit( 0 );
+}
+
+
+void serve( const std::filesystem::path & socket, const art::Pipeline & p )
+{
+    const auto addr{ address( socket ) };
+    const auto fd{ ::socket( AF_UNIX, SOCK_STREAM, 0 ) };
+    ::unlink( addr.sun_path );
+    if( fd < 0
+     || ::bind( fd, reinterpret_cast< const sockaddr * >( & addr ), sizeof( addr ) )
+     || ::listen( fd, SOMAXCONN ) )
+    {
+        throw Exception{ "Cannot listen on '" + socket.string() + "': " + std::strerror( errno ) };
+    }
+    std::strcpy( socket_to_remove, addr.sun_path );
+    std::signal( SIGINT, remove_socket );
+    std::signal( SIGTERM, remove_socket );
+
+    // Workers and connection handlers wait on sockets and queues; the spectra
+    // are scored on the pool by 'art::Pipeline::score()'. They are joined
+    // before 'server' goes, should accepting fail.
+    Server server{ p };
+    std::vector< std::thread > threads;
+    try
+    {
+        const auto num_workers{ std::max( opt::get( "srv.workers", task::concurrency() ), 1u ) };
+        const auto num_handlers{ std::max( opt::get( "srv.handlers", 64u ), 1u ) };
+        for( unsigned i {}; i < num_workers; ++i )
+        {
+            threads.emplace_back( [ & server ] { server.work(); } );
+        }
+        for( unsigned i {}; i < num_handlers; ++i )
+        {
+            threads.emplace_back( [ & server ] { server.handle(); } );
+        }
+
+        print::info( "Serving on '" + socket.string() + "' with " + std::to_string( num_workers )
+                   + " workers for up to " + std::to_string( num_handlers ) + " connections." );
+        while( true )
+        {
+            // Connections beyond the handlers wait in the listen backlog.
+            server.wait_for_handler();
+            const auto client{ ::accept( fd, nullptr, nullptr ) };
+            if( client < 0 )
+            {
+                if( errno == EINTR || errno == ECONNABORTED )
+                {
+                    continue;
+                }
+                throw Exception{ std::string{ "Accepting failed: " } + std::strerror( errno ) };
+            }
+            server.hand( client );
+        }
+    }
+    catch( ... )
+    {
+        server.stop();
+        for( auto & t : threads )
+        {
+            t.join();
+        }
+        ::close( fd );
+        throw;
+    }
+}
+
+
+Client::Client( const std::filesystem::path & socket )
+    : _fd{ ::socket( AF_UNIX, SOCK_STREAM, 0 ) }
+{
+    const auto addr{ address( socket ) };
+    if( _fd < 0
+     || ::connect( _fd, reinterpret_cast< const sockaddr * >( & addr ), sizeof( addr ) ) )
+    {
+        if( _fd >= 0 )
+        {
+            ::close( _fd );
+        }
+        throw Exception{ "Cannot connect to '" + socket.string() + "': " + std::strerror( errno ) };
+    }
+}
+
+
+Client::~Client()
+{
+    ::close( _fd );
+}
+
+
+std::string Client::request( char kind, const std::string & payload )
+{
+    send_frame( _fd, kind, payload );
+    auto frame{ receive_frame( _fd ) };
+    if( ! frame )
+    {
+        throw Exception{ "Server closed the connection." };
+    }
+    if( frame->first == 'E' )
+    {
+        throw Exception{ "Server error: " + frame->second };
+    }
+    return std::move( frame->second );
+}
+
+
+std::vector< std::pair< label::Num, float > >
+Client::classify( const std::vector< dat::Spectrum > & spectra )
+{
+    const auto response{ request( 'B', encode_binary( spectra ) ) };
+    const auto entry{ sizeof( std::uint32_t ) + sizeof( float ) };
+    if( response.size() != spectra.size() * entry )
+    {
+        throw Exception{ "Server answered a different number of spectra." };
+    }
+
+    std::vector< std::pair< label::Num, float > > ret( spectra.size() );
+    for( size_t i {}; i < ret.size(); ++i )
+    {
+        std::uint32_t l;
+        std::memcpy( & l, response.data() + i * entry, sizeof( l ) );
+        std::memcpy( & ret[ i ].second, response.data() + i * entry + sizeof( l ), sizeof( float ) );
+        ret[ i ].first = l;
+    }
+    return ret;
+}
+
+
+void load( const std::filesystem::path & socket
+         , const std::vector< dat::Spectrum > & spectra
+         , unsigned connections
+         , unsigned batch
+         , double seconds
+         )
+{
+    if( spectra.empty() )
+    {
+        throw Exception{ "The load generator needs some spectra to send." };
+    }
+
+    Latencies latencies;
+    std::atomic< std::uint64_t > sent {};
+    const auto start{ Clock::now() };
+    const auto deadline{ start + std::chrono::duration_cast< Clock::duration >(
+                                     std::chrono::duration< double >( seconds ) ) };
+
+    // Clients mostly block on their sockets, so each gets a thread of its own
+    // rather than one of the pool's. The first to fail stops the others.
+    std::atomic< bool > failed {};
+    std::mutex error_lock;
+    std::exception_ptr error;
+    const auto run = [ & ] ( size_t c )
+    {
+        try
+        {
+            Client client{ socket };
+            auto next{ c * batch };
+            while( ! failed && Clock::now() < deadline )
+            {
+                std::vector< dat::Spectrum > request;
+                for( unsigned i {}; i < batch; ++i )
+                {
+                    request.push_back( spectra[ next++ % spectra.size() ] );
+                }
+
+                const auto sent_at{ Clock::now() };
+                client.classify( request );
+                latencies.add( Clock::now() - sent_at );
+                sent += batch;
+            }
+        }
+        catch( ... )
+        {
+            std::lock_guard lock{ error_lock };
+            if( ! error )
+            {
+                error = std::current_exception();
+            }
+            failed = true;
+        }
+    };
+    std::vector< std::thread > clients;
+    for( unsigned c {}; c < connections; ++c )
+    {
+        clients.emplace_back( run, c );
+    }
+    for( auto & c : clients )
+    {
+        c.join();
+    }
+    if( error )
+    {
+        std::rethrow_exception( error );
+    }
+
+    const std::chrono::duration< double > elapsed{ Clock::now() - start };
+    std::cout << "client_requests " << latencies.count() << '\n'
+              << "client_spectra_per_s " << sent / elapsed.count() << '\n'
+              << "client_p50_us " << latencies.percentile( 0.5 ) << '\n'
+              << "client_p99_us " << latencies.percentile( 0.99 ) << '\n'
+              << Client{ socket }.request( 'S' );
+}
+
+
+}  // namespace srv
@@ -0,0 +1,93 @@
+#ifndef SRV_H_
+#define SRV_H_
+
+
+// In this file: a prediction daemon on a Unix domain socket, and its clients.
+//
+// Requests and responses are frames: a 1 byte kind, a 4 byte payload size
+// and the payload. Numbers are in native byte order, it is a local socket.
+//     'B' binary batch: u32 count, then count * 7810 f32 intensities;
+//         answered by count * ( u32 label, f32 score ).
+//     'C' CSV batch: one spectrum per line, 7810 comma separated intensities;
+//         answered by one "label,score" line per spectrum.
+//     'L' labels: answered by one "number,label" line per label.
+//     'S' stats: answered by one "name value" line per counter.
+// A failed request is answered by an 'E' frame holding the error message.
+
+
+#include "art.h"
+#include "dat.h"
+#include "label.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace srv
+{
+
+
+// Lock free histogram of durations in buckets growing by 2^(1/4),
+// so percentiles are accurate to about 20%.
+struct Latencies
+{
+    void add( std::chrono::nanoseconds );
+    std::uint64_t count() const;
+    // In microseconds, 'p' from 0 to 1.
+    double percentile( double p ) const;
+
+private:
+    std::array< std::atomic< std::uint64_t >, 128 > _buckets {};
+};
+
+
+// Answer requests with the pipeline until killed.
+// Requests from all connections are gathered into micro-batches,
+// each predicted by one of the workers.
+// Options: srv.workers - '-j' by default,
+//          srv.handlers - most connections talked to at once, 64 by default,
+//                         others wait to be accepted,
+//          srv.batch - most spectra in a micro-batch,
+//          srv.window_us - longest wait for a micro-batch to fill.
+void serve( const std::filesystem::path & socket, const art::Pipeline & );
+
+
+struct Client
+{
+    Client( const std::filesystem::path & socket );
+    ~Client();
+    Client( const Client & ) = delete;
+    Client & operator=( const Client & ) = delete;
+
+    // A 'B' request.
+    std::vector< std::pair< label::Num, float > > classify( const std::vector< dat::Spectrum > & );
+
+    // Any request with a text answer.
+    std::string request( char kind, const std::string & payload = {} );
+
+private:
+    const int _fd;
+};
+
+
+// Load generator: 'connections' clients send batches of 'batch' spectra
+// for 'seconds', each waiting for its answer before sending again.
+// Prints the client side throughput and latencies, then the server's stats.
+void load( const std::filesystem::path & socket
+         , const std::vector< dat::Spectrum > &
+         , unsigned connections
+         , unsigned batch
+         , double seconds
+         );
+
+
+}  // namespace srv
+
+
+#endif  // defined(SRV_H_)
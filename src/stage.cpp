@@ -0,0 +1,181 @@
+#include "stage.h"
+
+#include "io.h"
+#include "model.h"
+#include "task.h"
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+
+namespace stage
+{
+
+
+using Clock = std::chrono::steady_clock;
+
+
+// Spectra of consecutive files, the first of them being 'first'.
+struct Batch
+{
+    size_t _first;
+    std::vector< dat::Spectrum > _spectra;
+    std::vector< label::Num > _labels;
+};
+
+
+// The first exception of any stage.
+struct Failure
+{
+    void set()
+    {
+        std::lock_guard lock{ _lock };
+        if( ! _error )
+        {
+            _error = std::current_exception();
+        }
+    }
+
+    std::mutex _lock;
+    std::exception_ptr _error;
+};
+
+
+// Transform the batches of 'in' into 'out', until 'in' is drained or either fails.
+// Closes 'out' and abandons 'in' when done, so both neighbours stop too.
+void relay( Queue< Batch > & in
+          , Queue< Batch > & out
+          , const std::function< void ( Batch & ) > & f
+          , std::chrono::duration< double > & busy
+          , Failure & failure
+          )
+{
+    try
+    {
+        while( auto b{ in.pop() } )
+        {
+            const auto start{ Clock::now() };
+            f( * b );
+            busy += Clock::now() - start;
+            if( ! out.push( std::move( * b ) ) )
+            {
+                break;
+            }
+        }
+    }
+    catch( ... )
+    {
+        failure.set();
+    }
+    in.abandon();
+    out.close();
+}
+
+
+Busy classify( const art::Pipeline & p
+             , const std::vector< std::filesystem::path > & files
+             , const std::function< void ( size_t, label::Num ) > & out
+             , size_t batch
+             , size_t depth
+             )
+{
+    batch = std::max< size_t >( batch, 1 );
+    depth = std::max< size_t >( depth, 1 );
+    const auto batched{ model::Registry::get().at( p._model_name )._traits.batch };
+
+    Busy busy;
+    Failure failure;
+    Queue< Batch > read{ depth };
+    Queue< Batch > preprocessed{ depth };
+    Queue< Batch > predicted{ depth };
+
+    // Each stage spreads its batch over the pool.
+    std::thread reader{ [ & ]
+        {
+            try
+            {
+                for( size_t first {}; first < files.size(); first += batch )
+                {
+                    const auto start{ Clock::now() };
+                    Batch b{ first, std::vector< dat::Spectrum >( std::min( batch, files.size() - first ) ), {} };
+                    task::parallel_for( b._spectra.size(), [ & ] ( size_t i )
+                        {
+                            b._spectra[ i ] = io::read_csv( files[ first + i ] );
+                        } );
+                    busy._read += Clock::now() - start;
+                    if( ! read.push( std::move( b ) ) )
+                    {
+                        break;
+                    }
+                }
+            }
+            catch( ... )
+            {
+                failure.set();
+            }
+            read.close();
+        } };
+
+    std::thread preprocessor{ [ & ]
+        {
+            relay( read, preprocessed, [ & p ] ( Batch & b )
+                {
+                    task::parallel_for( b._spectra.size(), [ & ] ( size_t i ) { p.preprocess( b._spectra[ i ] ); } );
+                }
+                 , busy._preprocess, failure );
+        } };
+
+    std::thread predictor{ [ & ]
+        {
+            relay( preprocessed, predicted, [ & p, batched ] ( Batch & b )
+                {
+                    b._labels.resize( b._spectra.size() );
+                    if( batched )
+                    {
+                        const auto scored{ p._model->score_batch( b._spectra ) };
+                        std::transform( scored.cbegin(), scored.cend(), b._labels.begin()
+                                      , [] ( const model::Scored & s ) { return s.label; } );
+                    }
+                    else
+                    {
+                        task::parallel_for( b._spectra.size(), [ & ] ( size_t i )
+                            {
+                                b._labels[ i ] = p._model->predict( b._spectra[ i ] );
+                            } );
+                    }
+                    // Not needed further down.
+                    b._spectra.clear();
+                }
+                 , busy._predict, failure );
+        } };
+
+    try
+    {
+        while( const auto b{ predicted.pop() } )
+        {
+            for( size_t i {}; i < b->_labels.size(); ++i )
+            {
+                out( b->_first + i, b->_labels[ i ] );
+            }
+        }
+    }
+    catch( ... )
+    {
+        failure.set();
+    }
+    predicted.abandon();
+
+    reader.join();
+    preprocessor.join();
+    predictor.join();
+    if( failure._error )
+    {
+        std::rethrow_exception( failure._error );
+    }
+    return busy;
+}
+
+
+}  // namespace stage
@@ -0,0 +1,147 @@
+#ifndef STAGE_H_
+#define STAGE_H_
+
+
+// In this file: bulk classification in concurrent stages.
+//
+// Parsing, preprocessing and predicting run at once, each stage on batches
+// of spectra, connected by bounded lock-free queues. A full queue blocks
+// its producer, so memory stays within the queues' capacity and the
+// throughput approaches the slowest stage's.
+
+
+#include "art.h"
+#include "label.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+namespace stage
+{
+
+
+// A bounded queue of one producer and one consumer, without locks.
+// Blocking, when full or empty, waits on the counters themselves.
+template< typename T >
+struct Queue
+{
+    // Rounded up to a power of two.
+    Queue( size_t capacity )
+    {
+        size_t c{ 1 };
+        while( c < capacity )
+        {
+            c *= 2;
+        }
+        _slots.resize( c );
+        _mask = c - 1;
+    }
+
+
+    // Blocks while full. False once the consumer abandoned the queue.
+    bool push( T && value )
+    {
+        const auto pushed{ _pushed.load( std::memory_order_relaxed ) };
+        for( ;; )
+        {
+            const auto popped{ _popped.load( std::memory_order_acquire ) };
+            if( popped & ABANDONED )
+            {
+                return false;
+            }
+            if( ( pushed - popped ) / 2 < _slots.size() )
+            {
+                break;
+            }
+            _popped.wait( popped, std::memory_order_acquire );
+        }
+        _slots[ ( pushed / 2 ) & _mask ] = std::move( value );
+        _pushed.store( pushed + 2, std::memory_order_release );
+        _pushed.notify_one();
+        return true;
+    }
+
+
+    // Blocks while empty. Nothing once the producer closed the queue and it is drained.
+    std::optional< T > pop()
+    {
+        const auto popped{ _popped.load( std::memory_order_relaxed ) };
+        for( ;; )
+        {
+            const auto pushed{ _pushed.load( std::memory_order_acquire ) };
+            if( ( pushed & ~CLOSED ) != popped )
+            {
+                break;
+            }
+            if( pushed & CLOSED )
+            {
+                return {};
+            }
+            _pushed.wait( pushed, std::memory_order_acquire );
+        }
+        std::optional< T > ret{ std::move( _slots[ ( popped / 2 ) & _mask ] ) };
+        _popped.store( popped + 2, std::memory_order_release );
+        _popped.notify_one();
+        return ret;
+    }
+
+
+    // By the producer, after its last push.
+    void close()
+    {
+        _pushed.fetch_or( CLOSED, std::memory_order_release );
+        _pushed.notify_one();
+    }
+
+
+    // By the consumer, to stop the producer.
+    void abandon()
+    {
+        _popped.fetch_or( ABANDONED, std::memory_order_release );
+        _popped.notify_one();
+    }
+
+private:
+    // The counters hold twice the pushes and pops, wrapping around,
+    // so that their lowest bits can flag the ends; the waits need one word.
+    static constexpr std::uint32_t CLOSED{ 1 };
+    static constexpr std::uint32_t ABANDONED{ 1 };
+
+    std::vector< T > _slots;
+    size_t _mask;
+    alignas( 64 ) std::atomic< std::uint32_t > _pushed {};
+    alignas( 64 ) std::atomic< std::uint32_t > _popped {};
+};
+
+
+// Time each stage spent working, rather than waiting on its queues.
+struct Busy
+{
+    std::chrono::duration< double > _read {};
+    std::chrono::duration< double > _preprocess {};
+    std::chrono::duration< double > _predict {};
+};
+
+
+// Classify 'files' with 'p', calling 'out' with the index of every file and its
+// label in the order of the files. Rethrows the first exception of any stage.
+// 'batch' spectra go into a batch, 'depth' batches fit into a queue.
+Busy classify( const art::Pipeline & p
+             , const std::vector< std::filesystem::path > & files
+             , const std::function< void ( size_t, label::Num ) > & out
+             , size_t batch
+             , size_t depth
+             );
+
+
+}  // namespace stage
+
+
+#endif  // defined(STAGE_H_)
@@ -0,0 +1,357 @@
+#include "sweep.h"
+
+#include "dat.h"
+#include "io.h"
+#include "model.h"
+#include "opt.h"
+#include "pre.h"
+#include "print.h"
+#include "res.h"
+#include "score.h"
+#include "task.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <utility>
+
+
+namespace sweep
+{
+
+
+std::vector< Cell > plan( unsigned labels_depth_max )
+{
+    const auto seeds{ opt::get_list< unsigned >( "sweep.seeds", { 0 } ) };
+    std::vector< Cell > ret;
+    for( const auto & m : model::Registry::get().names() )
+    {
+        for( const auto & p : pre::Registry::get().names() )
+        {
+            for( auto l{ labels_depth_max }; l; --l )
+            {
+                for( const auto seed : seeds )
+                {
+                    ret.push_back( { m, { p }, l, seed } );
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+
+std::string describe( const Cell & c )
+{
+    std::string chain;
+    for( const auto & p : c._preprocessing )
+    {
+        chain += ( chain.empty() ? "" : " " ) + p;
+    }
+    return "model " + c._model
+         + ", preprocessing " + ( chain.empty() ? "none" : chain )
+         + ", labels depth " + std::to_string( c._labels_depth )
+         + ", seed " + std::to_string( c._seed );
+}
+
+
+// Admits cells while they fit, and always one if none runs.
+struct Budget
+{
+    Budget( unsigned cells, size_t bytes )
+        : _cells{ std::max( cells, 1u ) }
+        , _bytes{ bytes }
+    {
+    }
+
+
+    void acquire( size_t bytes )
+    {
+        std::unique_lock lock{ _lock };
+        _released.wait( lock, [ & ]
+            {
+                return ! _running
+                    || ( _running < _cells && ( ! _bytes || _used + bytes <= _bytes ) );
+            } );
+        ++_running;
+        _used += bytes;
+    }
+
+
+    void release( size_t bytes )
+    {
+        {
+            std::lock_guard lock{ _lock };
+            --_running;
+            _used -= bytes;
+        }
+        _released.notify_all();
+    }
+
+private:
+    const unsigned _cells;
+    const size_t _bytes;
+    unsigned _running {};
+    size_t _used {};
+    std::mutex _lock;
+    std::condition_variable _released;
+};
+
+
+using Clock = std::chrono::steady_clock;
+
+
+// A preprocessed dataset split, shared by the cells trained on it.
+struct Split
+{
+    std::pair< dat::Dataset, dat::Dataset > _traintest;
+    std::chrono::duration< double > _preprocessing;
+};
+
+
+// Reports are printed whole, one at a time.
+struct Report
+{
+    void print( const std::string & s )
+    {
+        std::lock_guard lock{ _lock };
+        _out << s << std::flush;
+    }
+
+    std::ostream & _out;
+    std::mutex _lock;
+};
+
+
+void run_cell( const Cell & c, const Split & s, const std::string & dataset, Report & r, res::Store * store )
+{
+    std::ostringstream report;
+    report << describe( c ) << '\n';
+    try
+    {
+        print::info( "Training a " + c._model + " model, " + describe( c ) + '.' );
+        const trace::Scope scope{ "cell: ", describe( c ), dat::count( s._traintest.second ) };
+        const auto start{ Clock::now() };
+        const auto m{ [ & ]
+            {
+                const trace::Scope scope{ "train:", c._model, dat::count( s._traintest.first ) };
+                return model::create( c._model, s._traintest.first );
+            }() };
+        const std::chrono::duration< double > training{ Clock::now() - start };
+        const auto e{ score::evaluate( s._traintest.second, * m, model::Registry::get().at( c._model )._traits, report ) };
+
+        if( store )
+        {
+            res::Record record{ c, dataset, static_cast< unsigned >( e._counts.size() ), {}, e._accuracy
+                              , s._preprocessing.count(), training.count(), e._predicting.count() };
+            for( label::Num truth {}; truth < record._classes; ++truth )
+            {
+                for( label::Num predicted {}; predicted < record._classes; ++predicted )
+                {
+                    record._confusion.push_back( e._counts.at( truth, predicted ) );
+                }
+            }
+            store->put( record );
+        }
+    }
+    catch( const std::exception & e )
+    {
+        report << "failed: " << e.what() << '\n';
+    }
+    r.print( report.str() );
+}
+
+
+std::vector< Cell > pending( const std::vector< Cell > & cells, const res::Store & store, const std::string & dataset )
+{
+    std::set< std::string > done;
+    for( const auto & r : store.records() )
+    {
+        if( r._dataset == dataset )
+        {
+            done.insert( describe( r._cell ) );
+        }
+    }
+
+    std::vector< Cell > ret;
+    for( const auto & c : cells )
+    {
+        if( ! done.count( describe( c ) ) )
+        {
+            ret.push_back( c );
+        }
+    }
+    if( ret.size() < cells.size() )
+    {
+        print::info( "Skipping " + std::to_string( cells.size() - ret.size() ) + " cells done already." );
+    }
+    return ret;
+}
+
+
+void run( const std::filesystem::path & data_dir
+        , const std::vector< Cell > & cells
+        , res::Store * store
+        , std::ostream & out
+        )
+{
+    const auto dataset{ io::identity( data_dir ) };
+    const auto todo{ store ? pending( cells, * store, dataset ) : cells };
+    if( todo.empty() )
+    {
+        return;
+    }
+
+    const auto deepest{ std::max_element( todo.cbegin(), todo.cend(), [] ( const Cell & a, const Cell & b )
+        {
+            return a._labels_depth < b._labels_depth;
+        } )->_labels_depth };
+
+    // Relabelling would leave those files out of the shallower depths.
+    if( io::csvs_above( data_dir, deepest ) )
+    {
+        print::warn( "Spectra lie above labels depth " + std::to_string( deepest ) + " in '" + data_dir.string()
+                   + "', reading the dataset at every labels depth on its own." );
+        std::map< unsigned, std::vector< Cell >, std::greater<> > by_depth;
+        for( const auto & c : todo )
+        {
+            by_depth[ c._labels_depth ].push_back( c );
+        }
+        for( const auto & [ depth, depth_cells ] : by_depth )
+        {
+            const auto raw{ [ & ]
+                {
+                    const trace::Scope scope{ "read" };
+                    return io::read( data_dir, depth );
+                }() };
+            run( raw, dataset, depth_cells, store, out );
+        }
+        return;
+    }
+
+    print::info( "Reading dataset '" + data_dir.string() + "' at labels depth " + std::to_string( deepest ) );
+    const auto raw{ [ & ]
+        {
+            const trace::Scope scope{ "read" };
+            return io::read( data_dir, deepest );
+        }() };
+    run( raw, dataset, todo, store, out );
+}
+
+
+void run( const dat::DataRaw & raw
+        , const std::string & identity
+        , const std::vector< Cell > & cells
+        , res::Store * store
+        , std::ostream & out
+        )
+{
+    // The graph: depths, deepest first, then preprocessing chains, then splits, then cells.
+    using Splits = std::map< unsigned, std::vector< const Cell * > >;
+    using Chains = std::map< std::vector< std::string >, Splits >;
+    std::map< unsigned, Chains, std::greater<> > graph;
+    for( const auto & c : cells )
+    {
+        graph[ c._labels_depth ][ c._preprocessing ][ c._seed ].push_back( & c );
+    }
+
+    Budget budget{ opt::get( "sweep.parallel", std::max( task::concurrency() / 4, 1u ) )
+                 , opt::get( "sweep.memory_mb", size_t{} ) << 20 };
+    Report report{ out, {} };
+    std::vector< task::Future< void > > running;
+
+    // The cells running refer to 'budget' and 'report', so should anything
+    // throw, those not started are cancelled and the others waited for.
+    try
+    {
+        for( const auto & [ depth, chains ] : graph )
+        {
+            print::info( "Relabelling the dataset to labels depth " + std::to_string( depth ) );
+            const auto dataset{ [ & ]
+                {
+                    const trace::Scope scope{ "relabel" };
+                    return dat::encode( dat::coarsen( raw, depth ) );
+                }() };
+
+            for( const auto & [ chain, splits ] : chains )
+            {
+                dat::Dataset preprocessed;
+                std::chrono::duration< double > preprocessing {};
+                try
+                {
+                    const auto start{ Clock::now() };
+                    preprocessed = dataset;
+                    for( const auto & op : chain )
+                    {
+                        print::info( "Preprocessing dataset via '" + op + "' algo." );
+                        const trace::Scope scope{ "pre:", op, dat::count( preprocessed ) };
+                        const auto algo{ pre::create( op, preprocessed ) };
+                        preprocessed = ( * algo )( preprocessed );
+                    }
+                    preprocessing = Clock::now() - start;
+                }
+                catch( const std::exception & e )
+                {
+                    for( const auto & kv : splits )
+                    {
+                        for( const auto c : kv.second )
+                        {
+                            report.print( describe( * c ) + "\nfailed: " + e.what() + '\n' );
+                        }
+                    }
+                    continue;
+                }
+
+                for( const auto & [ seed, split_cells ] : splits )
+                {
+                    // Freed by the last cell of the split.
+                    const auto split{ std::make_shared< const Split >( Split{ dat::split( preprocessed, 0.66, seed )
+                                                                            , preprocessing } ) };
+                    const auto bytes{ dat::count( split->_traintest.first ) * sizeof( dat::Spectrum ) };
+                    for( const auto c : split_cells )
+                    {
+                        budget.acquire( bytes );
+                        running.push_back( task::async( [ c, split, bytes, store, & identity, & budget, & report ]
+                            {
+                                run_cell( * c, * split, identity, report, store );
+                                budget.release( bytes );
+                            } ) );
+                    }
+                }
+            }
+        }
+
+        for( auto & r : running )
+        {
+            r.get();
+        }
+    }
+    catch( ... )
+    {
+        for( auto & r : running )
+        {
+            if( r.valid() )
+            {
+                r.cancel();
+            }
+        }
+        for( auto & r : running )
+        {
+            if( r.valid() )
+            {
+                r.wait();
+            }
+        }
+        throw;
+    }
+}
+
+
+}  // namespace sweep
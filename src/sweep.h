@@ -0,0 +1,82 @@
+#ifndef SWEEP_H_
+#define SWEEP_H_
+
+
+// In this file: the sweep of all models, preprocessings and labels depths.
+//
+// The sweep is planned as a graph rather than run cell by cell. The dataset
+// is read once, at the deepest labels depth, and coarser depths relabel it;
+// unless .csv files lie above that depth, when every depth is read on its own.
+// Every preprocessing of a depth is computed and split once, then shared by
+// all cells training a model on it. Cells run concurrently on the thread
+// pool, within a budget of cells and of memory.
+
+
+#include "dat.h"
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+namespace res
+{
+struct Store;
+}
+
+
+namespace sweep
+{
+
+
+// One experiment: a model trained on a preprocessed dataset and evaluated.
+struct Cell
+{
+    std::string _model;
+    std::vector< std::string > _preprocessing;
+    unsigned _labels_depth;
+    // Of the train and test split.
+    unsigned _seed;
+};
+
+
+// E.g. "model svm, preprocessing log, labels depth 2, seed 0".
+std::string describe( const Cell & );
+
+
+// Every model on every single preprocessing, at labels depths 'labels_depth_max' to 1.
+// Option sweep.seeds - the splits to try each on, 0 by default.
+std::vector< Cell > plan( unsigned labels_depth_max );
+
+
+// The cells not recorded into the store yet for 'dataset', see 'io::identity()'.
+// Records of other datasets are left alone.
+std::vector< Cell > pending( const std::vector< Cell > &, const res::Store &, const std::string & dataset );
+
+
+// Print the evaluation of every cell to 'out', as each finishes, and record it
+// into 'store' if any. Cells already in the store are skipped.
+// A cell that throws is reported and does not stop the others.
+// Options: sweep.parallel - most cells at once,
+//          sweep.memory_mb - most training data of the cells at once, 0 for no limit.
+void run( const std::filesystem::path & data_dir
+        , const std::vector< Cell > &
+        , res::Store * store = nullptr
+        , std::ostream & out = std::cout
+        );
+
+// The same on a dataset read already, at least as deep as the deepest cell,
+// recorded as of 'dataset'. Runs every cell given, recorded into the store or not.
+void run( const dat::DataRaw &
+        , const std::string & dataset
+        , const std::vector< Cell > &
+        , res::Store * store = nullptr
+        , std::ostream & out = std::cout
+        );
+
+
+}  // namespace sweep
+
+
+#endif  // defined(SWEEP_H_)
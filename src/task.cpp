@@ -1,53 +1,346 @@
 #include "task.h"
 
-#include "label.h"
-
-#include <future>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <limits>
 #include <thread>
-#include <vector>
 
 
 namespace task
 {
 
 
-void run_async( std::promise< std::vector< label::Num > > & p
-              , const model::Base & m
-              , const std::vector< dat::Spectrum > & spectra )
+unsigned & concurrency_storage()
+{
+    static unsigned c{ std::max( std::thread::hardware_concurrency(), 1u ) };
+    return c;
+}
+
+
+void set_concurrency( unsigned c )
+{
+    concurrency_storage() = std::max( c, 1u );
+}
+
+
+unsigned concurrency()
+{
+    return concurrency_storage();
+}
+
+
+using Job = std::function< void () >;
+
+
+struct Queue
+{
+    std::mutex _lock;
+    std::deque< Job > _jobs;
+};
+
+
+struct Pool
+{
+    static Pool & get()
+    {
+        // The threads waiting on the workers make up the rest.
+        static Pool p{ std::max( concurrency(), 2u ) - 1 };
+        return p;
+    }
+
+
+    Pool( unsigned workers )
+    {
+        for( unsigned w {}; w < workers; ++w )
+        {
+            _queues.push_back( std::make_unique< Queue >() );
+        }
+        for( unsigned w {}; w < workers; ++w )
+        {
+            _threads.emplace_back( [ this, w ] { work( w ); } );
+        }
+    }
+
+
+    ~Pool()
+    {
+        {
+            std::lock_guard lock{ _sleep_lock };
+            _stop = true;
+        }
+        _wake.notify_all();
+        for( auto & t : _threads )
+        {
+            t.join();
+        }
+    }
+
+
+    // Workers push onto their own queue, other threads onto the shared one.
+    void submit( Job && j )
+    {
+        auto & q{ _index < _queues.size() ? * _queues[ _index ] : _shared };
+        // Counted first, so that popping it cannot take the count below zero.
+        ++_pending;
+        {
+            std::lock_guard lock{ q._lock };
+            q._jobs.push_back( std::move( j ) );
+        }
+        // Taken so that a worker cannot miss the job between checking and sleeping.
+        {
+            std::lock_guard lock{ _sleep_lock };
+        }
+        _wake.notify_one();
+    }
+
+
+    // The newest job of our own, the oldest shared one, or the oldest of another worker.
+    bool pop( Job & j )
+    {
+        const auto take = [ & ] ( Queue & q, bool newest )
+        {
+            std::lock_guard lock{ q._lock };
+            if( q._jobs.empty() )
+            {
+                return false;
+            }
+            if( newest )
+            {
+                j = std::move( q._jobs.back() );
+                q._jobs.pop_back();
+            }
+            else
+            {
+                j = std::move( q._jobs.front() );
+                q._jobs.pop_front();
+            }
+            --_pending;
+            return true;
+        };
+
+        const auto n{ _queues.size() };
+        if( _index < n && take( * _queues[ _index ], true ) )
+        {
+            return true;
+        }
+        if( take( _shared, false ) )
+        {
+            return true;
+        }
+        const auto first{ _index < n ? _index + 1 : 0 };
+        for( size_t k {}; k < n; ++k )
+        {
+            if( take( * _queues[ ( first + k ) % n ], false ) )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    void work( size_t index )
+    {
+        _index = index;
+        for( ;; )
+        {
+            Job j;
+            if( pop( j ) )
+            {
+                j();
+                continue;
+            }
+            std::unique_lock lock{ _sleep_lock };
+            _wake.wait( lock, [ this ] { return _stop || _pending > 0; } );
+            if( _stop )
+            {
+                return;
+            }
+        }
+    }
+
+private:
+    std::vector< std::unique_ptr< Queue > > _queues;
+    Queue _shared;
+    std::vector< std::thread > _threads;
+    std::atomic< size_t > _pending {};
+    std::mutex _sleep_lock;
+    std::condition_variable _wake;
+    bool _stop {};
+
+    // Of the worker this thread is, else past the last one.
+    static thread_local size_t _index;
+};
+
+
+thread_local size_t Pool::_index{ std::numeric_limits< size_t >::max() };
+
+
+void submit( std::function< void () > && job )
+{
+    Pool::get().submit( std::move( job ) );
+}
+
+
+bool run_one()
 {
-    std::vector< label::Num > ret;
-    for( const auto & s : spectra )
+    Job j;
+    if( ! Pool::get().pop( j ) )
     {
-        ret.push_back( m.predict( s ) );
+        return false;
     }
-    p.set_value( ret );
+    j();
+    return true;
 }
 
 
-Task::Task( const model::Base & m, const std::vector< dat::Spectrum > & s )
-        : _p{ }
-        , _t{ run_async, std::ref( _p ), std::ref( m ), std::ref( s ) }
+// Shared with the helpers, which may start after 'parallel_for()' returns.
+struct Loop
 {
+    size_t _n;
+    const std::function< void ( size_t ) > * _f;
+    std::atomic< size_t > _next {};
+    std::atomic< unsigned > _running {};
+    std::atomic< bool > _closed {};
+    std::mutex _error_lock;
+    std::exception_ptr _error;
+
+    void work()
+    {
+        for( auto i{ _next++ }; i < _n; i = _next++ )
+        {
+            try
+            {
+                ( * _f )( i );
+            }
+            catch( ... )
+            {
+                std::lock_guard lock{ _error_lock };
+                if( ! _error )
+                {
+                    _error = std::current_exception();
+                }
+                _next = _n;
+            }
+        }
+    }
+};
+
+
+void parallel_for( size_t n
+                 , const std::function< void ( size_t ) > & f
+                 , unsigned threads )
+{
+    const auto loop{ std::make_shared< Loop >() };
+    loop->_n = n;
+    loop->_f = & f;
+
+    const auto helpers{ std::min< size_t >( std::max( threads, 1u ), n ) };
+    for( size_t h { 1 }; h < helpers; ++h )
+    {
+        submit( [ loop ]
+            {
+                ++loop->_running;
+                // Once closed 'f' may be gone.
+                if( ! loop->_closed )
+                {
+                    loop->work();
+                }
+                if( --loop->_running == 0 )
+                {
+                    loop->_running.notify_all();
+                }
+            } );
+    }
+    loop->work();
+
+    // Helpers not started by now never call 'f', wait only for the others.
+    loop->_closed = true;
+    for( auto r{ loop->_running.load() }; r; r = loop->_running.load() )
+    {
+        loop->_running.wait( r );
+    }
+
+    if( loop->_error )
+    {
+        std::rethrow_exception( loop->_error );
+    }
 }
 
 
-std::vector< label::Num > Task::get()
+namespace detail
+{
+
+
+void Control::wait()
 {
-    _t.join();
-    return _p.get_future().get();
+    while( ! done() )
+    {
+        if( ! run_one() )
+        {
+            // Jobs submitted meanwhile do not wake us, hence the timeout.
+            std::unique_lock lock{ _lock };
+            _finished.wait_for( lock, std::chrono::milliseconds{ 1 }, [ this ] { return done(); } );
+        }
+    }
 }
 
 
-// 1. Despite all this effort, moving a Task object
-// (for example by a vector rellocating its storage)
-// causes a weird crash.
-// For now the workaround is to allocate enough memory in the container.
-// 2. The threads bog down the machine, implement limit on their number.
-Task::Task( Task && t )
-    : _p{ std::move( t._p ) }
+bool Control::done() const
 {
-    _t.swap( t._t );
+    return _state == DONE;
 }
 
 
+void Control::finish( std::exception_ptr e )
+{
+    std::vector< std::function< void () > > continuations;
+    {
+        std::lock_guard lock{ _lock };
+        _error = e;
+        _state = DONE;
+        continuations.swap( _continuations );
+    }
+    _finished.notify_all();
+    for( auto & c : continuations )
+    {
+        submit( std::move( c ) );
+    }
+}
+
+
+void Control::then( std::function< void () > && c )
+{
+    {
+        std::lock_guard lock{ _lock };
+        if( _state != DONE )
+        {
+            _continuations.push_back( std::move( c ) );
+            return;
+        }
+    }
+    submit( std::move( c ) );
+}
+
+
+bool Control::start()
+{
+    auto expected{ PENDING };
+    return _state.compare_exchange_strong( expected, RUNNING );
+}
+
+
+void Control::cancel()
+{
+    if( start() )
+    {
+        finish( std::make_exception_ptr( Cancelled{} ) );
+    }
+}
+
+
+}  // namespace detail
+
+
 }  // namespace task
@@ -2,40 +2,250 @@
 #define TASK_H_
 
 
-// In this file: multithreaded model evaluation; training is far too specific to generalise so.
+// In this file: the process-wide thread pool all parallel work runs on.
+//
+// A fixed number of workers, 'concurrency()' in all with the threads waiting
+// on them, each with its own deque of jobs: a worker pushes and pops at the
+// back of its own, idle workers steal from the front of the others'.
+// Threads outside the pool submit into a shared queue. Waiting on a future
+// runs other jobs meanwhile, so nested parallelism never deadlocks nor adds threads.
+
+
+#include "except.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 
 
-#include "dat.h"
-#include "label.h"
-#include "model.h"
+namespace task
+{
 
-#include <vector>
-#include <future>
-#include <thread>
 
+// Upper bound on the threads the program runs at once.
+// All cores by default, see '-j'. The pool is sized on its first use,
+// later calls only limit 'parallel_for()'.
+void set_concurrency( unsigned );
+unsigned concurrency();
 
-namespace task
+
+// Call 'f( i )' for every i in [0, n) on up to 'threads' threads of the pool,
+// the calling one included. Rethrows the first exception thrown by 'f',
+// after all calls in progress finish; the calls not started are skipped.
+void parallel_for( size_t n
+                 , const std::function< void ( size_t ) > & f
+                 , unsigned threads = concurrency() );
+
+
+// Got from a future whose job was cancelled before it started.
+struct Cancelled : Exception
+{
+    Cancelled()
+        : Exception( "The task was cancelled." ) { }
+};
+
+
+// Run 'job' on the pool.
+void submit( std::function< void () > && job );
+
+// Run one pending job on this thread; false if there was none.
+bool run_one();
+
+
+template< typename T >
+struct Future;
+
+
+namespace detail
+{
+
+
+// What a job and its future share.
+struct Control
 {
+    // Blocks until 'done()', running pending jobs meanwhile.
+    void wait();
+    bool done() const;
+
+    // The continuations run on the pool.
+    void finish( std::exception_ptr );
+    // Runs 'c' on the pool once finished.
+    void then( std::function< void () > && c );
+
+    // Claims the job to start it; false if cancelled or started already.
+    bool start();
+    // Finishes the job with 'Cancelled' unless started.
+    void cancel();
+
+private:
+    enum State { PENDING, RUNNING, DONE };
+    std::atomic< State > _state{ PENDING };
+    std::mutex _lock;
+    std::condition_variable _finished;
+    std::exception_ptr _error;
+    std::vector< std::function< void () > > _continuations;
+
+    template< typename T >
+    friend struct task::Future;
+};
 
 
-struct Task
+template< typename T >
+struct Shared
 {
-    Task( const model::Base &, const std::vector< dat::Spectrum > & );
-    std::vector< label::Num > get();
+    using Value = std::conditional_t< std::is_void_v< T >, std::monostate, T >;
+
+    Control _control;
+    std::optional< Value > _value;
+};
 
-    Task( Task && );
-    Task( const Task & ) = delete;
-    ~Task() = default;
-    Task & operator=( Task && other) = delete;
-    Task & operator=(const Task & other) = delete;
 
+// Run 'f' and keep its result or exception in 's'.
+template< typename T, typename F >
+void run( Shared< T > & s, F & f )
+{
+    try
+    {
+        if constexpr( std::is_void_v< T > )
+        {
+            f();
+            s._value.emplace();
+        }
+        else
+        {
+            s._value.emplace( f() );
+        }
+        s._control.finish( nullptr );
+    }
+    catch( ... )
+    {
+        s._control.finish( std::current_exception() );
+    }
+}
+
+
+}  // namespace detail
+
+
+// The result of a job on the pool, consumed by either 'get()' or 'then()'.
+template< typename T >
+struct Future
+{
+    Future() = default;
+    explicit Future( std::shared_ptr< detail::Shared< T > > s )
+        : _shared{ std::move( s ) } { }
+    Future( Future && ) = default;
+    Future & operator=( Future && ) = default;
+    Future( const Future & ) = delete;
+    Future & operator=( const Future & ) = delete;
+
+    bool valid() const
+    {
+        return static_cast< bool >( _shared );
+    }
+
+    bool ready() const
+    {
+        return _shared->_control.done();
+    }
+
+    // Runs other jobs meanwhile.
+    void wait() const
+    {
+        _shared->_control.wait();
+    }
+
+    // Rethrows what the job threw, 'Cancelled' if it never ran.
+    T get()
+    {
+        const auto s{ std::move( _shared ) };
+        s->_control.wait();
+        if( s->_control._error )
+        {
+            std::rethrow_exception( s->_control._error );
+        }
+        if constexpr( ! std::is_void_v< T > )
+        {
+            return std::move( * s->_value );
+        }
+    }
+
+    // Skips the job if it has not started yet, a started one runs to its end.
+    // Continuations are cancelled in turn.
+    void cancel()
+    {
+        _shared->_control.cancel();
+    }
+
+    // Runs 'f' on the result, on the pool, once ready. Exceptions, cancellation
+    // included, skip 'f' and pass on to the future returned. This one is left
+    // to 'cancel()' or wait on, its result going to 'f' rather than 'get()'.
+    template< typename F >
+    auto then( F && f )
+    {
+        using R = std::conditional_t< std::is_void_v< T >
+                                    , std::invoke_result< F >
+                                    , std::invoke_result< F, T > >;
+        using U = typename R::type;
+        auto next{ std::make_shared< detail::Shared< U > >() };
+        auto prev{ _shared };
+        prev->_control.then( [ prev, next, f{ std::forward< F >( f ) } ] () mutable
+            {
+                if( ! next->_control.start() )
+                {
+                    return;
+                }
+                if( prev->_control._error )
+                {
+                    next->_control.finish( prev->_control._error );
+                    return;
+                }
+                auto call = [ & ] () -> U
+                {
+                    if constexpr( std::is_void_v< T > )
+                    {
+                        return f();
+                    }
+                    else
+                    {
+                        return f( std::move( * prev->_value ) );
+                    }
+                };
+                detail::run( * next, call );
+            } );
+        return Future< U >{ std::move( next ) };
+    }
 
 private:
-    std::promise< std::vector< label::Num > > _p;
-    std::thread _t;
+    std::shared_ptr< detail::Shared< T > > _shared;
 };
 
 
+// Run 'f()' on the pool.
+template< typename F >
+auto async( F && f )
+{
+    using T = std::invoke_result_t< F >;
+    auto s{ std::make_shared< detail::Shared< T > >() };
+    submit( [ s, f{ std::forward< F >( f ) } ] () mutable
+        {
+            if( s->_control.start() )
+            {
+                detail::run( * s, f );
+            }
+        } );
+    return Future< T >{ std::move( s ) };
+}
+
+
 }  // namespace task
 
 
@@ -0,0 +1,162 @@
+#include "trace.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace trace
+{
+
+
+using Clock = std::chrono::steady_clock;
+
+
+std::atomic< bool > on {};
+Clock::time_point origin;
+
+
+void start()
+{
+    if( ! on )
+    {
+        origin = Clock::now();
+        on = true;
+    }
+}
+
+
+bool enabled()
+{
+    return on.load( std::memory_order_relaxed );
+}
+
+
+struct Event
+{
+    std::string _name;
+    size_t _count;
+    Clock::time_point _start;
+    Clock::duration _duration;
+};
+
+
+// Of a thread, numbered from 1 in the order they first record.
+// The lock is contended only while writing the trace.
+struct Buffer
+{
+    unsigned _thread {};
+    std::mutex _lock;
+    std::vector< Event > _events;
+};
+
+
+// Outlive their threads, whose scopes are kept until written.
+struct Buffers
+{
+    std::mutex _lock;
+    std::vector< std::unique_ptr< Buffer > > _all;
+};
+
+
+Buffers & buffers()
+{
+    static Buffers b;
+    return b;
+}
+
+
+Buffer & local()
+{
+    thread_local Buffer * ret {};
+    if( ! ret )
+    {
+        auto & b{ buffers() };
+        std::lock_guard lock{ b._lock };
+        b._all.push_back( std::make_unique< Buffer >() );
+        ret = b._all.back().get();
+        ret->_thread = static_cast< unsigned >( b._all.size() );
+    }
+    return * ret;
+}
+
+
+Scope::Scope( const char * name, size_t count )
+    : Scope{ name, {}, count }
+{
+}
+
+
+Scope::Scope( const char * name, const std::string & detail, size_t count )
+    : _count{ count }
+{
+    if( enabled() )
+    {
+        _name = name + detail;
+        _start = Clock::now();
+    }
+}
+
+
+Scope::~Scope()
+{
+    if( _start == Clock::time_point{} )
+    {
+        return;
+    }
+    const auto duration{ Clock::now() - _start };
+    auto & b{ local() };
+    std::lock_guard lock{ b._lock };
+    b._events.push_back( { std::move( _name ), _count, _start, duration } );
+}
+
+
+// Names are ours, only quotes and backslashes need escaping.
+std::string quoted( const std::string & s )
+{
+    std::string ret{ '"' };
+    for( const auto c : s )
+    {
+        if( c == '"' || c == '\\' )
+        {
+            ret += '\\';
+        }
+        ret += c;
+    }
+    return ret + '"';
+}
+
+
+void write_json( std::ostream & out )
+{
+    const auto pid{ ::getpid() };
+    const auto us = [] ( Clock::duration d ) { return std::chrono::duration< double, std::micro >{ d }.count(); };
+
+    auto & b{ buffers() };
+    std::lock_guard lock{ b._lock };
+    out << std::fixed << std::setprecision( 3 ) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char * separator{ "\n" };
+    for( const auto & thread : b._all )
+    {
+        std::lock_guard thread_lock{ thread->_lock };
+        out << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid
+            << ", \"tid\": " << thread->_thread
+            << ", \"args\": {\"name\": \"thread " << thread->_thread << "\"}}";
+        separator = ",\n";
+        for( const auto & e : thread->_events )
+        {
+            out << separator << "{\"name\": " << quoted( e._name ) << ", \"cat\": \"rocks\", \"ph\": \"X\""
+                << ", \"pid\": " << pid << ", \"tid\": " << thread->_thread
+                << ", \"ts\": " << us( e._start - origin ) << ", \"dur\": " << us( e._duration )
+                << ", \"args\": {\"count\": " << e._count << "}}";
+        }
+    }
+    out << "\n]}\n" << std::defaultfloat << std::flush;
+}
+
+
+}  // namespace trace
@@ -0,0 +1,56 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+
+// In this file: a trace of where the time goes, for chrome://tracing or Perfetto.
+//
+// Scoped timers mark stages: each records its name, the thread it ran on,
+// its start, duration and a count of the items it processed into a buffer of
+// that thread. Off unless started, when a scope costs a check of a flag: its
+// name is joined from a literal and a detail only if on.
+
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+
+namespace trace
+{
+
+
+// Record scopes from now on.
+void start();
+bool enabled();
+
+
+// Records from construction to destruction, if enabled at construction,
+// named 'name' followed by 'detail', e.g. "pre:" and the operation.
+struct Scope
+{
+    explicit Scope( const char * name, size_t count = 0 );
+    Scope( const char * name, const std::string & detail, size_t count = 0 );
+    ~Scope();
+    Scope( const Scope & ) = delete;
+    Scope & operator=( const Scope & ) = delete;
+
+    // Known only once done, e.g. spectra predicted.
+    void count( size_t c ) { _count = c; }
+
+private:
+    std::string _name;
+    size_t _count;
+    std::chrono::steady_clock::time_point _start;
+};
+
+
+// In the Trace Event Format, complete events with their count as an argument.
+// Scopes of other threads still running are left out.
+void write_json( std::ostream & );
+
+
+}  // namespace trace
+
+
+#endif  // defined(TRACE_H_)
@@ -0,0 +1,881 @@
+#include "tree.h"
+
+#include "except.h"
+#include "task.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+
+
+namespace tree
+{
+
+
+// Rows sampled for the quantiles; more only slows down sorting.
+constexpr size_t QUANTILE_SAMPLE{ 1u << 14 };
+
+
+Binned::Binned( const std::vector< const double * > & rows
+              , size_t num_features
+              , unsigned max_bins
+              , unsigned threads )
+    : _num_rows{ rows.size() }
+    , _num_features{ num_features }
+    , _edges( num_features )
+    , _bins( num_features * rows.size() )
+{
+    max_bins = std::clamp( max_bins, 2u, MAX_BINS );
+    const auto stride{ std::max< size_t >( rows.size() / QUANTILE_SAMPLE, 1 ) };
+
+    task::parallel_for( num_features
+                      , [ & ] ( size_t f )
+        {
+            std::vector< double > values;
+            for( size_t r {}; r < rows.size(); r += stride )
+            {
+                values.push_back( rows[ r ][ f ] );
+            }
+            if( values.empty() )
+            {
+                return;
+            }
+            std::sort( values.begin(), values.end() );
+
+            // Every bin holds at least one sampled value.
+            auto & edges{ _edges[ f ] };
+            for( unsigned b{ 1 }; b < max_bins; ++b )
+            {
+                const auto v{ values[ b * values.size() / max_bins ] };
+                if( v > ( edges.empty() ? values.front() : edges.back() ) )
+                {
+                    edges.push_back( v );
+                }
+            }
+
+            const auto column{ & _bins[ f * _num_rows ] };
+            for( size_t r {}; r < _num_rows; ++r )
+            {
+                const auto it{ std::upper_bound( edges.cbegin(), edges.cend(), rows[ r ][ f ] ) };
+                column[ r ] = static_cast< std::uint8_t >( it - edges.cbegin() );
+            }
+        }
+                      , threads );
+}
+
+
+size_t Binned::num_rows() const
+{
+    return _num_rows;
+}
+
+
+size_t Binned::num_features() const
+{
+    return _num_features;
+}
+
+
+const std::uint8_t * Binned::column( size_t feature ) const
+{
+    return & _bins[ feature * _num_rows ];
+}
+
+
+unsigned Binned::bins( size_t feature ) const
+{
+    return static_cast< unsigned >( _edges[ feature ].size() + 1 );
+}
+
+
+double Binned::edge( size_t feature, unsigned bin ) const
+{
+    return _edges[ feature ][ bin ];
+}
+
+
+Flat::Flat( art::Reader & r )
+    : _nodes{ r.get_vector< Node >() }
+    , _roots{ r.get_vector< std::uint32_t >() }
+{
+}
+
+
+void Flat::check( size_t num_features, size_t num_leaves ) const
+{
+    // Children follow their parent, so walks cannot loop.
+    for( size_t i {}; i < _nodes.size(); ++i )
+    {
+        const auto & n{ _nodes[ i ] };
+        if( n.feature == LEAF ? n.next >= num_leaves
+                              : n.feature >= num_features || n.next <= i || size_t{ n.next } + 1 >= _nodes.size() )
+        {
+            throw Exception{ "Corrupt decision tree." };
+        }
+    }
+    for( const auto r : _roots )
+    {
+        if( r >= _nodes.size() )
+        {
+            throw Exception{ "Corrupt decision tree." };
+        }
+    }
+}
+
+
+void Flat::save( art::Writer & w ) const
+{
+    w.put( _nodes );
+    w.put( _roots );
+}
+
+
+void Flat::append( const Flat & other, std::uint32_t first_leaf )
+{
+    const auto offset{ static_cast< std::uint32_t >( _nodes.size() ) };
+    for( auto n : other._nodes )
+    {
+        n.next += ( n.feature == LEAF ? first_leaf : offset );
+        _nodes.push_back( n );
+    }
+    for( const auto r : other._roots )
+    {
+        _roots.push_back( r + offset );
+    }
+}
+
+
+// Where a node splits, 'feature' is LEAF if it does not.
+struct Split
+{
+    std::uint32_t feature;
+    unsigned bin;
+};
+
+
+std::mt19937_64 seeded( std::uint64_t seed, std::uint64_t tree )
+{
+    std::seed_seq s{ seed, seed >> 32, tree };
+    return std::mt19937_64{ s };
+}
+
+
+// One tree of a forest, its leaves numbered from 0.
+struct Grower
+{
+    Grower( const Binned & data
+          , const std::vector< std::uint32_t > & classes
+          , unsigned num_classes
+          , const ForestParams & p
+          , unsigned features
+          , std::uint64_t tree )
+        : _data{ data }
+        , _classes{ classes }
+        , _k{ num_classes }
+        , _p{ p }
+        , _features{ features }
+        , _rng{ seeded( p.seed, tree ) }
+        , _order( data.num_features() )
+    {
+        for( std::uint32_t f {}; f < _order.size(); ++f )
+        {
+            _order[ f ] = f;
+        }
+    }
+
+
+    void grow()
+    {
+        // Bootstrap sample.
+        std::uniform_int_distribution< std::uint32_t > pick( 0, static_cast< std::uint32_t >( _data.num_rows() - 1 ) );
+        std::vector< std::uint32_t > rows( _data.num_rows() );
+        for( auto & r : rows )
+        {
+            r = pick( _rng );
+        }
+
+        struct Pending
+        {
+            std::uint32_t node;
+            size_t begin;
+            size_t end;
+            unsigned depth;
+        };
+
+        _flat._roots.push_back( 0 );
+        _flat._nodes.push_back( {} );
+        std::vector< Pending > pending{ { 0, 0, rows.size(), 0 } };
+        while( ! pending.empty() )
+        {
+            const auto n{ pending.back() };
+            pending.pop_back();
+
+            _counts.assign( _k, 0 );
+            for( auto i{ n.begin }; i < n.end; ++i )
+            {
+                ++_counts[ _classes[ rows[ i ] ] ];
+            }
+
+            const auto split{ n.depth < _p.max_depth
+                            ? find_split( rows.data() + n.begin, n.end - n.begin )
+                            : Split{ LEAF, 0 } };
+            if( split.feature == LEAF )
+            {
+                _flat._nodes[ n.node ] = { 0, LEAF, static_cast< std::uint32_t >( _leaves.size() / _k ) };
+                for( const auto c : _counts )
+                {
+                    _leaves.push_back( static_cast< float >( c ) / static_cast< float >( n.end - n.begin ) );
+                }
+                continue;
+            }
+
+            const auto column{ _data.column( split.feature ) };
+            const auto mid{ std::partition( rows.begin() + static_cast< std::ptrdiff_t >( n.begin )
+                                          , rows.begin() + static_cast< std::ptrdiff_t >( n.end )
+                                          , [ & ] ( std::uint32_t r ) { return column[ r ] <= split.bin; }
+                                          ) - rows.begin() };
+
+            const auto left{ static_cast< std::uint32_t >( _flat._nodes.size() ) };
+            _flat._nodes.resize( _flat._nodes.size() + 2 );
+            _flat._nodes[ n.node ] = { _data.edge( split.feature, split.bin ), split.feature, left };
+            pending.push_back( { left + 1, static_cast< size_t >( mid ), n.end, n.depth + 1 } );
+            pending.push_back( { left, n.begin, static_cast< size_t >( mid ), n.depth + 1 } );
+        }
+    }
+
+
+    // The split of a node, given '_counts', with the least Gini impurity,
+    // maximising the sum over children of squared class counts by child size.
+    Split find_split( const std::uint32_t * rows, size_t size )
+    {
+        Split ret{ LEAF, 0 };
+        if( size < 2 * std::max( _p.min_leaf, 1u ) )
+        {
+            return ret;
+        }
+
+        double best {};
+        for( const auto c : _counts )
+        {
+            best += 1. * c * c;
+        }
+        best /= static_cast< double >( size );
+        best *= 1 + 1e-12;
+
+        std::uniform_int_distribution< size_t > pick;
+        for( unsigned j {}; j < _features; ++j )
+        {
+            // Draw features without replacement.
+            std::swap( _order[ j ], _order[ j + pick( _rng, decltype( pick )::param_type{ 0, _order.size() - j - 1 } ) ] );
+            const auto f{ _order[ j ] };
+            const auto bins{ _data.bins( f ) };
+            if( bins < 2 )
+            {
+                continue;
+            }
+
+            const auto column{ _data.column( f ) };
+            _hist.assign( bins * _k, 0 );
+            for( size_t i {}; i < size; ++i )
+            {
+                ++_hist[ column[ rows[ i ] ] * _k + _classes[ rows[ i ] ] ];
+            }
+
+            _left.assign( _k, 0 );
+            size_t num_left {};
+            double left_squares {};
+            double right_squares {};
+            for( const auto c : _counts )
+            {
+                right_squares += 1. * c * c;
+            }
+            for( unsigned b {}; b + 1 < bins; ++b )
+            {
+                for( unsigned c {}; c < _k; ++c )
+                {
+                    const auto h{ _hist[ b * _k + c ] };
+                    if( h )
+                    {
+                        const double l{ 1. * _left[ c ] };
+                        const double r{ 1. * _counts[ c ] - l };
+                        left_squares += h * ( 2 * l + h );
+                        right_squares += h * ( h - 2 * r );
+                        _left[ c ] += h;
+                        num_left += h;
+                    }
+                }
+
+                const auto num_right{ size - num_left };
+                if( num_left < _p.min_leaf || num_right < _p.min_leaf || ! num_right )
+                {
+                    continue;
+                }
+                const auto gain{ left_squares / static_cast< double >( num_left )
+                               + right_squares / static_cast< double >( num_right ) };
+                if( gain > best )
+                {
+                    best = gain;
+                    ret = { f, b };
+                }
+            }
+        }
+        return ret;
+    }
+
+
+    const Binned & _data;
+    const std::vector< std::uint32_t > & _classes;
+    const unsigned _k;
+    const ForestParams & _p;
+    const unsigned _features;
+    std::mt19937_64 _rng;
+    std::vector< std::uint32_t > _order;
+    std::vector< std::uint32_t > _counts;
+    std::vector< std::uint32_t > _left;
+    std::vector< std::uint32_t > _hist;
+
+    Flat _flat;
+    std::vector< float > _leaves;
+};
+
+
+Forest::Forest( const std::vector< const double * > & rows
+              , size_t num_features
+              , const std::vector< std::uint32_t > & classes
+              , unsigned num_classes
+              , const ForestParams & p )
+    : _num_classes{ num_classes }
+{
+    if( rows.empty() || rows.size() != classes.size() || ! num_features || ! p.trees )
+    {
+        throw Exception{ "A forest needs rows, features, trees and a class per row." };
+    }
+
+    const Binned data{ rows, num_features, p.bins, p.threads };
+    const auto features{ p.features
+                       ? std::min< unsigned >( p.features, static_cast< unsigned >( num_features ) )
+                       : std::max( static_cast< unsigned >( std::sqrt( num_features ) ), 1u ) };
+
+    std::vector< std::unique_ptr< Grower > > trees( p.trees );
+    task::parallel_for( trees.size()
+                      , [ & ] ( size_t t )
+        {
+            trees[ t ] = std::make_unique< Grower >( data, classes, num_classes, p, features, t );
+            trees[ t ]->grow();
+        }
+                      , p.threads );
+
+    for( const auto & t : trees )
+    {
+        _flat.append( t->_flat, static_cast< std::uint32_t >( _leaves.size() / _num_classes ) );
+        _leaves.insert( _leaves.end(), t->_leaves.cbegin(), t->_leaves.cend() );
+    }
+}
+
+
+Forest::Forest( art::Reader & r, size_t num_features )
+    : _num_classes{ r.get< std::uint32_t >() }
+    , _flat{ r }
+    , _leaves{ r.get_vector< float >() }
+{
+    if( ! _num_classes || _leaves.size() % _num_classes )
+    {
+        throw Exception{ "Corrupt random forest." };
+    }
+    _flat.check( num_features, _leaves.size() / _num_classes );
+}
+
+
+void Forest::save( art::Writer & w ) const
+{
+    w.put( std::uint32_t{ _num_classes } );
+    _flat.save( w );
+    w.put( _leaves );
+}
+
+
+std::vector< float > Forest::predict( const std::vector< const double * > & rows
+                                    , unsigned threads ) const
+{
+    constexpr size_t BLOCK{ 64 };
+    std::vector< float > ret( rows.size() * _num_classes );
+    const auto scale{ 1.f / static_cast< float >( _flat._roots.size() ) };
+
+    task::parallel_for( ( rows.size() + BLOCK - 1 ) / BLOCK
+                      , [ & ] ( size_t block )
+        {
+            const auto end{ std::min( ( block + 1 ) * BLOCK, rows.size() ) };
+            for( size_t t {}; t < _flat._roots.size(); ++t )
+            {
+                for( auto r{ block * BLOCK }; r < end; ++r )
+                {
+                    const auto leaf{ & _leaves[ size_t{ _flat.walk( t, rows[ r ] ) } * _num_classes ] };
+                    const auto out{ & ret[ r * _num_classes ] };
+                    for( unsigned c {}; c < _num_classes; ++c )
+                    {
+                        out[ c ] += leaf[ c ] * scale;
+                    }
+                }
+            }
+        }
+                      , threads );
+    return ret;
+}
+
+
+unsigned Forest::num_classes() const
+{
+    return _num_classes;
+}
+
+
+// Sums over the rows falling into a histogram bin.
+struct GradBin
+{
+    float g;
+    float h;
+    std::uint32_t n;
+};
+
+
+// One tree fitted to the gradients of one class, leaf-wise.
+struct BoostGrower
+{
+    struct Candidate
+    {
+        double gain;
+        std::uint32_t feature;
+        unsigned bin;
+    };
+
+    struct Leaf
+    {
+        std::uint32_t node;
+        size_t begin;
+        size_t end;
+        double g;
+        double h;
+        std::vector< GradBin > hist;
+        Candidate best;
+    };
+
+
+    // 'rows' are indices of binned rows, permuted so leaves own ranges of it.
+    BoostGrower( const Binned & data
+               , const BoostParams & p
+               , const std::vector< std::uint32_t > & features
+               , const float * g
+               , const float * h
+               , std::vector< std::uint32_t > & rows )
+        : _data{ data }
+        , _p{ p }
+        , _features{ features }
+        , _g{ g }
+        , _h{ h }
+        , _rows{ rows }
+    {
+        size_t size {};
+        for( const auto f : _features )
+        {
+            _offsets.push_back( size );
+            size += _data.bins( f );
+        }
+        _hist_size = size;
+    }
+
+
+    void grow()
+    {
+        _flat._roots.push_back( 0 );
+        _flat._nodes.push_back( {} );
+        _leaves.push_back( leaf( 0, 0, _rows.size() ) );
+        fill( _leaves.back() );
+        _leaves.back().best = best_split( _leaves.back() );
+
+        while( _leaves.size() < _p.leaves )
+        {
+            const auto it{ std::max_element( _leaves.begin(), _leaves.end()
+                                           , [] ( const Leaf & a, const Leaf & b ) { return a.best.gain < b.best.gain; } ) };
+            if( it->best.gain <= 0 )
+            {
+                break;
+            }
+
+            auto parent{ std::move( * it ) };
+            const auto f{ parent.best.feature };
+            const auto column{ _data.column( f ) };
+            const auto mid{ static_cast< size_t >(
+                std::partition( _rows.begin() + static_cast< std::ptrdiff_t >( parent.begin )
+                              , _rows.begin() + static_cast< std::ptrdiff_t >( parent.end )
+                              , [ & ] ( std::uint32_t r ) { return column[ r ] <= parent.best.bin; }
+                              ) - _rows.begin() ) };
+
+            const auto left_node{ static_cast< std::uint32_t >( _flat._nodes.size() ) };
+            _flat._nodes.resize( _flat._nodes.size() + 2 );
+            _flat._nodes[ parent.node ] = { _data.edge( f, parent.best.bin ), f, left_node };
+
+            auto left{ leaf( left_node, parent.begin, mid ) };
+            auto right{ leaf( left_node + 1, mid, parent.end ) };
+
+            // The histogram subtraction trick.
+            auto & smaller{ mid - parent.begin < parent.end - mid ? left : right };
+            auto & larger{ & smaller == & left ? right : left };
+            fill( smaller );
+            larger.hist = std::move( parent.hist );
+            for( size_t i {}; i < _hist_size; ++i )
+            {
+                larger.hist[ i ].g -= smaller.hist[ i ].g;
+                larger.hist[ i ].h -= smaller.hist[ i ].h;
+                larger.hist[ i ].n -= smaller.hist[ i ].n;
+            }
+
+            left.best = best_split( left );
+            right.best = best_split( right );
+            * it = std::move( left );
+            _leaves.push_back( std::move( right ) );
+        }
+
+        for( std::uint32_t l {}; l < _leaves.size(); ++l )
+        {
+            _flat._nodes[ _leaves[ l ].node ] = { 0, LEAF, l };
+            _values.push_back( static_cast< float >( - _p.learning_rate * _leaves[ l ].g
+                                                     / ( _leaves[ l ].h + _p.lambda ) ) );
+        }
+    }
+
+
+    Leaf leaf( std::uint32_t node, size_t begin, size_t end ) const
+    {
+        Leaf ret{ node, begin, end, 0, 0, {}, { 0, 0, 0 } };
+        for( auto i{ begin }; i < end; ++i )
+        {
+            ret.g += _g[ _rows[ i ] ];
+            ret.h += _h[ _rows[ i ] ];
+        }
+        return ret;
+    }
+
+
+    // Histograms of blocks of features in parallel, small leaves on one thread.
+    void fill( Leaf & l ) const
+    {
+        constexpr size_t BLOCK{ 32 };
+        l.hist.assign( _hist_size, {} );
+        const auto work{ ( l.end - l.begin ) * _features.size() };
+        task::parallel_for( ( _features.size() + BLOCK - 1 ) / BLOCK
+                          , [ & ] ( size_t block )
+            {
+                const auto end{ std::min( ( block + 1 ) * BLOCK, _features.size() ) };
+                for( auto j{ block * BLOCK }; j < end; ++j )
+                {
+                    const auto column{ _data.column( _features[ j ] ) };
+                    const auto out{ & l.hist[ _offsets[ j ] ] };
+                    for( auto i{ l.begin }; i < l.end; ++i )
+                    {
+                        const auto r{ _rows[ i ] };
+                        auto & bin{ out[ column[ r ] ] };
+                        bin.g += _g[ r ];
+                        bin.h += _h[ r ];
+                        ++bin.n;
+                    }
+                }
+            }
+                          , work < ( 1u << 18 ) ? 1 : _p.threads );
+    }
+
+
+    Candidate best_split( const Leaf & l ) const
+    {
+        Candidate ret{ 0, 0, 0 };
+        const auto size{ l.end - l.begin };
+        if( size < 2 * std::max( _p.min_leaf, 1u ) )
+        {
+            return ret;
+        }
+
+        const auto parent{ l.g * l.g / ( l.h + _p.lambda ) };
+        for( size_t j {}; j < _features.size(); ++j )
+        {
+            const auto bins{ _data.bins( _features[ j ] ) };
+            const auto hist{ & l.hist[ _offsets[ j ] ] };
+            double g {};
+            double h {};
+            size_t n {};
+            for( unsigned b {}; b + 1 < bins; ++b )
+            {
+                g += hist[ b ].g;
+                h += hist[ b ].h;
+                n += hist[ b ].n;
+                if( n < _p.min_leaf )
+                {
+                    continue;
+                }
+                if( size - n < _p.min_leaf )
+                {
+                    break;
+                }
+                const auto gain{ g * g / ( h + _p.lambda )
+                               + ( l.g - g ) * ( l.g - g ) / ( l.h - h + _p.lambda )
+                               - parent };
+                if( gain > ret.gain )
+                {
+                    ret = { gain, _features[ j ], b };
+                }
+            }
+        }
+        return ret;
+    }
+
+
+    const Binned & _data;
+    const BoostParams & _p;
+    const std::vector< std::uint32_t > & _features;
+    const float * const _g;
+    const float * const _h;
+    std::vector< std::uint32_t > & _rows;
+    std::vector< size_t > _offsets;
+    size_t _hist_size;
+
+    std::vector< Leaf > _leaves;
+    Flat _flat;
+    std::vector< float > _values;
+};
+
+
+// In place, returns the log of the sum of exponentials.
+double softmax( float * f, unsigned n )
+{
+    const auto max{ * std::max_element( f, f + n ) };
+    double sum {};
+    for( unsigned k {}; k < n; ++k )
+    {
+        sum += std::exp( f[ k ] - max );
+    }
+    for( unsigned k {}; k < n; ++k )
+    {
+        f[ k ] = static_cast< float >( std::exp( f[ k ] - max ) / sum );
+    }
+    return max + std::log( sum );
+}
+
+
+Boosted::Boosted( const std::vector< const double * > & rows
+                , size_t num_features
+                , const std::vector< std::uint32_t > & classes
+                , unsigned num_classes
+                , const BoostParams & p )
+    : _num_classes{ num_classes }
+{
+    if( rows.empty() || rows.size() != classes.size() || ! num_features || ! num_classes )
+    {
+        throw Exception{ "Boosting needs rows, features, classes and a class per row." };
+    }
+
+    // Hold out every n-th row of each class.
+    const auto every{ p.validation > 0
+                    ? std::max( static_cast< unsigned >( std::lround( 1 / p.validation ) ), 2u )
+                    : 0u };
+    std::vector< unsigned > seen( num_classes );
+    std::vector< const double * > train;
+    std::vector< std::uint32_t > train_classes;
+    std::vector< const double * > valid;
+    std::vector< std::uint32_t > valid_classes;
+    for( size_t r {}; r < rows.size(); ++r )
+    {
+        const auto c{ classes[ r ] };
+        const auto hold_out{ every && ++seen[ c ] % every == 0 };
+        ( hold_out ? valid : train ).push_back( rows[ r ] );
+        ( hold_out ? valid_classes : train_classes ).push_back( c );
+    }
+
+    const Binned data{ train, num_features, MAX_BINS, p.threads };
+    const auto n{ train.size() };
+    const auto k{ num_classes };
+
+    std::vector< size_t > counts( k );
+    for( const auto c : train_classes )
+    {
+        ++counts[ c ];
+    }
+    for( const auto c : counts )
+    {
+        _base.push_back( static_cast< float >( std::log( ( c + 1. ) / static_cast< double >( n + k ) ) ) );
+    }
+
+    // Raw scores, 'k' per row.
+    std::vector< float > scores;
+    for( size_t r {}; r < n; ++r )
+    {
+        scores.insert( scores.end(), _base.cbegin(), _base.cend() );
+    }
+    std::vector< float > valid_scores;
+    for( size_t r {}; r < valid.size(); ++r )
+    {
+        valid_scores.insert( valid_scores.end(), _base.cbegin(), _base.cend() );
+    }
+
+    std::vector< std::uint32_t > all_features( num_features );
+    for( std::uint32_t f {}; f < num_features; ++f )
+    {
+        all_features[ f ] = f;
+    }
+    const auto num_sampled{ std::clamp< size_t >( static_cast< size_t >( p.features * static_cast< float >( num_features ) )
+                                                , 1, num_features ) };
+    auto rng{ seeded( p.seed, 0 ) };
+
+    std::vector< float > g( k * n );
+    std::vector< float > h( k * n );
+    std::vector< float > prob( k );
+    std::vector< std::uint32_t > order( n );
+
+    // Sizes after each round, to keep the best rounds only.
+    std::vector< std::pair< size_t, size_t > > sizes{ { 0, 0 } };
+    auto best_loss{ std::numeric_limits< double >::infinity() };
+    size_t best_round {};
+
+    for( size_t round {}; round < p.rounds; ++round )
+    {
+        for( size_t r {}; r < n; ++r )
+        {
+            std::copy_n( & scores[ r * k ], k, prob.begin() );
+            softmax( prob.data(), k );
+            for( unsigned c {}; c < k; ++c )
+            {
+                const auto y{ train_classes[ r ] == c ? 1.f : 0.f };
+                g[ c * n + r ] = prob[ c ] - y;
+                h[ c * n + r ] = std::max( prob[ c ] * ( 1 - prob[ c ] ), 1e-6f );
+            }
+        }
+
+        for( unsigned c {}; c < k; ++c )
+        {
+            // Sorted so histograms are filled in memory order.
+            std::shuffle( all_features.begin(), all_features.end(), rng );
+            std::vector< std::uint32_t > features( all_features.cbegin()
+                                                 , all_features.cbegin() + static_cast< std::ptrdiff_t >( num_sampled ) );
+            std::sort( features.begin(), features.end() );
+            for( std::uint32_t r {}; r < n; ++r )
+            {
+                order[ r ] = r;
+            }
+
+            BoostGrower t{ data, p, features, & g[ c * n ], & h[ c * n ], order };
+            t.grow();
+
+            for( const auto & l : t._leaves )
+            {
+                const auto v{ t._values[ t._flat._nodes[ l.node ].next ] };
+                for( auto i{ l.begin }; i < l.end; ++i )
+                {
+                    scores[ order[ i ] * k + c ] += v;
+                }
+            }
+            for( size_t r {}; r < valid.size(); ++r )
+            {
+                valid_scores[ r * k + c ] += t._values[ t._flat.walk( 0, valid[ r ] ) ];
+            }
+
+            _flat.append( t._flat, static_cast< std::uint32_t >( _leaves.size() ) );
+            _leaves.insert( _leaves.end(), t._values.cbegin(), t._values.cend() );
+        }
+        sizes.emplace_back( _flat._nodes.size(), _leaves.size() );
+
+        if( valid.empty() )
+        {
+            best_round = round + 1;
+            continue;
+        }
+        double loss {};
+        for( size_t r {}; r < valid.size(); ++r )
+        {
+            std::copy_n( & valid_scores[ r * k ], k, prob.begin() );
+            loss += softmax( prob.data(), k ) - valid_scores[ r * k + valid_classes[ r ] ];
+        }
+        loss /= static_cast< double >( valid.size() );
+        if( loss < best_loss )
+        {
+            best_loss = loss;
+            best_round = round + 1;
+        }
+        else if( round + 1 - best_round >= p.patience )
+        {
+            break;
+        }
+    }
+
+    _flat._roots.resize( best_round * k );
+    _flat._nodes.resize( sizes[ best_round ].first );
+    _leaves.resize( sizes[ best_round ].second );
+}
+
+
+Boosted::Boosted( art::Reader & r, size_t num_features )
+    : _num_classes{ r.get< std::uint32_t >() }
+    , _base{ r.get_vector< float >() }
+    , _flat{ r }
+    , _leaves{ r.get_vector< float >() }
+{
+    if( _base.size() != _num_classes || _flat._roots.size() % std::max( _num_classes, 1u ) )
+    {
+        throw Exception{ "Corrupt boosted trees." };
+    }
+    _flat.check( num_features, _leaves.size() );
+}
+
+
+void Boosted::save( art::Writer & w ) const
+{
+    w.put( std::uint32_t{ _num_classes } );
+    w.put( _base );
+    _flat.save( w );
+    w.put( _leaves );
+}
+
+
+std::vector< float > Boosted::predict( const std::vector< const double * > & rows
+                                     , unsigned threads ) const
+{
+    constexpr size_t BLOCK{ 64 };
+    const auto k{ _num_classes };
+    std::vector< float > ret( rows.size() * k );
+    task::parallel_for( ( rows.size() + BLOCK - 1 ) / BLOCK
+                      , [ & ] ( size_t block )
+        {
+            const auto end{ std::min( ( block + 1 ) * BLOCK, rows.size() ) };
+            for( auto r{ block * BLOCK }; r < end; ++r )
+            {
+                std::copy( _base.cbegin(), _base.cend(), & ret[ r * k ] );
+            }
+            for( size_t t {}; t < _flat._roots.size(); ++t )
+            {
+                const auto c{ t % k };
+                for( auto r{ block * BLOCK }; r < end; ++r )
+                {
+                    ret[ r * k + c ] += _leaves[ _flat.walk( t, rows[ r ] ) ];
+                }
+            }
+            for( auto r{ block * BLOCK }; r < end; ++r )
+            {
+                softmax( & ret[ r * k ], k );
+            }
+        }
+                      , threads );
+    return ret;
+}
+
+
+unsigned Boosted::num_classes() const
+{
+    return _num_classes;
+}
+
+
+size_t Boosted::rounds() const
+{
+    return _flat._roots.size() / std::max( _num_classes, 1u );
+}
+
+
+}  // namespace tree
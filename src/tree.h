@@ -0,0 +1,200 @@
+#ifndef TREE_H_
+#define TREE_H_
+
+
+// In this file: decision trees over histogram-binned features.
+//
+// Training bins every feature once into at most 256 quantile bins, so split
+// finding scans small per-node histograms instead of sorting values.
+// Trained trees are flattened into one contiguous array of nodes whose
+// thresholds are the bins' edges, so inference reads the raw features.
+
+
+#include "art.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+
+namespace tree
+{
+
+
+constexpr unsigned MAX_BINS{ 256 };
+
+
+// A dataset binned per feature, and the bins' edges.
+struct Binned
+{
+    // 'rows' point to 'num_features' values each.
+    // Edges are quantiles of up to 'max_bins' bins, computed on 'threads' threads.
+    Binned( const std::vector< const double * > & rows
+          , size_t num_features
+          , unsigned max_bins
+          , unsigned threads );
+
+    size_t num_rows() const;
+    size_t num_features() const;
+
+    // The bin of every row, for one feature.
+    const std::uint8_t * column( size_t feature ) const;
+    unsigned bins( size_t feature ) const;
+    // A value falls into a bin up to 'bin' exactly when it is below this edge;
+    // 'bin' is below 'bins( feature ) - 1'.
+    double edge( size_t feature, unsigned bin ) const;
+
+private:
+    size_t _num_rows;
+    size_t _num_features;
+    std::vector< std::vector< double > > _edges;
+    // Feature major.
+    std::vector< std::uint8_t > _bins;
+};
+
+
+constexpr std::uint32_t LEAF{ std::numeric_limits< std::uint32_t >::max() };
+
+
+// A branch sends values below 'threshold' to node 'next', others to 'next' + 1.
+// A leaf has 'feature' LEAF and 'next' numbering its value.
+struct Node
+{
+    double threshold;
+    std::uint32_t feature;
+    std::uint32_t next;
+};
+
+
+// Trees in one array of nodes, children next to each other.
+struct Flat
+{
+    Flat() = default;
+    Flat( art::Reader & );
+    void save( art::Writer & ) const;
+
+    // Throws unless every walk ends in one of 'num_leaves', reading features
+    // below 'num_features' on the way; for trees read from an artifact.
+    void check( size_t num_features, size_t num_leaves ) const;
+
+    // Append the trees of another, its leaves numbered from 'first_leaf' on.
+    void append( const Flat &, std::uint32_t first_leaf );
+
+    // The number of the leaf 'x' ends in.
+    std::uint32_t walk( size_t tree, const double * x ) const
+    {
+        auto n{ & _nodes[ _roots[ tree ] ] };
+        while( n->feature != LEAF )
+        {
+            n = & _nodes[ n->next + ( x[ n->feature ] < n->threshold ? 0 : 1 ) ];
+        }
+        return n->next;
+    }
+
+    std::vector< Node > _nodes;
+    std::vector< std::uint32_t > _roots;
+};
+
+
+struct ForestParams
+{
+    unsigned trees{ 100 };
+    unsigned max_depth{ 32 };
+    // Fewest rows in a leaf.
+    unsigned min_leaf{ 1 };
+    // Features tried per split; 0 means the square root of their count.
+    unsigned features{ 0 };
+    unsigned bins{ 64 };
+    unsigned threads{ 1 };
+    std::uint64_t seed{ 0 };
+};
+
+
+// Classification trees on bootstrap samples, split by Gini impurity.
+// Leaves hold the class distribution of their rows.
+struct Forest
+{
+    // 'classes' holds a class, below 'num_classes', per row of the rows binned.
+    Forest( const std::vector< const double * > & rows
+          , size_t num_features
+          , const std::vector< std::uint32_t > & classes
+          , unsigned num_classes
+          , const ForestParams & );
+    Forest( art::Reader &, size_t num_features );
+    void save( art::Writer & ) const;
+
+    // Class probabilities averaged over the trees, 'num_classes()' per row.
+    // Every tree walks a block of rows in turn, while its nodes are cached.
+    std::vector< float > predict( const std::vector< const double * > & rows
+                                , unsigned threads ) const;
+
+    unsigned num_classes() const;
+
+private:
+    unsigned _num_classes;
+    Flat _flat;
+    // 'num_classes()' per leaf.
+    std::vector< float > _leaves;
+};
+
+
+struct BoostParams
+{
+    // Most boosting rounds, each adding a tree per class.
+    unsigned rounds{ 100 };
+    // Most leaves per tree.
+    unsigned leaves{ 15 };
+    float learning_rate{ 0.1f };
+    // Fewest rows in a leaf.
+    unsigned min_leaf{ 20 };
+    // L2 regularisation of the leaf values.
+    float lambda{ 1 };
+    // Share of the features each tree is grown on.
+    float features{ 0.1f };
+    // Share of the rows held out for early stopping, 0 disables it.
+    float validation{ 0.1f };
+    // Rounds without a lower validation loss before stopping.
+    unsigned patience{ 10 };
+    unsigned threads{ 1 };
+    std::uint64_t seed{ 0 };
+};
+
+
+// Gradient boosted trees minimising the multiclass softmax loss.
+// Features are binned into 256 bins; trees grow leaf-wise, always splitting
+// the leaf with the best gain. A child's histogram is built from its rows
+// only for the smaller child, the other is its parent's minus the smaller.
+// Early stopping keeps the rounds with the lowest loss on the held out rows.
+struct Boosted
+{
+    Boosted( const std::vector< const double * > & rows
+           , size_t num_features
+           , const std::vector< std::uint32_t > & classes
+           , unsigned num_classes
+           , const BoostParams & );
+    Boosted( art::Reader &, size_t num_features );
+    void save( art::Writer & ) const;
+
+    // Class probabilities, 'num_classes()' per row.
+    std::vector< float > predict( const std::vector< const double * > & rows
+                                , unsigned threads ) const;
+
+    unsigned num_classes() const;
+    // Trees per class kept.
+    size_t rounds() const;
+
+private:
+    unsigned _num_classes;
+    // Log priors of the classes.
+    std::vector< float > _base;
+    // Round major, in each round a tree per class.
+    Flat _flat;
+    // A value per leaf.
+    std::vector< float > _leaves;
+};
+
+
+}  // namespace tree
+
+
+#endif  // defined(TREE_H_)
@@ -0,0 +1,124 @@
+// Checks of the sweep spooled to worker processes, see src/spool.h: cells run
+// on the dataset cached or in shared memory as they run in process.
+//
+// This very program is the workers, started as "rocks -j <threads> -W <dir>".
+
+
+#include "except.h"
+#include "opt.h"
+#include "res.h"
+#include "shm.h"
+#include "spool.h"
+#include "sweep.h"
+#include "task.h"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+int failures {};
+
+
+void check( bool ok, const std::string & what )
+{
+    if( ! ok )
+    {
+        std::cerr << "failed: " << what << '\n';
+        ++failures;
+    }
+}
+
+
+// At labels depth 2, "/a/x" and "/a/y" lie either side of "/b/z": told apart
+// there, while at depth 1 the centroid of "/a" is that of "/b".
+dat::DataRaw dataset()
+{
+    dat::DataRaw ret;
+    for( unsigned i {}; i < 12; ++i )
+    {
+        dat::Spectrum x {}, y {}, z {};
+        x._y[ 0 ] = 10. + i * .01;
+        y._y[ 1 ] = 10. + i * .01;
+        z._y[ 0 ] = z._y[ 1 ] = 5. + i * .01;
+        ret[ "/a/x" ].push_back( x );
+        ret[ "/a/y" ].push_back( y );
+        ret[ "/b/z" ].push_back( z );
+    }
+    return ret;
+}
+
+
+// The single record of 'store'.
+res::Record record( const fs::path & store )
+{
+    const auto records{ res::open( store )->records() };
+    if( records.size() != 1 )
+    {
+        throw Exception{ "Expected a record in '" + store.string() + "', found " + std::to_string( records.size() ) + '.' };
+    }
+    return records.front();
+}
+
+
+// A depth 2 cell gives the same results in process and by workers, whether
+// the spool holds the dataset in a cache file or in shared memory.
+void depths( const fs::path & tmp )
+{
+    const auto name{ "/rocks-spool-test-" + std::to_string( ::getpid() ) };
+    const auto published{ shm::Segment::publish( name, dataset(), 2 ) };
+    const auto data_dir{ shm::PREFIX + name };
+    const std::vector< sweep::Cell > cells{ { "centroid", {}, 2, 0 } };
+
+    std::ostringstream out;
+    sweep::run( dataset(), data_dir, cells, res::open( tmp / "process" ).get(), out );
+    spool::run( tmp / "spool", data_dir, cells, tmp / "cache", 2, out );
+    opt::set( "spool.dataset=shm" );
+    spool::run( tmp / "spool", data_dir, cells, tmp / "shm", 2, out );
+
+    const auto in_process{ record( tmp / "process" ) };
+    check( in_process._accuracy == 1., "the labels of depth 2 tell the heads apart" );
+    for( const auto store : { "cache", "shm" } )
+    {
+        const auto spooled{ record( tmp / store ) };
+        check( spooled._cell._labels_depth == 2, std::string{ "the spooled cell is of depth 2, " } + store );
+        check( spooled._confusion == in_process._confusion, std::string{ "the confusion is that in process, " } + store );
+    }
+}
+
+
+int main( int argc, char ** argv )
+{
+    if( argc == 5 && std::string{ argv[ 3 ] } == "-W" )
+    {
+        task::set_concurrency( static_cast< unsigned >( std::stoul( argv[ 2 ] ) ) );
+        spool::work( argv[ 4 ] );
+        return 0;
+    }
+
+    const auto tmp{ fs::temp_directory_path() / ( "rocks-spool-test-" + std::to_string( ::getpid() ) ) };
+    fs::create_directories( tmp );
+    try
+    {
+        depths( tmp );
+    }
+    catch( const std::exception & e )
+    {
+        check( false, e.what() );
+    }
+    fs::remove_all( tmp );
+
+    if( failures )
+    {
+        std::cerr << failures << " checks failed.\n";
+        return 1;
+    }
+    std::cout << "All checks passed.\n";
+}
@@ -0,0 +1,201 @@
+// Checks of the thread pool, see src/task.h: nested loops, exceptions,
+// cancellation and continuations.
+
+
+#include "except.h"
+#include "task.h"
+
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+
+int failures {};
+
+
+void check( bool ok, const std::string & what )
+{
+    if( ! ok )
+    {
+        std::cerr << "failed: " << what << '\n';
+        ++failures;
+    }
+}
+
+
+// Loops inside loops run every call once, however few threads are left.
+void nested()
+{
+    std::atomic< size_t > calls {};
+    task::parallel_for( 8, [ & ] ( size_t )
+        {
+            task::parallel_for( 8, [ & ] ( size_t )
+                {
+                    task::parallel_for( 8, [ & ] ( size_t ) { ++calls; } );
+                } );
+        } );
+    check( calls == 8 * 8 * 8, "nested parallel_for calls every index once" );
+}
+
+
+// The first exception reaches the caller, after the calls in progress finish.
+void exceptions()
+{
+    std::atomic< unsigned > running {};
+    std::atomic< bool > overlapped {};
+    try
+    {
+        task::parallel_for( 1000, [ & ] ( size_t i )
+            {
+                ++running;
+                if( i == 10 )
+                {
+                    --running;
+                    throw std::runtime_error{ "ten" };
+                }
+                std::this_thread::yield();
+                --running;
+            } );
+        check( false, "parallel_for rethrows" );
+    }
+    catch( const std::runtime_error & e )
+    {
+        check( std::string{ e.what() } == "ten", "parallel_for rethrows what was thrown" );
+        overlapped = running != 0;
+    }
+    check( ! overlapped, "parallel_for returns after the calls in progress" );
+
+    auto f{ task::async( [] () -> int { throw Exception{ "async" }; } ) };
+    try
+    {
+        f.get();
+        check( false, "a future rethrows" );
+    }
+    catch( const Exception & e )
+    {
+        check( std::string{ e.what() } == "async", "a future rethrows what was thrown" );
+    }
+
+    check( task::async( [] { return 42; } ).get() == 42, "a future returns the result" );
+}
+
+
+// A job cancelled before it starts never runs, its future throws 'Cancelled'.
+void cancel()
+{
+    // Keeps the only worker busy, so that the job cancelled cannot start.
+    std::atomic< bool > started {};
+    std::atomic< bool > release {};
+    auto busy{ task::async( [ & ]
+        {
+            started = true;
+            while( ! release )
+            {
+                std::this_thread::yield();
+            }
+        } ) };
+    while( ! started )
+    {
+        std::this_thread::yield();
+    }
+
+    std::atomic< bool > ran {};
+    auto f{ task::async( [ & ] { ran = true; } ) };
+    f.cancel();
+    try
+    {
+        f.get();
+        check( false, "a cancelled future throws" );
+    }
+    catch( const task::Cancelled & )
+    {
+    }
+    release = true;
+    busy.get();
+    check( ! ran, "a cancelled job does not run" );
+
+    auto done{ task::async( [] { return 1; } ) };
+    done.wait();
+    done.cancel();
+    check( done.get() == 1, "cancelling a finished job keeps its result" );
+}
+
+
+// Continuations run on the result, exceptions and cancellation pass through them.
+void continuations()
+{
+    auto doubled{ task::async( [] { return 21; } ).then( [] ( int i ) { return i * 2; } ) };
+    check( doubled.get() == 42, "a continuation gets the result" );
+
+    std::atomic< bool > called {};
+    auto chained{ task::async( [] {} ).then( [ & ] { called = true; } ).then( [ & ] { return called.load(); } ) };
+    check( chained.get(), "continuations run in order" );
+
+    called = false;
+    auto failed{ task::async( [] () -> int { throw Exception{ "parent" }; } )
+                     .then( [ & ] ( int i ) { called = true; return i; } ) };
+    try
+    {
+        failed.get();
+        check( false, "a continuation rethrows its parent's exception" );
+    }
+    catch( const Exception & e )
+    {
+        check( std::string{ e.what() } == "parent", "a continuation rethrows what its parent threw" );
+    }
+    check( ! called, "a failed parent skips its continuation" );
+
+    // The only worker busy, the parent cannot start before it is cancelled.
+    std::atomic< bool > started {};
+    std::atomic< bool > release {};
+    auto busy{ task::async( [ & ]
+        {
+            started = true;
+            while( ! release )
+            {
+                std::this_thread::yield();
+            }
+        } ) };
+    while( ! started )
+    {
+        std::this_thread::yield();
+    }
+
+    std::atomic< bool > ran {};
+    called = false;
+    auto parent{ task::async( [ & ] { ran = true; } ) };
+    auto next{ parent.then( [ & ] { called = true; } ) };
+    parent.cancel();
+    try
+    {
+        next.get();
+        check( false, "the continuation of a cancelled parent throws" );
+    }
+    catch( const task::Cancelled & )
+    {
+    }
+    release = true;
+    busy.get();
+    check( ! ran && ! called, "neither a cancelled parent nor its continuation runs" );
+}
+
+
+int main()
+{
+    // One worker, the main thread being the other.
+    task::set_concurrency( 2 );
+
+    nested();
+    exceptions();
+    cancel();
+    continuations();
+
+    if( failures )
+    {
+        std::cerr << failures << " checks failed.\n";
+        return 1;
+    }
+    std::cout << "All checks passed.\n";
+}